@@ -0,0 +1,399 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "MailClient.hpp"
+#include "Result.hpp"
+
+using namespace std;
+using namespace post;
+
+namespace mail_client {
+
+    /**
+     * Mail Client which is composed at compile time: protocol and transport
+     * are template parameters instead of Post Provider and Transport Layer
+     * Provider pointers, so there is no virtual call and no shared pointer
+     * between a command and the socket.
+     * Protocol is a class with static methods `signin', `signout',
+     * `stat', `list', `uidl', `top' and `retr' which take transport as
+     * a channel and command buffer of session and return ErrorCode (see
+     * POP3Protocol).
+     * Transport is held by value and should provide `connect', `disconnect',
+     * `isConnected', `getGreeting', `transmit' and `receiveInto' like
+     * Transport Layer Provider.
+     * MailClient is the dynamic counterpart of this class.
+     *
+     * Every operation has two forms: `tryX' returns Result and doesn't
+     * throw on ordinary failures (bad credentials, negative response,
+     * lost connection), `X' throws MailClientException like MailClient.
+     */
+    template <class Protocol, class Transport>
+    class BasicMailClient {
+        protected:
+            Transport transport;
+            State state;
+            /**
+             * Command buffer which is reused by every command of session.
+             */
+            string buffer;
+            /**
+             * Server of the last connection as `host:port'.
+             */
+            string server;
+            /**
+             * Capabilities which server announced before authorization.
+             */
+            strings capabilities;
+
+            Result checkState (State required) {
+                if (!this->transport.isConnected()) {
+                    return Result(NOT_CONNECTED);
+                }
+                if (this->state != required) {
+                    return Result(WRONG_STATE);
+                }
+                return Result();
+            }
+
+            /**
+             * Throw exception if operation failed.
+             * @param result Result of operation.
+             * @param subject ID of letter to add to error message.
+             * @throws MailClientException Thrown if result isn't
+             * successful.
+             */
+            static void raise (Result result,
+                               const string& subject = string())
+                              throw(MailClientException) {
+                if (result.error() == NOT_CONNECTED) {
+                    throw ClosedConnectionException();
+                }
+                if (!result) {
+                    string message = string("An error occured: ") +
+                                     result.what();
+                    if (!subject.empty()) {
+                        message += " Message " + subject + ".";
+                    }
+                    throw MailClientException(message);
+                }
+            }
+        public:
+            BasicMailClient () {
+                this->state = DISCONNECTED;
+            }
+
+            /**
+             * Connect to mail server.
+             * @param server Server IP or url.
+             * @param port Port to connect to.
+             * @return Returns TRANSPORT_FAILED if connection can't be
+             * established.
+             */
+            Result tryConnect (const string& host, const string& port) {
+                try {
+                    this->transport.connect(host, port);
+                }
+                catch (const TransportException& e) {
+                    return Result(TRANSPORT_FAILED);
+                }
+                this->server = host + ":" + port;
+                this->state = LOGIN_REQUIRED;
+                return Result();
+            }
+
+            /**
+             * Connect to mail server.
+             * @param server Server IP or url.
+             * @param port Port to connect to.
+             * @throws MailClientException Thrown if connection operation was
+             * failed.
+             */
+            void connect (const string& host, const string& port)
+                         throw(MailClientException) {
+                try {
+                    this->transport.connect(host, port);
+                }
+                catch (const TransportException& e) {
+                    throw ConnectionError(string(e.what()));
+                }
+                this->server = host + ":" + port;
+                this->state = LOGIN_REQUIRED;
+            }
+
+            /**
+             * Sign in to mailbox.
+             * @param login User name.
+             * @param password User password.
+             * @return Returns AUTHORIZATION_FAILED if login or password is
+             * wrong and TEMPORARY_FAILURE if mailbox is locked or server
+             * is busy.
+             */
+            Result trySignin (const string& login, const string& password) {
+                Result result = this->checkState(LOGIN_REQUIRED);
+                if (!result) {
+                    return result;
+                }
+                // Login and password may go in one packet, so there is no
+                // PASSWORD_REQUIRED state in between
+                result = this->execute([&] () {
+                    return Protocol::signin(this->transport, this->buffer,
+                                            this->server,
+                                            this->transport.getGreeting(),
+                                            login, password,
+                                            this->capabilities);
+                });
+                if (result) {
+                    this->state = AUTHORIZED;
+                }
+                else if (result.error() == NEGATIVE_RESPONSE) {
+                    result = Result(AUTHORIZATION_FAILED);
+                }
+                return result;
+            }
+
+            /**
+             * Sign in to mailbox.
+             * @param login User name.
+             * @param password User password.
+             * @throws MailClientException Thrown if connection wasn't
+             * established, if user is already authorized or if login or
+             * password is wrong.
+             */
+            void signin (const string& login, const string& password)
+                        throw(MailClientException) {
+                raise(this->trySignin(login, password));
+            }
+
+            /**
+             * Sign out from mailbox.
+             */
+            Result trySignout () {
+                Result result = this->checkState(AUTHORIZED);
+                if (result) {
+                    result = this->execute([&] () {
+                        return Protocol::signout(this->transport, this->buffer);
+                    });
+                }
+                if (result) {
+                    this->state = LOGIN_REQUIRED;
+                }
+                return result;
+            }
+
+            /**
+             * Sign out from mailbox.
+             * @throws MailClientException Thrown if not authorized.
+             */
+            void signout () throw(MailClientException) {
+                raise(this->trySignout());
+            }
+
+            /**
+             * Get IDs (numbers) of letters and their sizes.
+             * @param ids Reference to vector where IDs will be stored.
+             * @param sizes Reference to vector where sizes will be stored.
+             */
+            Result tryGetLettersIDs (strings& ids, vector<size_t>& sizes) {
+                return this->run([&] () {
+                    return Protocol::list(this->transport, this->buffer, ids,
+                                          sizes);
+                });
+            }
+
+            /**
+             * Get IDs (numbers) of letters and their sizes.
+             * @param ids Reference to vector where IDs will be stored.
+             * @param sizes Reference to vector where sizes will be stored.
+             * @throws MailClientException Thrown if not authorized.
+             */
+            void getLettersIDs (strings& ids, vector<size_t>& sizes)
+                               throw(MailClientException) {
+                raise(this->tryGetLettersIDs(ids, sizes));
+            }
+
+            /**
+             * Get number of letters and size of mailbox.
+             * @param count Reference to write number of letters to it.
+             * @param octets Reference to write size of mailbox to it.
+             */
+            Result tryGetMailboxStat (size_t& count, size_t& octets) {
+                return this->run([&] () {
+                    return Protocol::stat(this->transport, this->buffer,
+                                          count, octets);
+                });
+            }
+
+            /**
+             * Get unique ID of one letter.
+             * @param id ID of letter.
+             * @param uid Reference to write unique ID to it.
+             * @return Returns NEGATIVE_RESPONSE if there is no such letter
+             * or server doesn't support unique IDs.
+             */
+            Result tryGetLetterUID (const string& id, string& uid) {
+                return this->run([&] () {
+                    return Protocol::uidl(this->transport, this->buffer, id,
+                                          uid);
+                });
+            }
+
+            /**
+             * Get unique IDs of letters.
+             * @param uids Reference to map where ID -> unique ID pairs will
+             * be stored.
+             * @return Returns NEGATIVE_RESPONSE if server doesn't support
+             * unique IDs.
+             */
+            Result tryGetLettersUIDs (unordered_map<string, string>& uids) {
+                return this->run([&] () {
+                    return Protocol::uidl(this->transport, this->buffer, uids);
+                });
+            }
+
+            /**
+             * Get unique IDs of letters.
+             * @param uids Reference to map where ID -> unique ID pairs will
+             * be stored.
+             * @throws MailClientException Thrown if not authorized or if
+             * server doesn't support unique IDs.
+             */
+            void getLettersUIDs (unordered_map<string, string>& uids)
+                                throw(MailClientException) {
+                raise(this->tryGetLettersUIDs(uids));
+            }
+
+            /**
+             * Get header of one letter.
+             * @param id ID of letter.
+             * @param header Reference to string where header will be stored.
+             * @return Returns NEGATIVE_RESPONSE if there is no such letter.
+             */
+            Result tryGetLetterHeader (const string& id, string& header) {
+                return this->run([&] () {
+                    return Protocol::top(this->transport, this->buffer, id,
+                                         header);
+                });
+            }
+
+            /**
+             * Get header of one letter.
+             * @param id ID of letter.
+             * @param header Reference to string where header will be stored.
+             * @throws MailClientException Thrown if not authorized or if
+             * letter can't be received.
+             */
+            void getLetterHeader (const string& id, string& header)
+                                 throw(MailClientException) {
+                raise(this->tryGetLetterHeader(id, header), id);
+            }
+
+            /**
+             * Get whole letter.
+             * @param id ID of letter.
+             * @param letter Reference to string where letter will be stored.
+             * @return Returns NEGATIVE_RESPONSE if there is no such letter.
+             */
+            Result tryGetLetter (const string& id, string& letter) {
+                return this->run([&] () {
+                    return Protocol::retr(this->transport, this->buffer, id,
+                                          letter);
+                });
+            }
+
+            /**
+             * Get whole letter.
+             * @param id ID of letter.
+             * @param letter Reference to string where letter will be stored.
+             * @throws MailClientException Thrown if not authorized or if
+             * letter can't be received.
+             */
+            void getLetter (const string& id, string& letter)
+                           throw(MailClientException) {
+                raise(this->tryGetLetter(id, letter), id);
+            }
+
+            /**
+             * Get whole letter without keeping it in memory.
+             * @param id ID of letter.
+             * @param handler Function which receives letter piece by piece.
+             * @return Returns NEGATIVE_RESPONSE if there is no such letter.
+             */
+            Result tryGetLetter (const string& id,
+                                 const LetterHandler& handler) {
+                return this->run([&] () {
+                    return Protocol::retr(this->transport, this->buffer, id,
+                                          handler);
+                });
+            }
+
+            /**
+             * Get letters headers.
+             * @param headers Reference to vector where result will be stored.
+             * @throws MailClientException Thrown if not authorized.
+             */
+            void getLettersHeaders (strings& headers)
+                                   throw(MailClientException) {
+                strings ids;
+                vector<size_t> sizes;
+                string header;
+                headers.clear();
+                this->getLettersIDs(ids, sizes);
+                for (const string& id : ids) {
+                    this->getLetterHeader(id, header);
+                    headers.push_back(header);
+                }
+            }
+
+            /**
+             * Is transport connected to email server?
+             * @return Returns `true' if connected and `false' otherwise.
+             */
+            bool isConnected () {
+                return this->transport.isConnected();
+            }
+
+            /**
+             * Close connection (after signing out or after failure), so the
+             * client can connect again.
+             */
+            void disconnect () {
+                if (this->transport.isConnected()) {
+                    try {
+                        this->transport.disconnect();
+                    }
+                    catch (const TransportException& e) {
+                    }
+                }
+                this->state = DISCONNECTED;
+            }
+        private:
+            /**
+             * Run protocol command. Transport errors are the only thrown
+             * ones: they're converted to TRANSPORT_FAILED.
+             * @param command Command which returns ErrorCode.
+             */
+            template <class Command>
+            Result execute (const Command& command) {
+                try {
+                    return Result(command());
+                }
+                catch (const TransportException& e) {
+                    return Result(TRANSPORT_FAILED);
+                }
+            }
+
+            /**
+             * Run protocol command in AUTHORIZED state.
+             * @param command Command which returns ErrorCode.
+             */
+            template <class Command>
+            Result run (const Command& command) {
+                Result result = this->checkState(AUTHORIZED);
+                if (!result) {
+                    return result;
+                }
+                return this->execute(command);
+            }
+    };
+}
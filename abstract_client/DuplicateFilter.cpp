@@ -0,0 +1,213 @@
+#include "DuplicateFilter.hpp"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+namespace post {
+
+    /**
+     * Bloom filter bits per entry: with 4 probes about 0.25% of new
+     * letters go to the map in vain.
+     */
+    static const size_t bitsPerEntry = 16;
+    static const size_t probes = 4;
+    static const size_t minimalBits = 1 << 16;
+
+    /**
+     * Stable 64-bit hash (FNV-1a): the same in every run, so it can be
+     * persisted unlike std::hash.
+     */
+    static uint64_t hash64 (const string& key) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (char c : key) {
+            hash ^= (unsigned char) c;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    DuplicateFilterException::DuplicateFilterException (string message) :
+                                                       exception() {
+        this->message = message;
+    }
+
+    const char* DuplicateFilterException::what () const throw() {
+        return this->message.c_str();
+    }
+
+    DuplicateFilter::DuplicateFilter (const string& filename)
+                                     throw(DuplicateFilterException) {
+        this->filename = filename;
+        this->duplicates = 0;
+        if (!filename.empty()) {
+            this->read(filename);
+        }
+        this->rebuild();
+    }
+
+    bool DuplicateFilter::mayContain (uint64_t id) const {
+        size_t mask = this->bloom.size() * 64 - 1;
+        uint64_t step = (id >> 32 | id << 32) | 1;
+        for (size_t i = 0; i < probes; ++i, id += step) {
+            size_t bit = id & mask;
+            if (!(this->bloom[bit >> 6] & (1ULL << (bit & 63)))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void DuplicateFilter::remember (uint64_t id) {
+        size_t mask = this->bloom.size() * 64 - 1;
+        uint64_t step = (id >> 32 | id << 32) | 1;
+        for (size_t i = 0; i < probes; ++i, id += step) {
+            size_t bit = id & mask;
+            this->bloom[bit >> 6] |= 1ULL << (bit & 63);
+        }
+    }
+
+    void DuplicateFilter::rebuild () {
+        size_t bits = minimalBits;
+        while (bits < this->seen.size() * bitsPerEntry) {
+            bits <<= 1;
+        }
+        this->bloom.assign(bits / 64, 0);
+        for (const auto& entry : this->seen) {
+            this->remember(entry.first);
+        }
+    }
+
+    bool DuplicateFilter::read (const string& filename)
+                               throw(DuplicateFilterException) {
+        ifstream in(filename);
+        if (!in.is_open()) {
+            return false;
+        }
+        string line;
+        while (getline(in, line)) {
+            if (line.empty()) {
+                continue;
+            }
+            istringstream fields(line);
+            uint64_t id, mailbox;
+            if (!(fields >> hex >> id >> mailbox)) {
+                throw DuplicateFilterException("Bad entry `" + line +
+                                               "' in " + filename + ".");
+            }
+            // The first mailbox wins: entries in memory are older
+            this->seen.insert(make_pair(id, mailbox));
+        }
+        return true;
+    }
+
+    bool DuplicateFilter::accept (const string& header,
+                                  const string& mailbox) {
+        string messageID = getMessageID(header);
+        if (messageID.empty()) {
+            return true;
+        }
+        uint64_t id = hash64(messageID), owner = hash64(mailbox);
+        lock_guard<mutex> guard(this->lock);
+        if (this->mayContain(id)) {
+            auto found = this->seen.find(id);
+            if (found != this->seen.end()) {
+                if (found->second == owner) {
+                    return true;
+                }
+                ++this->duplicates;
+                return false;
+            }
+        }
+        this->seen[id] = owner;
+        if (this->seen.size() * bitsPerEntry > this->bloom.size() * 64) {
+            this->rebuild();
+        }
+        else {
+            this->remember(id);
+        }
+        return true;
+    }
+
+    size_t DuplicateFilter::getDuplicates () {
+        lock_guard<mutex> guard(this->lock);
+        return this->duplicates;
+    }
+
+    void DuplicateFilter::save () throw(DuplicateFilterException) {
+        if (this->filename.empty()) {
+            return;
+        }
+        lock_guard<mutex> guard(this->lock);
+        string lockname = this->filename + ".lock";
+        int lockFD = open(lockname.c_str(), O_RDWR | O_CREAT | O_CLOEXEC,
+                          0644);
+        if (lockFD < 0 || flock(lockFD, LOCK_EX) != 0) {
+            if (lockFD >= 0) {
+                close(lockFD);
+            }
+            throw DuplicateFilterException("Can't lock " + lockname + ": " +
+                                           strerror(errno) + ".");
+        }
+        string temporary = this->filename + ".tmp";
+        bool written;
+        try {
+            // Another process could save its entries since we read file
+            this->read(this->filename);
+            ofstream out(temporary);
+            out << hex;
+            for (const auto& entry : this->seen) {
+                out << entry.first << " " << entry.second << "\n";
+            }
+            written = static_cast<bool>(out.flush());
+        }
+        catch (const DuplicateFilterException& e) {
+            close(lockFD);
+            throw;
+        }
+        if (!written || rename(temporary.c_str(),
+                               this->filename.c_str()) != 0) {
+            close(lockFD);
+            throw DuplicateFilterException("Can't write " + this->filename +
+                                           ".");
+        }
+        close(lockFD);
+        this->rebuild();
+    }
+
+    string getMessageID (const string& header) {
+        static const char name[] = "message-id:";
+        static const size_t nameSize = sizeof(name) - 1;
+        size_t start = 0;
+        while (start < header.size()) {
+            size_t end = header.find('\n', start);
+            end = end == string::npos ? header.size() : end + 1;
+            if (end - start > nameSize &&
+                strncasecmp(header.data() + start, name, nameSize) == 0) {
+                // Value may be folded to the next lines
+                string value;
+                size_t position = start + nameSize;
+                do {
+                    value.append(header, position, end - position);
+                    position = end;
+                    end = header.find('\n', position);
+                    end = end == string::npos ? header.size() : end + 1;
+                } while (position < header.size() &&
+                         (header[position] == ' ' ||
+                          header[position] == '\t'));
+                size_t first = value.find_first_not_of(" \t\r\n");
+                if (first == string::npos) {
+                    return "";
+                }
+                size_t last = value.find_last_not_of(" \t\r\n");
+                return value.substr(first, last - first + 1);
+            }
+            start = end;
+        }
+        return "";
+    }
+}
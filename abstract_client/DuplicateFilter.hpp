@@ -0,0 +1,106 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include <exception>
+#include <unordered_map>
+
+using namespace std;
+
+namespace post {
+
+    /**
+     * Thrown when file of seen Message-IDs can't be read or written.
+     */
+    class DuplicateFilterException : public exception {
+        protected:
+            string message;
+        public:
+            DuplicateFilterException (string message);
+            virtual const char* what () const throw();
+    };
+
+    /**
+     * Set of Message-IDs which were seen in mailboxes, for dropping copies
+     * of one letter (mailing lists, distribution mail) which were delivered
+     * to several mailboxes. Letter is a duplicate when its Message-ID was
+     * first seen in another mailbox; letters of the same mailbox pass, so
+     * repeated runs over one mailbox aren't affected.
+     * Message-ID and mailbox are kept as 64-bit hashes in exact hash map
+     * with Bloom filter in front of it: most letters are new, and they are
+     * answered by a few bit probes without touching the map. Set is shared
+     * by all sessions of process and persisted in file as `id mailbox'
+     * lines of hexadecimal hashes; Bloom filter is rebuilt on loading.
+     */
+    class DuplicateFilter {
+        private:
+            string filename;
+            mutex lock;
+            /**
+             * Message-ID hash -> hash of the first mailbox.
+             */
+            unordered_map<uint64_t, uint64_t> seen;
+            vector<uint64_t> bloom;
+            size_t duplicates;
+
+            bool mayContain (uint64_t id) const;
+            void remember (uint64_t id);
+            /**
+             * Resize Bloom filter for current number of entries and fill
+             * it again.
+             */
+            void rebuild ();
+            /**
+             * Add entries of file to the set. Missing file is empty.
+             * @return Returns `false' if file doesn't exist.
+             */
+            bool read (const string& filename)
+                      throw(DuplicateFilterException);
+        public:
+            /**
+             * Construct set and read file of seen Message-IDs.
+             * @param filename File name (empty for set which isn't
+             * persisted).
+             * @throws DuplicateFilterException Thrown if file can't be
+             * parsed.
+             */
+            DuplicateFilter (const string& filename = string())
+                            throw(DuplicateFilterException);
+            /**
+             * Check letter and remember its Message-ID. Letters without
+             * Message-ID are never duplicates.
+             * @param header Message header.
+             * @param mailbox Mailbox name, e.g. `login@host:port'.
+             * @return Returns `true' if letter should be processed and
+             * `false' if it was seen in another mailbox.
+             */
+            bool accept (const string& header, const string& mailbox);
+            /**
+             * Number of letters which were rejected as duplicates.
+             */
+            size_t getDuplicates ();
+            /**
+             * Merge new entries into file. File is locked while it's
+             * merged, so processes which share it don't lose entries of
+             * each other; temporary file is renamed over the old one.
+             * @throws DuplicateFilterException Thrown if file can't be
+             * written.
+             */
+            void save () throw(DuplicateFilterException);
+    };
+
+    /**
+     * Extract Message-ID of letter (field name is case insensitive).
+     * @param header Message header.
+     * @return Returns Message-ID without surrounding whitespace or empty
+     * string if there is no such field.
+     */
+    string getMessageID (const string& header);
+
+    /**
+     * Shortcut for Duplicate Filter shared pointer.
+     */
+    typedef shared_ptr<DuplicateFilter> p_DF;
+}
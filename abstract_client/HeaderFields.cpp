@@ -0,0 +1,109 @@
+#include "HeaderFields.hpp"
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <boost/algorithm/string.hpp>
+
+using namespace boost;
+
+typedef vector<string> strings;
+
+namespace post {
+
+    string getHeaderParameter (const string& header,
+                               const string& parameterName) {
+        size_t valueStart, valueLength;
+        valueStart = header.find(parameterName + ": ");
+        if (valueStart == string::npos) {
+            return "";
+        }
+        valueStart += parameterName.size() + 2;
+        valueLength = header.find("\r\n", valueStart) - valueStart;
+        return header.substr(valueStart, valueLength);
+    }
+
+    string getResponseBody (const string& response) {
+        size_t start = response.find("\r\n");
+        start = start == string::npos ? response.size() : start + 2;
+        size_t end = response.size();
+        if (end >= start + 3 && response.compare(end - 3, 3, ".\r\n") == 0) {
+            end -= 3;
+        }
+        return response.substr(start, end - start);
+    }
+
+    bool parseDate (const string& value, time_t& result) {
+        static const string months[] = {"jan", "feb", "mar", "apr", "may",
+                                        "jun", "jul", "aug", "sep", "oct",
+                                        "nov", "dec"};
+        string date = value;
+        // Drop day of week and comments
+        size_t comma = date.find(',');
+        if (comma != string::npos) {
+            date.erase(0, comma + 1);
+        }
+        size_t comment = date.find('(');
+        if (comment != string::npos) {
+            date.erase(comment);
+        }
+        trim(date);
+        strings tokens;
+        split(tokens, date, is_any_of(" \t"), token_compress_on);
+        if (tokens.size() < 4) {
+            return false;
+        }
+        tm time = {};
+        int hours, minutes, seconds = 0, zone = 0;
+        try {
+            time.tm_mday = stoi(tokens[0]);
+            string month = tokens[1].substr(0, 3);
+            to_lower(month);
+            time.tm_mon = find(months, months + 12, month) - months;
+            time.tm_year = stoi(tokens[2]);
+        }
+        catch (const logic_error&) {
+            return false;
+        }
+        if (time.tm_mon == 12) {
+            return false;
+        }
+        // Obsolete two and three digits years
+        if (time.tm_year < 50) {
+            time.tm_year += 2000;
+        }
+        else if (time.tm_year < 1000) {
+            time.tm_year += 1900;
+        }
+        time.tm_year -= 1900;
+        if (sscanf(tokens[3].c_str(), "%d:%d:%d", &hours, &minutes,
+                   &seconds) < 2) {
+            return false;
+        }
+        time.tm_hour = hours;
+        time.tm_min = minutes;
+        time.tm_sec = seconds;
+        if (tokens.size() > 4) {
+            string z = tokens[4];
+            to_upper(z);
+            if ((z[0] == '+' || z[0] == '-') && z.size() == 5) {
+                int offset = atoi(z.c_str() + 1);
+                zone = (offset / 100 * 60 + offset % 100) * 60;
+                zone = z[0] == '-' ? -zone : zone;
+            }
+            else {
+                // Obsolete North American zones (others are treated as UT)
+                static const pair<string, int> zones[] = {
+                    {"EDT", -4}, {"EST", -5}, {"CDT", -5}, {"CST", -6},
+                    {"MDT", -6}, {"MST", -7}, {"PDT", -7}, {"PST", -8}};
+                for (const pair<string, int>& named : zones) {
+                    if (named.first == z) {
+                        zone = named.second * 3600;
+                    }
+                }
+            }
+        }
+        result = timegm(&time) - zone;
+        return true;
+    }
+}
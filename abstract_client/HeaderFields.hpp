@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <ctime>
+
+using namespace std;
+
+namespace post {
+
+    /**
+     * Extract value of header field.
+     * @param header Message header.
+     * @param parameterName Field name.
+     * @return Returns field value or empty string if there is no such field.
+     */
+    string getHeaderParameter (const string& header,
+                               const string& parameterName);
+
+    /**
+     * Cut status line and terminating dot from multi-line response
+     * (e.g. TOP).
+     * @param response Full response.
+     * @return Returns response body.
+     */
+    string getResponseBody (const string& response);
+
+    /**
+     * Parse value of Date field (RFC 2822), e.g.
+     * `Mon, 1 Jan 2024 10:00:00 +0000'.
+     * @param value Field value.
+     * @param result Reference to write UNIX time to it.
+     * @return Returns `true' if date was parsed, `false' otherwise.
+     */
+    bool parseDate (const string& value, time_t& result);
+}
@@ -0,0 +1,206 @@
+#include "HeaderFilter.hpp"
+#include <queue>
+#include <fstream>
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+
+using namespace boost;
+
+namespace post {
+
+    // Filter Exception methods
+    FilterException::FilterException (string message) : exception() {
+        this->message = message;
+    }
+
+    const char* FilterException::what () const throw() {
+        return this->message.c_str();
+    }
+
+    // Header Matcher methods
+    HeaderMatcher::~HeaderMatcher () {
+    }
+
+    // Keywords Matcher methods
+    KeywordsMatcher::KeywordsMatcher (const strings& keywords) {
+        this->nodes.push_back(Node{{}, 0, false});
+        // Build trie
+        for (string keyword : keywords) {
+            to_lower(keyword);
+            if (keyword.empty()) {
+                continue;
+            }
+            int node = 0;
+            for (unsigned char c : keyword) {
+                int next = this->child(node, c);
+                if (next < 0) {
+                    next = this->nodes.size();
+                    this->nodes.push_back(Node{{}, 0, false});
+                    vector<pair<unsigned char, int>>& transitions =
+                        this->nodes[node].next;
+                    transitions.insert(upper_bound(transitions.begin(),
+                        transitions.end(), make_pair(c, -1)),
+                        make_pair(c, next));
+                }
+                node = next;
+            }
+            this->nodes[node].terminal = true;
+        }
+        // Build failure links breadth first
+        queue<int> nodesQueue;
+        for (const pair<unsigned char, int>& t : this->nodes[0].next) {
+            nodesQueue.push(t.second);
+        }
+        while (!nodesQueue.empty()) {
+            int node = nodesQueue.front();
+            nodesQueue.pop();
+            for (const pair<unsigned char, int>& t : this->nodes[node].next) {
+                int fail = this->nodes[node].fail;
+                while (fail != 0 && this->child(fail, t.first) < 0) {
+                    fail = this->nodes[fail].fail;
+                }
+                int target = this->child(fail, t.first);
+                this->nodes[t.second].fail = target >= 0 ? target : 0;
+                this->nodes[t.second].terminal |=
+                    this->nodes[this->nodes[t.second].fail].terminal;
+                nodesQueue.push(t.second);
+            }
+        }
+    }
+
+    int KeywordsMatcher::child (int node, unsigned char c) const {
+        const vector<pair<unsigned char, int>>& transitions =
+            this->nodes[node].next;
+        vector<pair<unsigned char, int>>::const_iterator it =
+            lower_bound(transitions.begin(), transitions.end(),
+                        make_pair(c, -1));
+        if (it == transitions.end() || it->first != c) {
+            return -1;
+        }
+        return it->second;
+    }
+
+    bool KeywordsMatcher::matches (const string& value) const {
+        int node = 0;
+        for (char symbol : value) {
+            unsigned char c = tolower((unsigned char) symbol);
+            int next;
+            while ((next = this->child(node, c)) < 0 && node != 0) {
+                node = this->nodes[node].fail;
+            }
+            node = next >= 0 ? next : 0;
+            if (this->nodes[node].terminal) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Regex Matcher methods
+    RegexMatcher::RegexMatcher (const string& expression)
+                               throw(FilterException) {
+        try {
+            this->expression = regex(expression, regex::ECMAScript |
+                                     regex::icase | regex::optimize);
+        }
+        catch (const regex_error& e) {
+            throw FilterException("Invalid regular expression `" +
+                                  expression + "'.");
+        }
+    }
+
+    bool RegexMatcher::matches (const string& value) const {
+        return regex_search(value, this->expression);
+    }
+
+    // Domains Matcher methods
+    DomainsMatcher::DomainsMatcher (const strings& domains) {
+        for (string domain : domains) {
+            to_lower(domain);
+            if (!domain.empty()) {
+                this->domains.insert(domain);
+            }
+        }
+    }
+
+    bool DomainsMatcher::matches (const string& value) const {
+        size_t at = 0;
+        while ((at = value.find('@', at)) != string::npos) {
+            size_t end = value.find_first_of(">,; \t\r\n\"", ++at);
+            string domain = value.substr(at, end == string::npos ?
+                                             string::npos : end - at);
+            to_lower(domain);
+            // Check domain and all its parent domains
+            while (!domain.empty()) {
+                if (this->domains.count(domain)) {
+                    return true;
+                }
+                size_t dot = domain.find('.');
+                if (dot == string::npos) {
+                    break;
+                }
+                domain.erase(0, dot + 1);
+            }
+        }
+        return false;
+    }
+
+    // Header Filter methods
+    void HeaderFilter::addRule (const string& expression)
+                               throw(FilterException) {
+        size_t colon = expression.find(':');
+        size_t equals = expression.find('=', colon);
+        if (colon == string::npos || colon == 0 || equals == string::npos) {
+            throw FilterException("Can't parse filter `" + expression +
+                                  "'. Use `Field:kind=values'.");
+        }
+        string field = expression.substr(0, colon);
+        string kind = expression.substr(colon + 1, equals - colon - 1);
+        string rawValues = expression.substr(equals + 1);
+        if (kind == "regex") {
+            this->rules.push_back(make_pair(field,
+                                            p_HM(new RegexMatcher(rawValues))));
+            return;
+        }
+        strings values;
+        if (starts_with(rawValues, "@")) {
+            string filename = rawValues.substr(1);
+            ifstream in(filename);
+            if (!in.is_open()) {
+                throw FilterException("Can't open file " + filename + ".");
+            }
+            string line;
+            while (getline(in, line)) {
+                trim(line);
+                values.push_back(line);
+            }
+        }
+        else {
+            split(values, rawValues, is_any_of(","), token_compress_on);
+        }
+        if (kind == "keywords") {
+            this->rules.push_back(make_pair(field,
+                p_HM(new KeywordsMatcher(values))));
+        }
+        else if (kind == "domain") {
+            this->rules.push_back(make_pair(field,
+                p_HM(new DomainsMatcher(values))));
+        }
+        else {
+            throw FilterException("Unknown filter kind `" + kind + "'.");
+        }
+    }
+
+    bool HeaderFilter::matches (const string& header) const {
+        for (const pair<string, p_HM>& rule : this->rules) {
+            if (!rule.second->matches(getHeaderParameter(header, rule.first))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool HeaderFilter::empty () const {
+        return this->rules.empty();
+    }
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <string>
+#include <regex>
+#include <exception>
+#include <unordered_set>
+#include "HeaderFields.hpp"
+
+using namespace std;
+
+typedef vector<string> strings;
+
+namespace post {
+
+    /**
+     * Thrown when filter expression can not be compiled.
+     */
+    class FilterException : public exception {
+        protected:
+            /**
+             * Error message.
+             */
+            string message;
+        public:
+            FilterException (string message);
+            virtual const char* what () const throw();
+    };
+
+    /**
+     * Compiled matcher of a single header field value.
+     */
+    class HeaderMatcher {
+        public:
+            virtual ~HeaderMatcher ();
+            /**
+             * Check field value.
+             * @param value Value of header field.
+             * @return Returns `true' if value matches.
+             */
+            virtual bool matches (const string& value) const = 0;
+    };
+
+    /**
+     * Shortcut for Header Matcher shared pointer.
+     */
+    typedef shared_ptr<HeaderMatcher> p_HM;
+
+    /**
+     * Matches values which contain any of keywords (case insensitive).
+     * All keywords are searched in one pass with Aho-Corasick automaton.
+     */
+    class KeywordsMatcher : public HeaderMatcher {
+        private:
+            /**
+             * Automaton node.
+             */
+            struct Node {
+                /**
+                 * Sorted transitions: (byte, node).
+                 */
+                vector<pair<unsigned char, int>> next;
+                /**
+                 * Failure link.
+                 */
+                int fail;
+                /**
+                 * Some keyword ends here (or in one of failure nodes).
+                 */
+                bool terminal;
+            };
+            vector<Node> nodes;
+            int child (int node, unsigned char c) const;
+        public:
+            KeywordsMatcher (const strings& keywords);
+            bool matches (const string& value) const;
+    };
+
+    /**
+     * Matches values by precompiled regular expression (case insensitive).
+     */
+    class RegexMatcher : public HeaderMatcher {
+        private:
+            regex expression;
+        public:
+            RegexMatcher (const string& expression) throw(FilterException);
+            bool matches (const string& value) const;
+    };
+
+    /**
+     * Matches addresses whose domain (or its parent domain) is in the set.
+     */
+    class DomainsMatcher : public HeaderMatcher {
+        private:
+            unordered_set<string> domains;
+        public:
+            DomainsMatcher (const strings& domains);
+            bool matches (const string& value) const;
+    };
+
+    /**
+     * Header filter: set of rules which all should match.
+     * Rule expression has format `Field:kind=values', where kind is
+     * `keywords', `regex' or `domain' and values are comma separated
+     * (`keywords' and `domain') or read line by line from file if they
+     * start with `@'. Examples:
+     * From:domain=example.com,example.org
+     * Subject:keywords=@keywords.txt
+     * Subject:regex=^\[(ALERT|CRIT)\]
+     */
+    class HeaderFilter {
+        private:
+            vector<pair<string, p_HM>> rules;
+        public:
+            /**
+             * Compile rule and add it to the filter.
+             * @param expression Rule expression.
+             * @throws FilterException Thrown if expression is invalid or
+             * values file can't be read.
+             */
+            void addRule (const string& expression) throw(FilterException);
+            /**
+             * Check whether message header passes all rules.
+             * @param header Message header.
+             * @return Returns `true' if header matches every rule.
+             */
+            bool matches (const string& header) const;
+            /**
+             * Check whether filter has no rules.
+             */
+            bool empty () const;
+    };
+
+    /**
+     * Shortcut for Header Filter shared pointer.
+     */
+    typedef shared_ptr<HeaderFilter> p_HF;
+}
@@ -26,6 +26,11 @@ namespace mail_client {
           MailClientException("Can not open connection. Reason: " + reason) {
     }
 
+    // Temporary Failure Exception methods
+    TemporaryFailureException::TemporaryFailureException (string reason) :
+                            MailClientException("An error occured: " + reason) {
+    }
+
     // Mail Client methods
     MailClient::MailClient () {
     }
@@ -55,6 +60,9 @@ namespace mail_client {
         try {
             this->postProvider->signin(login, password);
         }
+        catch(const post::TemporaryFailureException& e) {
+            throw TemporaryFailureException(string(e.what()));
+        }
         catch(const PostException& e) {
             throw MailClientException("An error occured: " + string(e.what()));
         }
@@ -97,6 +105,34 @@ namespace mail_client {
         }
     }
 
+    void MailClient::getRecentLettersHeaders (strings& headers, size_t count,
+                                              time_t since)
+                                             throw(MailClientException) {
+        if (!this->isConnected()) {
+            throw ClosedConnectionException();
+        }
+        try {
+            this->postProvider->getRecentLettersHeaders(headers, count, since);
+        }
+        catch(const PostException& e) {
+            throw MailClientException("An error occured: " + string(e.what()));
+        }
+    }
+
+    void MailClient::getLettersHeaders (const HeaderHandler& handler,
+                                        const unordered_set<string>& skipUIDs)
+                                       throw(MailClientException) {
+        if (!this->isConnected()) {
+            throw ClosedConnectionException();
+        }
+        try {
+            this->postProvider->getLettersHeaders(handler, skipUIDs);
+        }
+        catch(const PostException& e) {
+            throw MailClientException("An error occured: " + string(e.what()));
+        }
+    }
+
     void MailClient::getLettersHeadersParameters (strings& parameters,
                const string& parameterName) throw(MailClientException) {
         if (!this->isConnected()) {
@@ -111,6 +147,112 @@ namespace mail_client {
         }
     }
 
+    void MailClient::getLettersIDs (strings& ids, vector<size_t>& sizes)
+                                   throw(MailClientException) {
+        if (!this->isConnected()) {
+            throw ClosedConnectionException();
+        }
+        try {
+            this->postProvider->getLettersIDs(ids, sizes);
+        }
+        catch(const PostException& e) {
+            throw MailClientException("An error occured: " + string(e.what()));
+        }
+    }
+
+    void MailClient::getMailboxStat (size_t& count, size_t& octets)
+                                    throw(MailClientException) {
+        if (!this->isConnected()) {
+            throw ClosedConnectionException();
+        }
+        try {
+            this->postProvider->getMailboxStat(count, octets);
+        }
+        catch(const PostException& e) {
+            throw MailClientException("An error occured: " + string(e.what()));
+        }
+    }
+
+    void MailClient::getLetterUID (const string& id, string& uid)
+                                  throw(MailClientException) {
+        if (!this->isConnected()) {
+            throw ClosedConnectionException();
+        }
+        try {
+            this->postProvider->getLetterUID(id, uid);
+        }
+        catch(const PostException& e) {
+            throw MailClientException("An error occured: " + string(e.what()));
+        }
+    }
+
+    void MailClient::getLettersUIDs (unordered_map<string, string>& uids)
+                                    throw(MailClientException) {
+        if (!this->isConnected()) {
+            throw ClosedConnectionException();
+        }
+        try {
+            this->postProvider->getLettersUIDs(uids);
+        }
+        catch(const PostException& e) {
+            throw MailClientException("An error occured: " + string(e.what()));
+        }
+    }
+
+    void MailClient::getLetterHeader (const string& id, string& header)
+                                     throw(MailClientException) {
+        if (!this->isConnected()) {
+            throw ClosedConnectionException();
+        }
+        try {
+            this->postProvider->getLetterHeader(id, header);
+        }
+        catch(const PostException& e) {
+            throw MailClientException("An error occured: " + string(e.what()));
+        }
+    }
+
+    void MailClient::getLetter (const string& id, string& letter)
+                               throw(MailClientException) {
+        if (!this->isConnected()) {
+            throw ClosedConnectionException();
+        }
+        try {
+            this->postProvider->getLetter(id, letter);
+        }
+        catch(const PostException& e) {
+            throw MailClientException("An error occured: " + string(e.what()));
+        }
+    }
+
+    void MailClient::getLetter (const string& id,
+                                const LetterHandler& handler)
+                               throw(MailClientException) {
+        if (!this->isConnected()) {
+            throw ClosedConnectionException();
+        }
+        try {
+            this->postProvider->getLetter(id, handler);
+        }
+        catch(const PostException& e) {
+            throw MailClientException("An error occured: " + string(e.what()));
+        }
+    }
+
+    void MailClient::deleteLetters (const RetentionPolicy& policy,
+                                    RetentionReport& report)
+                                   throw(MailClientException) {
+        if (!this->isConnected()) {
+            throw ClosedConnectionException();
+        }
+        try {
+            this->postProvider->deleteLetters(policy, report);
+        }
+        catch(const PostException& e) {
+            throw MailClientException("An error occured: " + string(e.what()));
+        }
+    }
+
 
     void MailClient::signout () throw(MailClientException) {
         if (!this->isConnected()) {
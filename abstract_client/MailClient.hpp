@@ -54,6 +54,18 @@ namespace mail_client {
             ConnectionError (string reason);
     };
 
+    /**
+     * Thrown if server is busy and the action may succeed later.
+     */
+    class TemporaryFailureException: public MailClientException {
+        public:
+            /**
+             * Construct new error.
+             * @param reason Response of server.
+             */
+            TemporaryFailureException (string reason);
+    };
+
     /**
      * Mail Client is a high-level class for accessing mail server and
      * communicating with it.
@@ -96,6 +108,7 @@ namespace mail_client {
              * @param password User password.
              * @throws MailClientException Thrown if connection wasn't
              * established or if user is already authorized.
+             * @throws TemporaryFailureException Thrown if server is busy.
              */
             void signin (string login, string password)
                         throw(MailClientException);
@@ -128,6 +141,29 @@ namespace mail_client {
              */
             void getLettersHeaders (strings& headers)
                               throw(MailClientException);
+            /**
+             * Get headers of the newest letters, newest first.
+             * @param headers Reference to vector where result will be stored.
+             * @param count Maximal number of letters to look at.
+             * @param since UNIX time of the oldest interesting letter
+             * (0 disables the cutoff).
+             * @throws MailClientException Thrown if not authorized.
+             */
+            void getRecentLettersHeaders (strings& headers, size_t count,
+                                          time_t since)
+                                         throw(MailClientException);
+            /**
+             * Get letters headers one by one together with their unique IDs.
+             * @param handler Function which is called for every header
+             * right after it's received.
+             * @param skipUIDs Unique IDs of letters which should not be
+             * downloaded.
+             * @throws MailClientException Thrown if not authorized or if
+             * server doesn't support unique IDs.
+             */
+            void getLettersHeaders (const HeaderHandler& handler,
+                                    const unordered_set<string>& skipUIDs)
+                                   throw(MailClientException);
             /**
              * Get vector of strings with parameter values for every message.
              * Allowed in state AUTHORIZED.
@@ -138,6 +174,80 @@ namespace mail_client {
              */
             void getLettersHeadersParameters (strings& parameters,
                 const string& parameterName) throw(MailClientException);
+            /**
+             * Get IDs (numbers) of letters and their sizes.
+             * @param ids Reference to vector where IDs will be stored.
+             * @param sizes Reference to vector where sizes will be stored.
+             * @throws MailClientException Thrown if not authorized.
+             */
+            void getLettersIDs (strings& ids, vector<size_t>& sizes)
+                               throw(MailClientException);
+            /**
+             * Get number of letters and size of mailbox.
+             * @param count Reference to write number of letters to it.
+             * @param octets Reference to write size of mailbox to it.
+             * @throws MailClientException Thrown if not authorized.
+             */
+            void getMailboxStat (size_t& count, size_t& octets)
+                                throw(MailClientException);
+            /**
+             * Get unique ID of one letter.
+             * @param id ID of letter.
+             * @param uid Reference to write unique ID to it.
+             * @throws MailClientException Thrown if not authorized, if
+             * there is no such letter or if server doesn't support unique
+             * IDs.
+             */
+            void getLetterUID (const string& id, string& uid)
+                              throw(MailClientException);
+            /**
+             * Get unique IDs of letters.
+             * @param uids Reference to map where ID -> unique ID pairs will
+             * be stored.
+             * @throws MailClientException Thrown if not authorized or if
+             * server doesn't support unique IDs.
+             */
+            void getLettersUIDs (unordered_map<string, string>& uids)
+                                throw(MailClientException);
+            /**
+             * Get header of one letter.
+             * @param id ID of letter.
+             * @param header Reference to string where header will be stored.
+             * @throws MailClientException Thrown if not authorized or if
+             * letter can't be received.
+             */
+            void getLetterHeader (const string& id, string& header)
+                                 throw(MailClientException);
+            /**
+             * Get whole letter.
+             * @param id ID of letter.
+             * @param letter Reference to string where letter will be stored.
+             * @throws MailClientException Thrown if not authorized or if
+             * letter can't be received.
+             */
+            void getLetter (const string& id, string& letter)
+                           throw(MailClientException);
+            /**
+             * Get whole letter without keeping it in memory.
+             * @param id ID of letter.
+             * @param handler Function which receives letter piece by piece.
+             * @throws MailClientException Thrown if not authorized or if
+             * letter can't be received.
+             */
+            void getLetter (const string& id, const LetterHandler& handler)
+                           throw(MailClientException);
+            /**
+             * Delete messages selected by retention policy. Deletion is
+             * committed by `signout'.
+             * @param policy Which messages to delete.
+             * @param report Reference to write number and size of deleted
+             * messages to it.
+             * @throws MailClientException Thrown if not authorized or if
+             * connection error occured.
+             */
+            void deleteLetters (const RetentionPolicy& policy,
+                                RetentionReport& report)
+                               throw(MailClientException);
 
             /**
              * Set not null Post Provider.
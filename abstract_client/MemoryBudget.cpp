@@ -0,0 +1,124 @@
+#include "MemoryBudget.hpp"
+#include <chrono>
+#include <algorithm>
+
+namespace transport {
+
+    // Memory Budget methods
+    MemoryBudget::MemoryBudget () {
+        this->limit = this->used = this->highWater = 0;
+        this->holders = this->waitingHolders = 0;
+        this->waits = this->overdrafts = 0;
+    }
+
+    MemoryBudget& MemoryBudget::global () {
+        static MemoryBudget budget;
+        return budget;
+    }
+
+    void MemoryBudget::setLimit (size_t limit) {
+        lock_guard<mutex> guard(this->lock);
+        this->limit = limit;
+        this->released.notify_all();
+    }
+
+    size_t MemoryBudget::getLimit () {
+        lock_guard<mutex> guard(this->lock);
+        return this->limit;
+    }
+
+    void MemoryBudget::acquire (size_t amount, size_t held) {
+        unique_lock<mutex> guard(this->lock);
+        // When every holder waits, nothing will be released: the first one
+        // which notices it goes on and the others see it running again
+        auto fits = [&] () {
+            return this->limit == 0 ||
+                   this->used + amount <= this->limit ||
+                   this->holders == this->waitingHolders;
+        };
+        if (!fits()) {
+            ++this->waits;
+            if (held > 0) {
+                ++this->waitingHolders;
+                // The last running holder may leave everybody waiting
+                this->released.notify_all();
+            }
+            bool released = this->released.wait_for(guard,
+                                                    chrono::seconds(1), fits);
+            if (held > 0) {
+                --this->waitingHolders;
+            }
+            if (!released || this->used + amount > this->limit) {
+                ++this->overdrafts;
+            }
+        }
+        this->holders += held == 0 ? 1 : 0;
+        this->used += amount;
+        this->highWater = max(this->highWater, this->used);
+    }
+
+    void MemoryBudget::release (size_t amount, size_t held) {
+        lock_guard<mutex> guard(this->lock);
+        this->used -= min(amount, this->used);
+        this->holders -= held == 0 && this->holders > 0 ? 1 : 0;
+        this->released.notify_all();
+    }
+
+    size_t MemoryBudget::window (size_t depth) {
+        lock_guard<mutex> guard(this->lock);
+        size_t half = this->limit / 2;
+        if (this->limit == 0 || this->used <= half) {
+            return depth;
+        }
+        size_t free = this->used < this->limit ? this->limit - this->used : 0;
+        return max((size_t) 1, depth * free / max(half, (size_t) 1));
+    }
+
+    size_t MemoryBudget::getUsed () {
+        lock_guard<mutex> guard(this->lock);
+        return this->used;
+    }
+
+    size_t MemoryBudget::getHighWater () {
+        lock_guard<mutex> guard(this->lock);
+        return this->highWater;
+    }
+
+    size_t MemoryBudget::getWaits () {
+        lock_guard<mutex> guard(this->lock);
+        return this->waits;
+    }
+
+    size_t MemoryBudget::getOverdrafts () {
+        lock_guard<mutex> guard(this->lock);
+        return this->overdrafts;
+    }
+
+    // Memory Charge methods
+    MemoryCharge::MemoryCharge () {
+        this->amount = 0;
+    }
+
+    MemoryCharge::~MemoryCharge () {
+        this->resize(0);
+    }
+
+    void MemoryCharge::resize (size_t amount) {
+        if (amount > this->amount) {
+            MemoryBudget::global().acquire(amount - this->amount,
+                                           this->amount);
+        }
+        else if (amount < this->amount) {
+            MemoryBudget::global().release(this->amount - amount, amount);
+        }
+        this->amount = amount;
+    }
+
+    void MemoryCharge::grow (size_t amount) {
+        this->resize(this->amount + amount);
+    }
+
+    size_t MemoryCharge::size () const {
+        return this->amount;
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+using namespace std;
+
+namespace transport {
+    /**
+     * Process-wide accountant of memory held by sessions: receive buffers,
+     * pipelined responses and stored headers are charged against it.
+     * When the limit is reached, session which wants more memory waits
+     * until other sessions release theirs, so its socket isn't read
+     * meanwhile. Budget without limit only counts.
+     */
+    class MemoryBudget {
+        private:
+            mutex lock;
+            condition_variable released;
+            /**
+             * Limit in octets (0 means unlimited).
+             */
+            size_t limit;
+            size_t used;
+            size_t highWater;
+            /**
+             * Number of owners which hold memory and how many of them
+             * wait for more.
+             */
+            size_t holders;
+            size_t waitingHolders;
+            /**
+             * Number of times sessions waited for memory.
+             */
+            size_t waits;
+            /**
+             * Number of times memory was taken over the limit because
+             * nothing was released in time.
+             */
+            size_t overdrafts;
+            MemoryBudget ();
+        public:
+            MemoryBudget (const MemoryBudget&) = delete;
+            MemoryBudget& operator= (const MemoryBudget&) = delete;
+            /**
+             * Budget shared by the whole process.
+             */
+            static MemoryBudget& global ();
+            /**
+             * Set limit in octets (0 means unlimited).
+             */
+            void setLimit (size_t limit);
+            size_t getLimit ();
+            /**
+             * Take memory, waiting while it doesn't fit into the limit and
+             * other holders are running, so they may release theirs. If
+             * every holder waits, one of them takes memory over the limit;
+             * wait is also bounded for holders which don't run at all.
+             * @param amount Octets to take.
+             * @param held Octets which are already held by caller.
+             */
+            void acquire (size_t amount, size_t held);
+            /**
+             * Give memory back.
+             * @param amount Octets to give back.
+             * @param held Octets which caller still holds.
+             */
+            void release (size_t amount, size_t held);
+            /**
+             * Scale number of commands sent at once to free budget: it's
+             * full while less than half of the limit is used and shrinks
+             * down to one command as the limit is approached.
+             * @param depth Number of commands without memory pressure.
+             * @return Returns allowed number of commands.
+             */
+            size_t window (size_t depth);
+            size_t getUsed ();
+            size_t getHighWater ();
+            size_t getWaits ();
+            size_t getOverdrafts ();
+    };
+
+    /**
+     * Memory charged by one owner to the global budget, released on
+     * destruction.
+     */
+    class MemoryCharge {
+        private:
+            size_t amount;
+        public:
+            MemoryCharge ();
+            ~MemoryCharge ();
+            MemoryCharge (const MemoryCharge&) = delete;
+            MemoryCharge& operator= (const MemoryCharge&) = delete;
+            /**
+             * Change charged amount. Growth may wait for budget
+             * (see MemoryBudget::acquire).
+             * @param amount Octets held by owner now.
+             */
+            void resize (size_t amount);
+            /**
+             * Charge more octets.
+             */
+            void grow (size_t amount);
+            size_t size () const;
+    };
+}
@@ -0,0 +1,354 @@
+#include "MimeParser.hpp"
+#include <array>
+#include <cstring>
+#include <boost/algorithm/string.hpp>
+
+using namespace boost::algorithm;
+
+namespace post {
+
+    /**
+     * Header of part is kept only up to this size.
+     */
+    static const size_t maxHeaderSize = 64 << 10;
+    /**
+     * Decoded data is passed to sink in pieces of about this size.
+     */
+    static const size_t outputSize = 64 << 10;
+
+    MimeSink::~MimeSink () {
+    }
+
+    /**
+     * Get unfolded value of header field.
+     * @param header Header of part.
+     * @param name Lowercase field name.
+     * @return Returns field value or empty string if there is no such
+     * field.
+     */
+    static string getField (const string& header, const string& name) {
+        string value;
+        bool found = false;
+        size_t start = 0;
+        while (start < header.size()) {
+            size_t end = header.find('\n', start);
+            end = end == string::npos ? header.size() : end + 1;
+            string line = header.substr(start, end - start);
+            start = end;
+            trim_right(line);
+            if (found) {
+                if (line.empty() || (line[0] != ' ' && line[0] != '\t')) {
+                    break;
+                }
+                value += " " + trim_copy(line);
+            }
+            else if (line.size() > name.size() && line[name.size()] == ':' &&
+                     iequals(line.substr(0, name.size()), name)) {
+                value = trim_copy(line.substr(name.size() + 1));
+                found = true;
+            }
+        }
+        return value;
+    }
+
+    static int hexDigit (char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        c = tolower(c);
+        return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+    }
+
+    string getFieldParameter (const string& value, const string& name) {
+        // Split parameters by semicolons which aren't quoted
+        vector<string> parameters(1);
+        bool quoted = false;
+        for (size_t i = 0; i < value.size(); ++i) {
+            char c = value[i];
+            if (c == '"') {
+                quoted = !quoted;
+            }
+            else if (c == '\\' && quoted && i + 1 < value.size()) {
+                parameters.back() += c;
+                c = value[++i];
+            }
+            else if (c == ';' && !quoted) {
+                parameters.push_back(string());
+                continue;
+            }
+            parameters.back() += c;
+        }
+        for (size_t i = 1; i < parameters.size(); ++i) {
+            size_t equals = parameters[i].find('=');
+            if (equals == string::npos) {
+                continue;
+            }
+            string key = trim_copy(parameters[i].substr(0, equals));
+            string result = trim_copy(parameters[i].substr(equals + 1));
+            if (iequals(key, name)) {
+                if (result.size() >= 2 && result[0] == '"') {
+                    string unquoted;
+                    for (size_t j = 1; j + 1 < result.size(); ++j) {
+                        if (result[j] == '\\' && j + 2 < result.size()) {
+                            ++j;
+                        }
+                        unquoted += result[j];
+                    }
+                    return unquoted;
+                }
+                return result;
+            }
+            if (iequals(key, name + "*")) {
+                // charset'language'percent-encoded value
+                size_t quote = result.find('\'');
+                quote = quote == string::npos ? quote :
+                        result.find('\'', quote + 1);
+                result = quote == string::npos ? result :
+                         result.substr(quote + 1);
+                string decoded;
+                for (size_t j = 0; j < result.size(); ++j) {
+                    if (result[j] == '%' && j + 2 < result.size() &&
+                        hexDigit(result[j + 1]) >= 0 &&
+                        hexDigit(result[j + 2]) >= 0) {
+                        decoded += (char) (hexDigit(result[j + 1]) * 16 +
+                                           hexDigit(result[j + 2]));
+                        j += 2;
+                    }
+                    else {
+                        decoded += result[j];
+                    }
+                }
+                return decoded;
+            }
+        }
+        return "";
+    }
+
+    // MIME Parser methods
+    MimeParser::MimeParser (MimeSink& sink) : sink(sink) {
+        this->section = HEADER;
+        this->inPart = false;
+        this->parts = 0;
+        this->lineStart = true;
+        this->base64 = this->quotedPrintable = false;
+        this->base64Bits = this->base64Count = 0;
+    }
+
+    void MimeParser::feed (const char* data, size_t size) {
+        if (size == 0) {
+            return;
+        }
+        bool complete = data[size - 1] == '\n';
+        bool atStart = this->lineStart;
+        this->lineStart = complete;
+        if (atStart && size >= 2 && data[0] == '-' && data[1] == '-' &&
+            this->delimiter(data, size)) {
+            return;
+        }
+        switch (this->section) {
+            case HEADER:
+                if (atStart && (data[0] == '\n' ||
+                                (size == 2 && data[0] == '\r'))) {
+                    this->beginPart();
+                }
+                else if (this->part.header.size() < maxHeaderSize) {
+                    this->part.header.append(data, size);
+                }
+                break;
+            case BODY:
+                this->decode(data, size, complete);
+                break;
+            case SKIPPED:
+                break;
+        }
+    }
+
+    void MimeParser::finish () {
+        if (this->inPart) {
+            // Without delimiter the last line ending belongs to body
+            this->output += this->heldEnding;
+            this->endPart();
+        }
+        this->section = SKIPPED;
+    }
+
+    size_t MimeParser::count () const {
+        return this->parts;
+    }
+
+    bool MimeParser::delimiter (const char* line, size_t size) {
+        // Delimiter may be followed by whitespace
+        while (size > 0 && isspace((unsigned char) line[size - 1])) {
+            --size;
+        }
+        for (size_t i = this->delimiters.size(); i-- > 0; ) {
+            const string& delimiter = this->delimiters[i];
+            if (size < delimiter.size() ||
+                memcmp(line, delimiter.data(), delimiter.size()) != 0) {
+                continue;
+            }
+            size_t rest = size - delimiter.size();
+            bool closing = rest == 2 && line[size - 2] == '-' &&
+                           line[size - 1] == '-';
+            if (rest != 0 && !closing) {
+                continue;
+            }
+            if (this->inPart) {
+                this->endPart();
+            }
+            // Delimiter of outer multipart closes inner ones too
+            this->delimiters.resize(i + 1);
+            if (closing) {
+                this->delimiters.pop_back();
+                this->section = SKIPPED;
+            }
+            else {
+                this->part = MimePart();
+                this->section = HEADER;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void MimeParser::beginPart () {
+        string contentType = getField(this->part.header, "content-type");
+        string type = to_lower_copy(trim_copy(
+                          contentType.substr(0, contentType.find(';'))));
+        if (starts_with(type, "multipart/")) {
+            string boundary = getFieldParameter(contentType, "boundary");
+            if (!boundary.empty()) {
+                this->delimiters.push_back("--" + boundary);
+                this->section = SKIPPED;
+                return;
+            }
+        }
+        this->part.contentType = type.empty() ? "text/plain" : type;
+        this->part.encoding = to_lower_copy(getField(this->part.header,
+                                            "content-transfer-encoding"));
+        if (this->part.encoding.empty()) {
+            this->part.encoding = "7bit";
+        }
+        this->part.filename = getFieldParameter(
+            getField(this->part.header, "content-disposition"), "filename");
+        if (this->part.filename.empty()) {
+            this->part.filename = getFieldParameter(contentType, "name");
+        }
+        this->part.number = ++this->parts;
+        this->base64 = this->part.encoding == "base64";
+        this->quotedPrintable = this->part.encoding == "quoted-printable";
+        this->base64Bits = this->base64Count = 0;
+        this->heldEnding.clear();
+        this->output.clear();
+        this->inPart = true;
+        this->section = BODY;
+        this->sink.begin(this->part);
+    }
+
+    void MimeParser::endPart () {
+        // Incomplete base64 quantum: padding was dropped
+        if (this->base64Count == 2) {
+            this->output += (char) (this->base64Bits >> 4);
+        }
+        else if (this->base64Count == 3) {
+            this->output += (char) (this->base64Bits >> 10);
+            this->output += (char) (this->base64Bits >> 2);
+        }
+        this->base64Bits = this->base64Count = 0;
+        this->heldEnding.clear();
+        this->flush();
+        this->sink.end();
+        this->inPart = false;
+    }
+
+    void MimeParser::decode (const char* data, size_t size, bool complete) {
+        if (this->base64) {
+            this->decodeBase64(data, size);
+        }
+        else {
+            size_t ending = !complete ? 0 :
+                            size >= 2 && data[size - 2] == '\r' ? 2 : 1;
+            this->output += this->heldEnding;
+            this->heldEnding.assign(data + size - ending, ending);
+            if (this->quotedPrintable) {
+                this->decodeQuotedPrintable(data, size - ending, complete);
+            }
+            else {
+                this->output.append(data, size - ending);
+            }
+        }
+        if (this->output.size() >= outputSize) {
+            this->flush();
+        }
+    }
+
+    void MimeParser::decodeBase64 (const char* data, size_t size) {
+        // Initialization of local static is thread-safe, so parsers of
+        // concurrent sessions may build the table at once
+        static const array<signed char, 256> values = [] () {
+            const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                   "abcdefghijklmnopqrstuvwxyz0123456789+/";
+            array<signed char, 256> result;
+            result.fill(-1);
+            for (int i = 0; i < 64; ++i) {
+                result[(unsigned char) alphabet[i]] = i;
+            }
+            return result;
+        }();
+        size_t used = this->output.size();
+        this->output.resize(used + size / 4 * 3 + 3);
+        char* out = &this->output[used];
+        unsigned bits = this->base64Bits, count = this->base64Count;
+        for (size_t i = 0; i < size; ++i) {
+            int value = values[(unsigned char) data[i]];
+            // Line endings, padding and garbage are skipped
+            if (value < 0) {
+                continue;
+            }
+            bits = (bits << 6) | value;
+            if (++count == 4) {
+                *out++ = (char) (bits >> 16);
+                *out++ = (char) (bits >> 8);
+                *out++ = (char) bits;
+                bits = count = 0;
+            }
+        }
+        this->output.resize(out - this->output.data());
+        this->base64Bits = bits;
+        this->base64Count = count;
+    }
+
+    void MimeParser::decodeQuotedPrintable (const char* data, size_t size,
+                                            bool complete) {
+        if (complete) {
+            // Trailing whitespace was added in transport
+            while (size > 0 && (data[size - 1] == ' ' ||
+                                data[size - 1] == '\t')) {
+                --size;
+            }
+            // Soft line break
+            if (size > 0 && data[size - 1] == '=') {
+                --size;
+                this->heldEnding.clear();
+            }
+        }
+        for (size_t i = 0; i < size; ++i) {
+            if (data[i] == '=' && i + 2 < size &&
+                hexDigit(data[i + 1]) >= 0 && hexDigit(data[i + 2]) >= 0) {
+                this->output += (char) (hexDigit(data[i + 1]) * 16 +
+                                        hexDigit(data[i + 2]));
+                i += 2;
+            }
+            else {
+                this->output += data[i];
+            }
+        }
+    }
+
+    void MimeParser::flush () {
+        if (!this->output.empty()) {
+            this->sink.write(this->output.data(), this->output.size());
+            this->output.clear();
+        }
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+namespace post {
+    /**
+     * Leaf part of MIME message (a part which isn't multipart itself).
+     */
+    struct MimePart {
+        /**
+         * Number of part in message, starting from 1.
+         */
+        size_t number;
+        /**
+         * Lowercase `type/subtype' (`text/plain' if it isn't set).
+         */
+        string contentType;
+        /**
+         * Lowercase Content-Transfer-Encoding (`7bit' if it isn't set).
+         */
+        string encoding;
+        /**
+         * File name from Content-Disposition or Content-Type (may be
+         * empty).
+         */
+        string filename;
+        /**
+         * Header of part as it was received.
+         */
+        string header;
+    };
+
+    /**
+     * Receiver of decoded parts.
+     */
+    class MimeSink {
+        public:
+            virtual ~MimeSink ();
+            virtual void begin (const MimePart& part) = 0;
+            /**
+             * Receive next piece of decoded body of the current part.
+             */
+            virtual void write (const char* data, size_t size) = 0;
+            virtual void end () = 0;
+    };
+
+    /**
+     * Streaming MIME parser: message is fed line by line (as it comes from
+     * RETR) and decoded body of every leaf part is passed to sink in
+     * pieces, so memory use doesn't depend on message size. Nested
+     * multiparts are followed by stack of boundaries; base64 and
+     * quoted-printable bodies are decoded on the fly, other encodings are
+     * passed as they are. Preambles and epilogues are dropped.
+     */
+    class MimeParser {
+        private:
+            enum Section {
+                HEADER,
+                BODY,
+                /**
+                 * Preamble or epilogue of multipart.
+                 */
+                SKIPPED
+            };
+            MimeSink& sink;
+            Section section;
+            /**
+             * Delimiters (`--boundary') of open multiparts, the innermost
+             * is the last.
+             */
+            vector<string> delimiters;
+            MimePart part;
+            bool inPart;
+            size_t parts;
+            bool lineStart;
+            /**
+             * Line ending which was held back: the last one before
+             * delimiter belongs to delimiter.
+             */
+            string heldEnding;
+            bool base64;
+            bool quotedPrintable;
+            unsigned base64Bits;
+            unsigned base64Count;
+            /**
+             * Decoded data which wasn't passed to sink yet.
+             */
+            string output;
+
+            /**
+             * Check whether line is delimiter of an open multipart and
+             * close parts which it ends.
+             * @return Returns `true' if line was delimiter.
+             */
+            bool delimiter (const char* line, size_t size);
+            void beginPart ();
+            void endPart ();
+            void decode (const char* data, size_t size, bool complete);
+            void decodeBase64 (const char* data, size_t size);
+            void decodeQuotedPrintable (const char* data, size_t size,
+                                        bool complete);
+            void flush ();
+        public:
+            /**
+             * Construct.
+             * @param sink Receiver of parts.
+             */
+            MimeParser (MimeSink& sink);
+            /**
+             * Feed next piece of message: a line with its ending or a
+             * part of long line.
+             */
+            void feed (const char* data, size_t size);
+            /**
+             * Finish the last part after the whole message was fed.
+             */
+            void finish ();
+            /**
+             * Number of leaf parts which were found.
+             */
+            size_t count () const;
+    };
+
+    /**
+     * Get parameter of structured header field, e.g. `boundary' of
+     * Content-Type. Quoted values are unquoted and RFC 2231 values
+     * (`name*=charset''value') are percent-decoded.
+     * @param value Field value.
+     * @param name Parameter name (case insensitive).
+     * @return Returns parameter value or empty string if there is no such
+     * parameter.
+     */
+    string getFieldParameter (const string& value, const string& name);
+}
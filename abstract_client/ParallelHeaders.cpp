@@ -0,0 +1,35 @@
+#include "ParallelHeaders.hpp"
+#include "HeaderFields.hpp"
+#include <algorithm>
+#include <thread>
+
+namespace post {
+
+    void getHeadersParameters (const strings& headers,
+                               const string& parameterName,
+                               strings& parameters, size_t threads) {
+        // Smaller chunks aren't worth a thread start
+        static const size_t minChunk = 1024;
+        parameters.assign(headers.size(), string());
+        if (threads == 0) {
+            threads = max(thread::hardware_concurrency(), 1u);
+        }
+        threads = min(threads, headers.size() / minChunk + 1);
+        size_t chunk = (headers.size() + threads - 1) / threads;
+        auto extract = [&] (size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                parameters[i] = getHeaderParameter(headers[i], parameterName);
+            }
+        };
+        vector<thread> workers;
+        for (size_t t = 1; t < threads; ++t) {
+            workers.emplace_back(extract, t * chunk,
+                                 min((t + 1) * chunk, headers.size()));
+        }
+        // Calling thread takes the first chunk
+        extract(0, min(chunk, headers.size()));
+        for (thread& worker : workers) {
+            worker.join();
+        }
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <vector>
+#include <string>
+
+using namespace std;
+
+typedef vector<string> strings;
+
+namespace post {
+
+    /**
+     * Extract value of header field from every header. Headers are split
+     * into contiguous chunks which are processed by separate threads; every
+     * thread writes only its own slice of result, so order of values is the
+     * order of headers.
+     * @param headers Message headers.
+     * @param parameterName Field name.
+     * @param parameters Reference to write field values to it.
+     * @param threads Number of threads (0 means number of cores).
+     */
+    void getHeadersParameters (const strings& headers,
+                               const string& parameterName,
+                               strings& parameters, size_t threads = 0);
+}
@@ -1,4 +1,6 @@
 #include "PostProvider.hpp"
+#include "ParallelHeaders.hpp"
+#include "Trace.hpp"
 
 namespace post {
 
@@ -11,9 +13,6 @@ namespace post {
                 bool loginIncorrect, bool passwordIncorrect) : PostException() {
         this->loginIncorrect    = loginIncorrect;
         this->passwordIncorrect = passwordIncorrect;
-    }
-
-    const char* IncorrectAuthorizationDataException::what () const throw() {
         string answer;
         if ((this->loginIncorrect | this->passwordIncorrect) == 0) {
             answer += "Incorrect login and/or password";
@@ -27,8 +26,11 @@ namespace post {
         else if (this->passwordIncorrect && answer != "") {
             answer += "and password";
         }
-        answer += ".";
-        return answer.c_str();
+        this->message = answer + ".";
+    }
+
+    const char* IncorrectAuthorizationDataException::what () const throw() {
+        return this->message.c_str();
     }
 
     // Icorrect state error methods
@@ -64,6 +66,25 @@ namespace post {
         return result.c_str();
     }
 
+    // Temporary Failure error methods
+    TemporaryFailureException::TemporaryFailureException () :
+                               PostException() {
+    }
+
+    const char* TemporaryFailureException::what () const throw() {
+        return "Server is temporarily unavailable.";
+    }
+
+    // Invalid Response error methods
+    InvalidResponseException::InvalidResponseException (string response) :
+                                                        PostException() {
+        this->response = "Unexpected server response: " + response;
+    }
+
+    const char* InvalidResponseException::what () const throw() {
+        return this->response.c_str();
+    }
+
     // Connection Error methods
     ConnectionError::ConnectionError (string message) : PostException() {
         this->message = message;
@@ -73,9 +94,20 @@ namespace post {
         return this->message.c_str();
     }
 
+    // Retention Policy methods
+    RetentionPolicy::RetentionPolicy () {
+        this->maxAge = 0;
+        this->minSize = 0;
+        this->byUIDs = false;
+        this->dryRun = false;
+    }
+
     // Post Provider methods
     PostProvider::PostProvider () {
+        this->state = DISCONNECTED;
         this->setState(DISCONNECTED);
+        this->pipelineDepth = 64;
+        this->threads = 0;
     }
 
     PostProvider::PostProvider (p_TLP transportLayerProvider) : PostProvider() {
@@ -97,10 +129,12 @@ namespace post {
             string message = string(e.what());
             throw ConnectionError(message);
         }
+        this->server = host + ":" + port;
         this->setState(LOGIN_REQUIRED);
     }
 
     void PostProvider::setState (State state) {
+        TRACE2(post__state, (int) this->state, (int) state);
         this->state = state;
     }
     void PostProvider::checkState (int required) throw(PostException) {
@@ -115,9 +149,63 @@ namespace post {
         }
     }
 
-    string PostProvider::send (string message, string responseEnding)
-                              throw(PostException) {
-        return this->transportLayerProvider->send(message, responseEnding);
+    void PostProvider::transmit (const string& message)
+                                throw(PostException) {
+        try {
+            TRACE_CLOCK(post__send, start);
+            this->transportLayerProvider->transmit(message);
+            TRACE2(post__send, message.size(), TRACE_ELAPSED(start));
+        }
+        catch (const TransportException& e) {
+            throw ConnectionError(string(e.what()));
+        }
+    }
+
+    string PostProvider::receive (const string& responseEnding)
+                                 throw(PostException) {
+        try {
+            return this->transportLayerProvider->receive(responseEnding);
+        }
+        catch (const TransportException& e) {
+            throw ConnectionError(string(e.what()));
+        }
+    }
+
+    void PostProvider::receiveInto (string& response,
+                                    const string& responseEnding)
+                                   throw(PostException) {
+        try {
+#ifdef POP3_TRACE
+            size_t received = response.size();
+            TRACE_CLOCK(post__receive, start);
+#endif
+            this->transportLayerProvider->receiveInto(response,
+                                                      responseEnding);
+            TRACE2(post__receive, response.size() - received,
+                   TRACE_ELAPSED(start));
+        }
+        catch (const TransportException& e) {
+            throw ConnectionError(string(e.what()));
+        }
+    }
+
+    bool PostProvider::receiveSome (string& response,
+                                    const string& responseEnding,
+                                    size_t limit) throw(PostException) {
+        try {
+#ifdef POP3_TRACE
+            size_t received = response.size();
+            TRACE_CLOCK(post__receive, start);
+#endif
+            bool complete = this->transportLayerProvider->receiveSome(
+                                response, responseEnding, limit);
+            TRACE2(post__receive, response.size() - received,
+                   TRACE_ELAPSED(start));
+            return complete;
+        }
+        catch (const TransportException& e) {
+            throw ConnectionError(string(e.what()));
+        }
     }
 
     void PostProvider::setTransportLayerProvider (p_TLP transportLayerProvider)
@@ -126,6 +214,31 @@ namespace post {
         this->setState(LOGIN_REQUIRED);
     }
 
+    void PostProvider::setHeaderFilter (p_HF headerFilter) {
+        this->headerFilter = headerFilter;
+    }
+
+    void PostProvider::setDuplicateFilter (p_DF duplicateFilter,
+                                           const string& mailbox) {
+        this->duplicateFilter = duplicateFilter;
+        this->mailbox = mailbox;
+    }
+
+    void PostProvider::setPipelineDepth (size_t pipelineDepth) {
+        this->pipelineDepth = pipelineDepth > 0 ? pipelineDepth : 1;
+    }
+
+    void PostProvider::setThreads (size_t threads) {
+        this->threads = threads;
+    }
+
+    bool PostProvider::isHeaderAccepted (const string& header) {
+        // Only letters which pass filter are remembered as seen
+        return (!this->headerFilter || this->headerFilter->matches(header)) &&
+               (!this->duplicateFilter ||
+                this->duplicateFilter->accept(header, this->mailbox));
+    }
+
     bool PostProvider::isConnected () {
         return this->transportLayerProvider->isConnected();
     }
@@ -138,18 +251,10 @@ namespace post {
                       const string& parameterName) throw(PostException) {
         strings headers;
         parameters.clear();
-        int valueStart, valueLength;
         this->getLettersHeaders(headers);
-        for (string header : headers) {
-            valueStart = header.find(parameterName + ": ");
-            if (valueStart == string::npos) {
-                parameters.push_back("");
-                continue;
-            }
-            valueStart += parameterName.size() + 2;
-            valueLength = header.find("\r\n", valueStart) - valueStart;
-            parameters.push_back(header.substr(valueStart, valueLength));
-        }
+        getHeadersParameters(headers, parameterName, parameters,
+                             this->threads);
+        this->stored.resize(0);
     }
 
     // Other functions
@@ -4,7 +4,13 @@
 #include <string>
 #include <iostream>
 #include <exception>
+#include <unordered_set>
+#include <unordered_map>
+#include <functional>
+#include <ctime>
 #include "TransportLayerProvider.hpp"
+#include "HeaderFilter.hpp"
+#include "DuplicateFilter.hpp"
 
 using namespace std;
 using namespace transport;
@@ -78,6 +84,10 @@ namespace post {
              * Set true if password is incorrect.
              */
             bool passwordIncorrect;
+            /**
+             * Error message (`what' returns pointer into it).
+             */
+            string message;
         public:
             /**
              * Construct new authorization error.
@@ -107,6 +117,16 @@ namespace post {
             virtual const char* what() const throw();
     };
 
+    /**
+     * Thrown when server is busy (see TEMPORARY_FAILURE): the same command
+     * may succeed later.
+     */
+    class TemporaryFailureException : public PostException {
+        public:
+            TemporaryFailureException ();
+            virtual const char* what() const throw();
+    };
+
     /**
      * Connection Error class.
      */
@@ -125,6 +145,67 @@ namespace post {
             virtual const char* what() const throw();
     };
 
+    /**
+     * Receives letter headers one by one as soon as they're downloaded.
+     * First parameter is unique ID of letter (UIDL), second is its header.
+     */
+    typedef function<void (const string&, const string&)> HeaderHandler;
+
+    /**
+     * Receives letter piece by piece while it's downloaded: every piece is
+     * a line with its ending (lines longer than 64 KiB come in several
+     * pieces). Lines are unstuffed, terminating dot isn't passed.
+     */
+    typedef function<void (const char*, size_t)> LetterHandler;
+
+    /**
+     * Which messages should be deleted by retention.
+     * Message is selected if it satisfies every criterion which is set.
+     */
+    struct RetentionPolicy {
+        /**
+         * Select messages older than this number of seconds (by Date field).
+         * Set 0 to ignore age.
+         */
+        time_t maxAge;
+        /**
+         * Select messages larger than this number of octets.
+         * Set 0 to ignore size.
+         */
+        size_t minSize;
+        /**
+         * Select only messages with UIDs from `uids' if `true'.
+         */
+        bool byUIDs;
+        /**
+         * UIDs of messages which are allowed to be deleted
+         * (e.g., already archived).
+         */
+        unordered_set<string> uids;
+        /**
+         * Only count what would be deleted, don't delete anything.
+         */
+        bool dryRun;
+        /**
+         * Construct policy which selects every message.
+         */
+        RetentionPolicy ();
+    };
+
+    /**
+     * Result of retention.
+     */
+    struct RetentionReport {
+        /**
+         * Number of deleted (or selected for dry run) messages.
+         */
+        size_t deleted;
+        /**
+         * Size of deleted (or selected for dry run) messages in octets.
+         */
+        size_t octets;
+    };
+
     /**
      * Post Provider class.
      * Abstract class for interacting with email server on application level.
@@ -146,6 +227,49 @@ namespace post {
              * Transport Layer Provider for communication with email server.
              */
             p_TLP transportLayerProvider;
+            /**
+             * Server of the last connection as `host:port'.
+             */
+            string server;
+            /**
+             * Filter for headers: messages which don't match it are dropped
+             * right after their headers are received.
+             */
+            p_HF headerFilter;
+            /**
+             * Message-IDs seen in other mailboxes: their copies in this
+             * mailbox are dropped like filtered messages.
+             */
+            p_DF duplicateFilter;
+            /**
+             * Name of this mailbox for Duplicate Filter.
+             */
+            string mailbox;
+            /**
+             * How many commands may be sent before their responses are
+             * read when server supports pipelining.
+             */
+            size_t pipelineDepth;
+            /**
+             * Number of threads which extract header parameters (0 means
+             * number of cores).
+             */
+            size_t threads;
+            /**
+             * Memory held by headers which were returned by
+             * `getLettersHeaders' and are still kept by caller. Charge is
+             * replaced by the next download.
+             */
+            MemoryCharge stored;
+            /**
+             * Check whether message should be kept according to header
+             * filter and whether it isn't a copy of letter from another
+             * mailbox.
+             * @param header Message header.
+             * @return Returns `true' if header matches filter (or there is
+             * no filter) and letter isn't a duplicate.
+             */
+            bool isHeaderAccepted (const string& header);
             /**
              * State checking function for throwing exception.
              * Compares actual state (this->state) with required and throws 
@@ -169,18 +293,36 @@ namespace post {
              */
             void checkState(int required) throw(PostException);
             /**
-             * Send message via Transport Layer Provider.
-             * Allowed in states AUTHORIZED, PASSWORD_REQUIRED, AUTHORIZED
-             * (not allowed when DISCONNECTED).
+             * Send message via Transport Layer Provider without waiting for
+             * response.
              * @param message The message to send to email server.
+             * @throws ConnectionError Thrown if message can't be sent.
+             */
+            void transmit (const string& message) throw(PostException);
+            /**
+             * Receive response which was requested by `transmit'.
              * @param responseEnding String which indicates end of server
              * response.
              * @returns Answer of the server.
-             * @throws IncorrectStateException Thrown if connection wasn't
-             * established
+             * @throws ConnectionError Thrown if response can't be received.
+             */
+            string receive (const string& responseEnding = "\r\n")
+                           throw(PostException);
+            /**
+             * Receive response and append it to the string.
+             * @param response Reference to append response to it.
+             * @param responseEnding String which indicates end of server
+             * response.
+             * @throws ConnectionError Thrown if response can't be received.
              */
-            string send (string message, string responseEnding = "\r\n")
-                        throw(PostException);
+            void receiveInto (string& response, const string& responseEnding)
+                             throw(PostException);
+            /**
+             * Receive part of large response (see Transport Layer Provider).
+             * @throws ConnectionError Thrown if response can't be received.
+             */
+            bool receiveSome (string& response, const string& responseEnding,
+                              size_t limit) throw(PostException);
             /**
              * Checks wether mail server answered OK or not OK.
              * @param response Response to check.
@@ -218,7 +360,8 @@ namespace post {
              */
             void connect (string host, string port) throw(PostException);
             /**
-             * Sign in to mailbox.
+             * Sign in to mailbox. Login and password may be sent together,
+             * so state goes from LOGIN_REQUIRED right to AUTHORIZED.
              * Allowed in state LOGIN_REQUIRED.
              * @param login User name.
              * @param password User password.
@@ -260,13 +403,117 @@ namespace post {
             /**
              * Get letters headers.
              * Allowed in state AUTHORIZED.
+             * Headers which don't match header filter are not stored.
              * @param headers Reference to vector where result will be stored.
              * @throws IncorrectStateException Thrown if not authorized.
              */
             virtual void getLettersHeaders (strings& headers)
                                       throw(PostException) = 0;
+            /**
+             * Get headers of the newest letters, newest first. Only the
+             * last `count' letters are requested; if `since' is set,
+             * reading stops at the first letter with older Date.
+             * Allowed in state AUTHORIZED.
+             * Headers which don't match header filter are not stored.
+             * @param headers Reference to vector where result will be stored.
+             * @param count Maximal number of letters to look at.
+             * @param since UNIX time of the oldest interesting letter
+             * (0 disables the cutoff).
+             * @throws IncorrectStateException Thrown if not authorized.
+             */
+            virtual void getRecentLettersHeaders (strings& headers,
+                size_t count, time_t since) throw(PostException) = 0;
+            /**
+             * Get letters headers one by one together with their unique IDs.
+             * Allowed in state AUTHORIZED.
+             * Headers which don't match header filter are skipped.
+             * @param handler Function which is called for every header
+             * right after it's received.
+             * @param skipUIDs Unique IDs of letters which should not be
+             * downloaded (e.g., downloaded earlier).
+             * @throws IncorrectStateException Thrown if not authorized.
+             * @throws ConnectionError Thrown if server doesn't support
+             * unique IDs.
+             */
+            virtual void getLettersHeaders (const HeaderHandler& handler,
+                const unordered_set<string>& skipUIDs)
+                throw(PostException) = 0;
+            /**
+             * Get IDs (numbers) of letters and their sizes.
+             * Allowed in state AUTHORIZED.
+             * @param ids Reference to vector where IDs will be stored.
+             * @param sizes Reference to vector where sizes of letters
+             * (in octets) will be stored.
+             * @throws IncorrectStateException Thrown if not authorized.
+             */
+            virtual void getLettersIDs (strings& ids, vector<size_t>& sizes)
+                                       throw(PostException) = 0;
+            /**
+             * Get number of letters and size of mailbox.
+             * Allowed in state AUTHORIZED.
+             * @param count Reference to write number of letters to it.
+             * @param octets Reference to write size of mailbox to it.
+             * @throws IncorrectStateException Thrown if not authorized.
+             */
+            virtual void getMailboxStat (size_t& count, size_t& octets)
+                                        throw(PostException) = 0;
+            /**
+             * Get unique ID of one letter.
+             * Allowed in state AUTHORIZED.
+             * @param id ID of letter.
+             * @param uid Reference to write unique ID to it.
+             * @throws IncorrectStateException Thrown if not authorized.
+             * @throws ConnectionError Thrown if there is no such letter or
+             * server doesn't support unique IDs.
+             */
+            virtual void getLetterUID (const string& id, string& uid)
+                                      throw(PostException) = 0;
+            /**
+             * Get unique IDs of letters.
+             * Allowed in state AUTHORIZED.
+             * @param uids Reference to map where ID -> unique ID pairs will
+             * be stored.
+             * @throws IncorrectStateException Thrown if not authorized.
+             * @throws ConnectionError Thrown if server doesn't support
+             * unique IDs.
+             */
+            virtual void getLettersUIDs (unordered_map<string, string>& uids)
+                                        throw(PostException) = 0;
+            /**
+             * Get header of one letter.
+             * Allowed in state AUTHORIZED.
+             * @param id ID of letter.
+             * @param header Reference to string where header will be stored.
+             * @throws IncorrectStateException Thrown if not authorized.
+             * @throws ConnectionError Thrown if letter can't be received.
+             */
+            virtual void getLetterHeader (const string& id, string& header)
+                                         throw(PostException) = 0;
+            /**
+             * Get whole letter.
+             * Allowed in state AUTHORIZED.
+             * @param id ID of letter.
+             * @param letter Reference to string where letter will be stored.
+             * @throws IncorrectStateException Thrown if not authorized.
+             * @throws ConnectionError Thrown if letter can't be received.
+             */
+            virtual void getLetter (const string& id, string& letter)
+                                   throw(PostException) = 0;
+            /**
+             * Get whole letter without keeping it in memory.
+             * Allowed in state AUTHORIZED.
+             * @param id ID of letter.
+             * @param handler Function which receives letter piece by piece.
+             * @throws IncorrectStateException Thrown if not authorized.
+             * @throws ConnectionError Thrown if letter can't be received.
+             */
+            virtual void getLetter (const string& id,
+                                    const LetterHandler& handler)
+                                   throw(PostException) = 0;
             /**
              * Get vector of strings with parameter values for every message.
+             * Headers are received first and then parameters are extracted
+             * from them by `threads' threads in the order of messages.
              * Allowed in state AUTHORIZED.
              * @param headers Vector where result will be stored.
              * @param parameterName The name of parameter which is needed to
@@ -275,6 +522,17 @@ namespace post {
              */
             void getLettersHeadersParameters (strings& parameters,
                 const string& parameterName) throw(PostException);
+            /**
+             * Mark messages selected by retention policy as deleted.
+             * Deletion is committed by `signout'.
+             * Allowed in state AUTHORIZED.
+             * @param policy Which messages to delete.
+             * @param report Reference to write number and size of deleted
+             * messages to it.
+             * @throws IncorrectStateException Thrown if not authorized.
+             */
+            virtual void deleteLetters (const RetentionPolicy& policy,
+                RetentionReport& report) throw(PostException) = 0;
             /**
              * Set Transport Layer Provider.
              * Allowed in state DISCONNECTED.
@@ -285,6 +543,30 @@ namespace post {
              */
             void setTransportLayerProvider (p_TLP transportLayerProvider)
                                            throw(PostException);
+            /**
+             * Set header filter. Pass NULL pointer to disable filtering.
+             * @param headerFilter Compiled header filter.
+             */
+            void setHeaderFilter (p_HF headerFilter);
+            /**
+             * Set Duplicate Filter. Pass NULL pointer to keep copies of
+             * letters from other mailboxes.
+             * @param duplicateFilter Set of seen Message-IDs.
+             * @param mailbox Name of this mailbox, e.g. `login@host:port'.
+             */
+            void setDuplicateFilter (p_DF duplicateFilter,
+                                     const string& mailbox);
+            /**
+             * Set maximal number of pipelined commands.
+             * @param pipelineDepth Number of commands sent at once
+             * (1 disables pipelining).
+             */
+            void setPipelineDepth (size_t pipelineDepth);
+            /**
+             * Set number of threads which extract header parameters.
+             * @param threads Number of threads (0 means number of cores).
+             */
+            void setThreads (size_t threads);
             /**
              * Is Post Provider connected to email server?
              * @return Returns `true' if connected and `false' otherwise.
@@ -0,0 +1,68 @@
+#pragma once
+
+namespace post {
+
+    /**
+     * Outcome of operation for the exception-free API.
+     */
+    enum ErrorCode {
+        SUCCESS              = 0x0, // Operation succeeded.
+        NOT_CONNECTED        = 0x1, // Connection isn't established.
+        WRONG_STATE          = 0x2, // Operation isn't allowed in this state.
+        AUTHORIZATION_FAILED = 0x3, // Login or password is wrong.
+        NEGATIVE_RESPONSE    = 0x4, // Server answered "not OK".
+        INVALID_RESPONSE     = 0x5, // Server answer wasn't recognised.
+        TRANSPORT_FAILED     = 0x6, // Connection error.
+        TEMPORARY_FAILURE    = 0x7  // Server is busy, try again later.
+    };
+
+    /**
+     * Result of operation: error code instead of thrown exception.
+     * Ordinary failures (bad credentials, negative response) are reported
+     * without throwing and without allocating: the message is static.
+     */
+    class Result {
+        private:
+            ErrorCode code;
+        public:
+            Result (ErrorCode code = SUCCESS) : code(code) {
+            }
+            /**
+             * Check whether operation succeeded.
+             */
+            bool ok () const {
+                return this->code == SUCCESS;
+            }
+            explicit operator bool () const {
+                return this->ok();
+            }
+            ErrorCode error () const {
+                return this->code;
+            }
+            /**
+             * Describe the error.
+             * @return Returns static string with error description.
+             */
+            const char* what () const {
+                switch (this->code) {
+                    case SUCCESS:
+                        return "Success.";
+                    case NOT_CONNECTED:
+                        return "Connection is needed to be opened.";
+                    case WRONG_STATE:
+                        return "Operation isn't allowed in current state.";
+                    case AUTHORIZATION_FAILED:
+                        return "Incorrect login and/or password.";
+                    case NEGATIVE_RESPONSE:
+                        return "Server responsed negatively.";
+                    case INVALID_RESPONSE:
+                        return "Unexpected server response.";
+                    case TRANSPORT_FAILED:
+                        return "Connection error.";
+                    case TEMPORARY_FAILURE:
+                        return "Server is temporarily unavailable.";
+                }
+                return "Unknown error.";
+            }
+    };
+}
@@ -0,0 +1,20 @@
+#include "Trace.hpp"
+
+#ifdef POP3_TRACE
+// Semaphores live in `.probes' section, as `dtrace -G' places them
+#define TRACE_SEMAPHORE(name) \
+    volatile unsigned short pop3_client_##name##_semaphore \
+        __attribute__((section(".probes"))) = 0
+
+extern "C" {
+    TRACE_SEMAPHORE(transport__connect);
+    TRACE_SEMAPHORE(transport__transmit);
+    TRACE_SEMAPHORE(transport__receive);
+    TRACE_SEMAPHORE(transport__disconnect);
+    TRACE_SEMAPHORE(post__send);
+    TRACE_SEMAPHORE(post__receive);
+    TRACE_SEMAPHORE(post__state);
+    TRACE_SEMAPHORE(pop3__command);
+    TRACE_SEMAPHORE(pop3__header);
+}
+#endif
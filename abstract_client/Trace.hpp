@@ -0,0 +1,133 @@
+#pragma once
+
+/**
+ * Static tracepoints (USDT) of provider `pop3_client' for perf, bpftrace
+ * and SystemTap, e.g.
+ *   bpftrace -e 'usdt:./pop3_client:pop3_client:pop3__command
+ *                { @[str(arg0, arg1)] = hist(arg4); }'
+ * Probes:
+ *   transport__connect (latency)
+ *   transport__transmit (bytes)
+ *   transport__receive (bytes, latency)
+ *   transport__disconnect ()
+ *   post__send (bytes, latency)
+ *   post__receive (bytes, latency)
+ *   post__state (old state, new state)
+ *   pop3__command (command, command length, status, response bytes,
+ *                  latency)
+ *   pop3__header (message number, bytes, accepted, latency)
+ * Latencies are in microseconds.
+ * Probes are compiled in when <sys/sdt.h> is available (systemtap-sdt-dev
+ * package); build with -DPOP3_NO_TRACE to leave them out anyway. Every
+ * probe has a semaphore (defined in Trace.cpp) which tracer increments
+ * while it's attached: until then probe is a test of its semaphore,
+ * arguments aren't evaluated and clocks aren't read.
+ */
+#if !defined(POP3_NO_TRACE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define POP3_TRACE 1
+#endif
+#endif
+
+#ifdef POP3_TRACE
+#include <chrono>
+
+extern "C" {
+    extern volatile unsigned short pop3_client_transport__connect_semaphore;
+    extern volatile unsigned short pop3_client_transport__transmit_semaphore;
+    extern volatile unsigned short pop3_client_transport__receive_semaphore;
+    extern volatile unsigned short
+        pop3_client_transport__disconnect_semaphore;
+    extern volatile unsigned short pop3_client_post__send_semaphore;
+    extern volatile unsigned short pop3_client_post__receive_semaphore;
+    extern volatile unsigned short pop3_client_post__state_semaphore;
+    extern volatile unsigned short pop3_client_pop3__command_semaphore;
+    extern volatile unsigned short pop3_client_pop3__header_semaphore;
+}
+
+/**
+ * Check whether tracer is attached to probe.
+ */
+#define TRACE_ENABLED(name) \
+    __builtin_expect(pop3_client_##name##_semaphore != 0, 0)
+/**
+ * The same checks under names which `dtrace -h' generates.
+ */
+#define POP3_CLIENT_TRANSPORT__CONNECT_ENABLED() \
+    TRACE_ENABLED(transport__connect)
+#define POP3_CLIENT_TRANSPORT__TRANSMIT_ENABLED() \
+    TRACE_ENABLED(transport__transmit)
+#define POP3_CLIENT_TRANSPORT__RECEIVE_ENABLED() \
+    TRACE_ENABLED(transport__receive)
+#define POP3_CLIENT_TRANSPORT__DISCONNECT_ENABLED() \
+    TRACE_ENABLED(transport__disconnect)
+#define POP3_CLIENT_POST__SEND_ENABLED() TRACE_ENABLED(post__send)
+#define POP3_CLIENT_POST__RECEIVE_ENABLED() TRACE_ENABLED(post__receive)
+#define POP3_CLIENT_POST__STATE_ENABLED() TRACE_ENABLED(post__state)
+#define POP3_CLIENT_POP3__COMMAND_ENABLED() TRACE_ENABLED(pop3__command)
+#define POP3_CLIENT_POP3__HEADER_ENABLED() TRACE_ENABLED(pop3__header)
+
+#define TRACE(name) \
+    do { \
+        if (TRACE_ENABLED(name)) { \
+            DTRACE_PROBE(pop3_client, name); \
+        } \
+    } while (0)
+#define TRACE1(name, a) \
+    do { \
+        if (TRACE_ENABLED(name)) { \
+            DTRACE_PROBE1(pop3_client, name, a); \
+        } \
+    } while (0)
+#define TRACE2(name, a, b) \
+    do { \
+        if (TRACE_ENABLED(name)) { \
+            DTRACE_PROBE2(pop3_client, name, a, b); \
+        } \
+    } while (0)
+#define TRACE3(name, a, b, c) \
+    do { \
+        if (TRACE_ENABLED(name)) { \
+            DTRACE_PROBE3(pop3_client, name, a, b, c); \
+        } \
+    } while (0)
+#define TRACE4(name, a, b, c, d) \
+    do { \
+        if (TRACE_ENABLED(name)) { \
+            DTRACE_PROBE4(pop3_client, name, a, b, c, d); \
+        } \
+    } while (0)
+#define TRACE5(name, a, b, c, d, e) \
+    do { \
+        if (TRACE_ENABLED(name)) { \
+            DTRACE_PROBE5(pop3_client, name, a, b, c, d, e); \
+        } \
+    } while (0)
+/**
+ * Remember current time for latency argument of probe; clock isn't read
+ * if tracer isn't attached to the probe.
+ */
+#define TRACE_CLOCK(name, clock) \
+    std::chrono::steady_clock::time_point clock = TRACE_ENABLED(name) ? \
+        std::chrono::steady_clock::now() : \
+        std::chrono::steady_clock::time_point()
+/**
+ * Microseconds since TRACE_CLOCK (0 if tracer attached after it).
+ */
+#define TRACE_ELAPSED(clock) \
+    (clock == std::chrono::steady_clock::time_point() ? 0LL : \
+     (long long) std::chrono::duration_cast<std::chrono::microseconds>( \
+         std::chrono::steady_clock::now() - clock).count())
+#else
+#define TRACE(name) ((void) 0)
+#define TRACE1(name, a) ((void) 0)
+#define TRACE2(name, a, b) ((void) 0)
+#define TRACE3(name, a, b, c) ((void) 0)
+#define TRACE4(name, a, b, c, d) ((void) 0)
+#define TRACE5(name, a, b, c, d, e) ((void) 0)
+#define TRACE_ENABLED(name) false
+#define TRACE_CLOCK(name, clock) ((void) 0)
+#define TRACE_ELAPSED(clock) 0
+#endif
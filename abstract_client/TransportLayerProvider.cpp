@@ -1,4 +1,5 @@
 #include "TransportLayerProvider.hpp"
+#include <algorithm>
 
 namespace transport {
 
@@ -30,6 +31,11 @@ namespace transport {
                  "connect.";
         return result.c_str();
     }
+    /**
+     * Function which is called when provider reaches a connection stage.
+     */
+    static void (*connectionStageHandler) (ConnectionStage) = NULL;
+
     // Transport Layer Provider methods
     TransportLayerProvider::TransportLayerProvider () {
         this->connectionEstablished = false;
@@ -38,14 +44,59 @@ namespace transport {
     TransportLayerProvider::~TransportLayerProvider () {
     }
 
+    void TransportLayerProvider::connectionStage (ConnectionStage stage) {
+        if (connectionStageHandler != NULL) {
+            connectionStageHandler(stage);
+        }
+    }
+
+    void TransportLayerProvider::setConnectionStageHandler (
+                                 void (*handler) (ConnectionStage)) {
+        connectionStageHandler = handler;
+    }
+
     void TransportLayerProvider::checkConnectionState (bool requiredState,
-         string actionName) throw(IncorrectConnectionStateException) {
+         const char* actionName) throw(IncorrectConnectionStateException) {
         if (this->isConnected() != requiredState) {
             throw IncorrectConnectionStateException(requiredState, actionName);
         }
     }
 
+    string TransportLayerProvider::send (const string& message,
+                                         const string& responseEnding)
+                                        throw(TransportException) {
+        this->transmit(message);
+        return this->receive(responseEnding);
+    }
+
+    string TransportLayerProvider::receive (const string& responseEnding)
+                                           throw(TransportException) {
+        string response;
+        this->receiveInto(response, responseEnding);
+        return response;
+    }
+
+    size_t TransportLayerProvider::partSize (const char* data, size_t size,
+                                             const string& ending,
+                                             size_t limit, bool& complete) {
+        // Ending which starts within limit is taken whole
+        size_t window = min(size, limit + ending.size() - 1);
+        const char* found = search(data, data + window, ending.begin(),
+                                   ending.end());
+        complete = found != data + window;
+        if (complete) {
+            return found - data + ending.size();
+        }
+        // Tail may be the beginning of the ending
+        size_t kept = ending.size() - 1;
+        return size > kept ? min(limit, size - kept) : 0;
+    }
+
     bool TransportLayerProvider::isConnected () {
         return this->connectionEstablished;
     }
+
+    const string& TransportLayerProvider::getGreeting () const {
+        return this->greeting;
+    }
 }
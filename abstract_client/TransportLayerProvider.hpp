@@ -2,6 +2,7 @@
 #include <memory>
 #include <string>
 #include <exception>
+#include "MemoryBudget.hpp"
 
 using namespace std;
 
@@ -44,6 +45,21 @@ namespace transport {
                                                string actionName);
             virtual const char* what () const throw();
     };
+
+    /**
+     * Stage of connection which is reported to startup benchmark.
+     */
+    enum ConnectionStage {
+        /**
+         * The first packet (SYN) is about to be sent.
+         */
+        CONNECTION_STARTING,
+        /**
+         * TLS is initialized and ClientHello is about to be sent.
+         */
+        HANDSHAKE_STARTING
+    };
+
     /**
      * Transport Layer Provider -- via this thing Post Provider communicates
      * with email server.
@@ -56,6 +72,36 @@ namespace transport {
              * or not (`false').
              */
             bool connectionEstablished;
+            /**
+             * Memory held by the last response and received data which
+             * wasn't returned yet. It's charged after every response, so
+             * under memory pressure the next read waits for the budget.
+             */
+            MemoryCharge received;
+            /**
+             * Greeting of server which was received on connection.
+             */
+            string greeting;
+            /**
+             * Find how much of received data `receiveSome' may return.
+             * @param data Received data.
+             * @param size Size of received data.
+             * @param ending Response ending.
+             * @param limit Maximal part size.
+             * @param complete Reference to write `true' to it if part
+             * ends with the ending.
+             * @return Returns part size (0 if more data is needed).
+             */
+            static size_t partSize (const char* data, size_t size,
+                                    const string& ending, size_t limit,
+                                    bool& complete);
+            /**
+             * Call connection stage handler if it's set. Transports call
+             * it right before the first packet (SYN) is sent and right
+             * before TLS handshake starts.
+             * @param stage Stage which is reached.
+             */
+            static void connectionStage (ConnectionStage stage);
         public:
             /**
              * Construct.
@@ -79,8 +125,53 @@ namespace transport {
              * response.
              * @return Response of the server.
              */
-            virtual string send (string message, string responseEnding = "\r\n")
-                                throw(TransportException) = 0;
+            string send (const string& message,
+                         const string& responseEnding = "\r\n")
+                        throw(TransportException);
+            /**
+             * Send message to the server without waiting for response.
+             * Several messages can be transmitted before their responses
+             * are received (pipelining).
+             * @param message Message to be sent.
+             */
+            virtual void transmit (const string& message)
+                                  throw(TransportException) = 0;
+            /**
+             * Receive response of the server. Data which arrived after
+             * the ending is kept for the next response.
+             * @param responseEnding String which indicates end of server
+             * response.
+             * @return Response of the server including the ending.
+             */
+            string receive (const string& responseEnding = "\r\n")
+                           throw(TransportException);
+            /**
+             * Receive response of the server and append it to the string,
+             * so buffer of the caller is reused from response to response.
+             * @param response Reference to append response (including the
+             * ending) to it.
+             * @param responseEnding String which indicates end of server
+             * response.
+             */
+            virtual void receiveInto (string& response,
+                                      const string& responseEnding)
+                                     throw(TransportException) = 0;
+            /**
+             * Receive part of response which may be too large to keep in
+             * memory. Waits for data and appends it to the string up to
+             * the first ending or at most `limit' octets of it. Data which
+             * may be the beginning of the ending is kept until the rest of
+             * it arrives, so the ending is never split between parts.
+             * @param response Reference to append data to it.
+             * @param responseEnding String after which nothing is taken.
+             * @param limit Maximal number of octets to append (if ending
+             * isn't found in them).
+             * @return Returns `true' if data ends with the ending.
+             */
+            virtual bool receiveSome (string& response,
+                                      const string& responseEnding,
+                                      size_t limit)
+                                     throw(TransportException) = 0;
             /**
              * Disconnect from the server.
              */
@@ -91,6 +182,12 @@ namespace transport {
              * returns `false' otherwise.
              */
             bool isConnected ();
+            /**
+             * Get greeting of server (APOP needs timestamp from it).
+             * @return Returns the first line received after connection
+             * including its ending.
+             */
+            const string& getGreeting () const;
             /**
              * Compare actual and required connection state.
              * @param requiredState Required state for current action.
@@ -98,8 +195,16 @@ namespace transport {
              * @throws IncorrectConnectionStateException Thrown if required
              * state is not equal to actual state.
              */
-            void checkConnectionState (bool requiredState, string actionName)
+            void checkConnectionState (bool requiredState,
+                                       const char* actionName)
                                       throw(IncorrectConnectionStateException);
+            /**
+             * Set function which is called when any provider reaches a
+             * stage of connection (used to measure startup time).
+             * @param handler Function to call, NULL removes handler.
+             */
+            static void setConnectionStageHandler (
+                            void (*handler) (ConnectionStage));
     };
 
     typedef shared_ptr<TransportLayerProvider>  p_TLP;
@@ -1,3 +1,10 @@
+#include "abstract_client/MemoryBudget.hpp"
 #include "abstract_client/TransportLayerProvider.hpp"
+#include "abstract_client/HeaderFields.hpp"
+#include "abstract_client/ParallelHeaders.hpp"
+#include "abstract_client/HeaderFilter.hpp"
+#include "abstract_client/DuplicateFilter.hpp"
 #include "abstract_client/PostProvider.hpp"
+#include "abstract_client/Result.hpp"
 #include "abstract_client/MailClient.hpp"
+#include "abstract_client/BasicMailClient.hpp"
@@ -3,14 +3,31 @@
 #include <exception>
 #include <boost/array.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include "../abstract_client/Trace.hpp"
 
 using namespace std;
 
-TLSTransportLayerProvider::TLSTransportLayerProvider () :
-                           TransportLayerProvider() {
-    // Constructing socket ssl stream
-    context c(context::sslv3_client);
-    s.reset(new stream<tcp::socket>(this->i, c));
+/**
+ * Size of one read from TLS stream: a TLS record carries at most 16 KiB of
+ * plaintext, so larger buffer isn't filled by a read anyway.
+ */
+static const size_t readSize = 16 << 10;
+
+io_service& TLSTransportLayerProvider::sharedService () {
+    static io_service service;
+    return service;
+}
+
+context& TLSTransportLayerProvider::tlsContext () {
+    static context c(context::sslv23_client);
+    static long mode = SSL_CTX_set_mode(c.native_handle(),
+                                        SSL_MODE_RELEASE_BUFFERS);
+    (void) mode;
+    return c;
+}
+
+TLSTransportLayerProvider::TLSTransportLayerProvider (io_service& service) :
+                           TransportLayerProvider(), i(service) {
 }
 
 TLSTransportLayerProvider::~TLSTransportLayerProvider () {
@@ -19,16 +36,25 @@ TLSTransportLayerProvider::~TLSTransportLayerProvider () {
 void TLSTransportLayerProvider::connect (string server, string port)
                                         throw(TransportException) {
     this->checkConnectionState(false, "connect");
+    TRACE_CLOCK(transport__connect, start);
     system::error_code e;
+    tcp::socket socket(this->i);
     try {
         // Connect to server
         tcp::resolver resolver(this->i);
         tcp::resolver::query query(server, port);
-        this->s->lowest_layer().connect(*resolver.resolve(query));
+        tcp::resolver::iterator endpoint = resolver.resolve(query);
+        connectionStage(CONNECTION_STARTING);
+        socket.connect(*endpoint);
     }
     catch (boost::system::system_error) {
         throw ConnectionException("Unable to establish connection.");
     }
+    // TLS is initialized only after the connection was established (and
+    // only once per process). Stream of the previous connection can't be
+    // reused: TLS session is bound to it
+    this->s.reset(new stream<tcp::socket>(std::move(socket), tlsContext()));
+    connectionStage(HANDSHAKE_STARTING);
 
     try {
         // Handshake for TLS
@@ -38,38 +64,77 @@ void TLSTransportLayerProvider::connect (string server, string port)
         throw ConnectionException("Unable provide handshake.");
     }
     // Get response from the server
-    boost::asio::streambuf response;
-    read(*(this->s), response, transfer_at_least(1), e);
+    size_t size = asio::read_until(*(this->s), this->response, "\r\n", e);
+    this->greeting.assign(buffers_begin(this->response.data()),
+                          buffers_begin(this->response.data()) + size);
+    this->response.consume(size);
     this->connectionEstablished = true;
+    TRACE1(transport__connect, TRACE_ELAPSED(start));
 }
 
 void TLSTransportLayerProvider::disconnect () throw(TransportException) {
     this->checkConnectionState(true, "disconnect");
-    this->s->lowest_layer().close();
+    this->s.reset();
+    this->response.consume(this->response.size());
+    this->received.resize(0);
+    this->connectionEstablished = false;
+    TRACE(transport__disconnect);
 }
 
-string TLSTransportLayerProvider::send (string message, string responseEnding)
-                                       throw(TransportException) {
+void TLSTransportLayerProvider::transmit (const string& message)
+                                         throw(TransportException) {
     this->checkConnectionState(true, "send a message");
-    asio::streambuf response;
     system::error_code e;
-    string result;
-
     // Transfer the message
-    write(*(this->s), buffer(message, message.size()));
-    // Read the response
-    asio::read_until(*(this->s), response, responseEnding, e);
-    // Convert the answer to string
-    result = string((istreambuf_iterator<char>(&response)), 
-                     istreambuf_iterator<char>());
-    /*
-    if (result.find(responseEnding) == string::npos) throw runtime_error(":'(");
-    else {
-        cerr << result.find(responseEnding);
-        if (result.find(responseEnding) < 10)
-            cerr << ": " << result;
-        cerr << endl;
+    write(*(this->s), buffer(message.data(), message.size()), e);
+    if (e) {
+        throw ConnectionException("Unable to send a message.");
+    }
+    TRACE1(transport__transmit, message.size());
+}
+
+void TLSTransportLayerProvider::receiveInto (string& response,
+                                             const string& responseEnding)
+                                            throw(TransportException) {
+    this->checkConnectionState(true, "receive a message");
+    TRACE_CLOCK(transport__receive, start);
+    system::error_code e;
+    // Read the response: data after the ending stays in the buffer
+    size_t size = asio::read_until(*(this->s), this->response,
+                                   responseEnding, e);
+    if (e) {
+        throw ConnectionException("Unable to receive a response.");
+    }
+    // Append the answer to the string: streambuf data is contiguous, so
+    // it's copied directly without temporary string
+    response.append(buffer_cast<const char*>(this->response.data()), size);
+    this->response.consume(size);
+    this->received.resize(response.capacity() + this->response.capacity());
+    TRACE2(transport__receive, size, TRACE_ELAPSED(start));
+}
+
+bool TLSTransportLayerProvider::receiveSome (string& response,
+                                             const string& responseEnding,
+                                             size_t limit)
+                                            throw(TransportException) {
+    this->checkConnectionState(true, "receive a message");
+    TRACE_CLOCK(transport__receive, start);
+    bool complete;
+    size_t size;
+    while ((size = partSize(buffer_cast<const char*>(this->response.data()),
+                            this->response.size(), responseEnding, limit,
+                            complete)) == 0) {
+        system::error_code e;
+        size_t received = this->s->read_some(
+                              this->response.prepare(readSize), e);
+        if (e) {
+            throw ConnectionException("Unable to receive a response.");
+        }
+        this->response.commit(received);
     }
-    */
-    return result;
+    response.append(buffer_cast<const char*>(this->response.data()), size);
+    this->response.consume(size);
+    this->received.resize(response.capacity() + this->response.capacity());
+    TRACE2(transport__receive, size, TRACE_ELAPSED(start));
+    return complete;
 }
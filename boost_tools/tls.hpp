@@ -10,16 +10,45 @@ using namespace boost::asio::ssl;
 using namespace boost::asio::ip;
 
 namespace transport {
-    class TLSTransportLayerProvider : public TransportLayerProvider {
+    /**
+     * TLS Transport Layer Provider on top of Boost.Asio.
+     * Sessions share one io_service and one TLS context; TLS stream is
+     * created on connection and destroyed on disconnection, so provider
+     * which isn't connected holds no socket and no SSL object and can be
+     * reused by the next session. Operations are blocking, so every
+     * session runs on the thread which called it and needs no strand.
+     */
+    class TLSTransportLayerProvider final : public TransportLayerProvider {
         private:
-            io_service i;
+            io_service& i;
             std::shared_ptr<stream<ip::tcp::socket>> s;
+            /**
+             * Received data which wasn't returned yet.
+             */
+            asio::streambuf response;
+
+            /**
+             * TLS context of all sessions. OpenSSL releases read and write
+             * buffers of idle connections.
+             */
+            static context& tlsContext ();
         public:
-            TLSTransportLayerProvider ();
+            /**
+             * Event loop which is shared by sessions by default.
+             */
+            static io_service& sharedService ();
+            /**
+             * Construct.
+             * @param service Event loop of sockets.
+             */
+            TLSTransportLayerProvider (io_service& service = sharedService());
             ~TLSTransportLayerProvider ();
             void connect (string server, string port) throw(TransportException);
             void disconnect () throw(TransportException);
-            string send (string message, string responseEnding = "\r\n")
-                        throw(TransportException);
+            void transmit (const string& message) throw(TransportException);
+            void receiveInto (string& response, const string& responseEnding)
+                             throw(TransportException);
+            bool receiveSome (string& response, const string& responseEnding,
+                              size_t limit) throw(TransportException);
     };
 }
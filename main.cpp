@@ -1,18 +1,25 @@
 #include <iostream>
 #include "utils/task.hpp"
+#include "utils/startup.hpp"
 
 using namespace utils;
 using namespace std;
 
 int main(int argumentsCount, char* arguments[]) {
     int exitCode;
-    string login, password, host, port;
-    exitCode = getCommandLineParameters(argumentsCount, arguments, host, port,
-                                        login, password);
+    Parameters parameters;
+    bool measured = watchStartup();
+    exitCode = getCommandLineParameters(argumentsCount, arguments, parameters);
     if (exitCode != EXIT_SUCCESS) {
         exit(exitCode);
     }
-    exitCode = task(host, port, login, password);
+    if (parameters.startupRuns > 0 && !measured) {
+        exit(benchmarkStartup(arguments, parameters.startupRuns, cout));
+    }
+    exitCode = task(parameters);
+    if (parameters.memoryBudget > 0) {
+        reportMemoryBudget(cerr);
+    }
     if (exitCode != EXIT_SUCCESS) {
         exit(exitCode);
     }
@@ -6,10 +6,12 @@ using namespace boost;
 
 namespace post {
     POP3PostProvider::POP3PostProvider () : PostProvider () {
+        this->capabilitiesReceived = false;
     }
 
     POP3PostProvider::POP3PostProvider (p_TLP transportLayerProvider) :
                                         PostProvider (transportLayerProvider) {
+        this->capabilitiesReceived = false;
     }
 
     POP3PostProvider::~POP3PostProvider () {
@@ -17,25 +19,42 @@ namespace post {
 
 
     bool POP3PostProvider::isResponseOK(string response) throw(PostException) {
-        if (starts_with(response, "+OK")) {
-            return true;
+        return POP3Protocol::isResponseOK(response);
+    }
+
+    bool POP3PostProvider::succeeded (ErrorCode code) throw(PostException) {
+        if (code == INVALID_RESPONSE) {
+            throw InvalidResponseException("status is neither +OK nor -ERR.");
         }
-        else if (starts_with(response, "-ERR")) {
-            return false;
+        if (code == TEMPORARY_FAILURE) {
+            throw TemporaryFailureException();
         }
+        return code == SUCCESS;
     }
 
     void POP3PostProvider::signin (string login, string password)
                                   throw(PostException) {
-        this->sendLogin(login);
-        this->sendPassword(password);
+        this->checkState(LOGIN_REQUIRED);
+        ErrorCode code = POP3Protocol::signin(*this, this->buffer,
+            this->server, this->transportLayerProvider->getGreeting(), login,
+            password, this->capabilities);
+        // PIPELINING announced before authorization is announced after it
+        // too (RFC 2449), otherwise capabilities are requested again
+        this->capabilitiesReceived = POP3Protocol::hasCapability(
+            this->capabilities, "PIPELINING");
+        if (this->succeeded(code)) {
+            this->setState(AUTHORIZED);
+        }
+        else {
+            throw IncorrectAuthorizationDataException();
+        }
     }
 
     void POP3PostProvider::sendLogin (string login) throw(PostException) {
-        string response;
         this->checkState(LOGIN_REQUIRED);
-        response = this->send("USER " + login + "\r\n");
-        if (this->isResponseOK(response)) {
+        ErrorCode code = POP3Protocol::sendLogin(*this, this->buffer,
+                                                 login);
+        if (this->succeeded(code)) {
             this->setState(PASSWORD_REQUIRED);
         }
         else {
@@ -44,10 +63,10 @@ namespace post {
     }
 
     void POP3PostProvider::sendPassword (string password) throw(PostException) {
-        string response;
         this->checkState(PASSWORD_REQUIRED);
-        response = this->send("PASS " + password + "\r\n");
-        if (this->isResponseOK(response)) {
+        ErrorCode code = POP3Protocol::sendPassword(*this, this->buffer,
+                                                    password);
+        if (this->succeeded(code)) {
             this->setState(AUTHORIZED);
         }
         else {
@@ -56,77 +75,318 @@ namespace post {
     }
 
     void POP3PostProvider::signout () throw(PostException) {
-        string response;
         this->checkState(AUTHORIZED);
-        response = this->send("QUIT\r\n");
-        if (this->isResponseOK(response)) {
+        if (this->succeeded(POP3Protocol::signout(*this, this->buffer))) {
             this->setState(LOGIN_REQUIRED);
+            this->capabilitiesReceived = false;
         }
     }
 
     void POP3PostProvider::getEmailsIDs (strings& result)
                                         throw(PostException) {
-        string response;
-        result.clear();
+        vector<size_t> sizes;
+        this->getEmailsIDs(result, sizes);
+    }
+
+    void POP3PostProvider::getEmailsIDs (strings& result,
+                                         vector<size_t>& sizes)
+                                        throw(PostException) {
         this->checkState(AUTHORIZED);
-        /**
-         * Get raw list of emails from server.
-         */
-        response = this->send("LIST\r\n", "\r\n.\r\n");
-        if (!this->isResponseOK(response)) {
-            throw ConnectionException("Server responsed negatively. "
-                                      "Reason's unknown.");
-        }
-        strings emailInfo;
-        int emailsCount;
-        try {
-            trim(response);
-            split(emailInfo, response, is_any_of(" "), token_compress_on);
-            emailsCount = stoi(emailInfo[1]);
-        }
-        catch (invalid_argument) {
-            throw ConnectionException("Server response was strange: "
-                                      "can't get emails count.");
-        }
-        catch (out_of_range) {
-            throw ConnectionException("Server response was strange: "
-                                      "you have a huge number of emails.");
-        }
-        /**
-         * Prepare list of emails' IDs.
-         */
-        strings emailsList;
-        split(emailsList, response, is_any_of("\r\n"), token_compress_on);
-        emailsList.erase(emailsList.begin());
-        emailsList.pop_back();
-        string currentHeader;
-        for (string email : emailsList) {
-            trim(email);
-            split(emailInfo, email, is_any_of(" "), token_compress_on);
-            result.push_back(emailInfo[0]);
+        ErrorCode code = POP3Protocol::list(*this, this->buffer,
+                                            result, sizes);
+        if (!this->succeeded(code)) {
+            throw ConnectionError("Server responsed negatively. "
+                                  "Reason's unknown.");
+        }
+    }
+
+    void POP3PostProvider::getEmailsUIDs (unordered_map<string, string>& result)
+                                         throw(PostException) {
+        this->checkState(AUTHORIZED);
+        ErrorCode code = POP3Protocol::uidl(*this, this->buffer, result);
+        if (!this->succeeded(code)) {
+            throw ConnectionError("Server doesn't support UIDL.");
+        }
+    }
+
+    bool POP3PostProvider::isPipeliningSupported () throw(PostException) {
+        if (!this->capabilitiesReceived) {
+            this->capabilities.clear();
+            this->transmit("CAPA\r\n");
+            string response = this->receiveResponse(true);
+            if (this->isResponseOK(response)) {
+                split(this->capabilities, response, is_any_of("\r\n"),
+                      token_compress_on);
+            }
+            this->capabilitiesReceived = true;
+        }
+        for (const string& capability : this->capabilities) {
+            if (iequals(capability, "PIPELINING")) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    string POP3PostProvider::receiveResponse (bool multiline)
+                                             throw(PostException) {
+        return POP3Protocol::receiveResponse(*this, multiline);
+    }
+
+    strings POP3PostProvider::pipeline (const strings& commands,
+                                        bool multiline)
+                                       throw(PostException) {
+        strings responses;
+        MemoryCharge queued;
+        bool pipelining = this->isPipeliningSupported();
+        size_t depth;
+        for (size_t start = 0; start < commands.size(); start += depth) {
+            // Window shrinks when memory budget is running out
+            depth = pipelining ?
+                    MemoryBudget::global().window(this->pipelineDepth) : 1;
+            size_t end = min(commands.size(), start + depth);
+            string batch;
+            for (size_t i = start; i < end; ++i) {
+                batch += commands[i];
+            }
+            this->transmit(batch);
+            for (size_t i = start; i < end; ++i) {
+                responses.push_back(this->receiveResponse(multiline));
+                queued.grow(responses.back().capacity());
+            }
+        }
+        return responses;
+    }
+
+    void POP3PostProvider::deleteLetters (const RetentionPolicy& policy,
+                                          RetentionReport& report)
+                                         throw(PostException) {
+        strings emailsIDs;
+        vector<size_t> sizes;
+        report.deleted = report.octets = 0;
+        this->checkState(AUTHORIZED);
+
+        this->getEmailsIDs(emailsIDs, sizes);
+        vector<bool> selected(emailsIDs.size(), true);
+        if (policy.minSize > 0) {
+            for (size_t i = 0; i < emailsIDs.size(); ++i) {
+                selected[i] = sizes[i] > policy.minSize;
+            }
+        }
+        if (policy.byUIDs) {
+            unordered_map<string, string> uids;
+            this->getEmailsUIDs(uids);
+            for (size_t i = 0; i < emailsIDs.size(); ++i) {
+                selected[i] = selected[i] &&
+                              policy.uids.count(uids[emailsIDs[i]]) > 0;
+            }
+        }
+        if (policy.maxAge > 0) {
+            // Age is known only from Date field: get headers of candidates
+            strings commands;
+            vector<size_t> candidates;
+            for (size_t i = 0; i < emailsIDs.size(); ++i) {
+                if (selected[i]) {
+                    commands.push_back("TOP " + emailsIDs[i] + " 0\r\n");
+                    candidates.push_back(i);
+                }
+            }
+            strings headers = this->pipeline(commands, true);
+            time_t now = time(NULL), date;
+            for (size_t i = 0; i < candidates.size(); ++i) {
+                // Messages with unknown age are kept
+                selected[candidates[i]] = this->isResponseOK(headers[i]) &&
+                    parseDate(getHeaderParameter(headers[i], "Date"), date) &&
+                    now - date > policy.maxAge;
+            }
+        }
+
+        strings commands;
+        vector<size_t> chosen;
+        for (size_t i = 0; i < emailsIDs.size(); ++i) {
+            if (selected[i]) {
+                commands.push_back("DELE " + emailsIDs[i] + "\r\n");
+                chosen.push_back(i);
+            }
+        }
+        if (policy.dryRun) {
+            for (size_t i : chosen) {
+                ++report.deleted;
+                report.octets += sizes[i];
+            }
+            return;
+        }
+        strings responses = this->pipeline(commands, false);
+        for (size_t i = 0; i < chosen.size(); ++i) {
+            if (this->isResponseOK(responses[i])) {
+                ++report.deleted;
+                report.octets += sizes[chosen[i]];
+            }
         }
     }
 
     void POP3PostProvider::getLettersHeaders (strings& headers)
                                         throw(PostException) {
         strings emailsIDs;
-        string response;
         headers.clear();
+        this->stored.resize(0);
+
+        this->checkState(AUTHORIZED);
+
+        this->getEmailsIDs(emailsIDs);
+        this->getHeaders(emailsIDs,
+                         [this, &headers] (const string&,
+                                           const string& header) {
+            headers.push_back(header);
+            this->stored.grow(headers.back().capacity());
+        });
+    }
+
+    void POP3PostProvider::getLettersHeaders (const HeaderHandler& handler,
+                                        const unordered_set<string>& skipUIDs)
+                                        throw(PostException) {
+        strings emailsIDs, selectedIDs;
+        unordered_map<string, string> uids;
 
         this->checkState(AUTHORIZED);
 
         this->getEmailsIDs(emailsIDs);
+        this->getEmailsUIDs(uids);
+        for (const string& emailID : emailsIDs) {
+            if (!skipUIDs.count(uids[emailID])) {
+                selectedIDs.push_back(emailID);
+            }
+        }
+        this->getHeaders(selectedIDs,
+                         [&] (const string& id, const string& header) {
+            handler(uids[id], header);
+        });
+    }
+
+    void POP3PostProvider::getRecentLettersHeaders (strings& headers,
+                                                    size_t count, time_t since)
+                                                   throw(PostException) {
+        size_t total, octets;
+        headers.clear();
+        this->stored.resize(0);
+
+        this->checkState(AUTHORIZED);
+
+        // Message numbers are 1..total in order of arrival, so STAT is
+        // enough to address the newest ones without LIST
+        this->getMailboxStat(total, octets);
+        count = min(count, total);
+        bool pipelining = this->isPipeliningSupported();
+        // Headers are requested in batches, so with cutoff at most one
+        // batch is read in vain
+        for (size_t done = 0; done < count; ) {
+            size_t depth = pipelining ?
+                MemoryBudget::global().window(this->pipelineDepth) : 1;
+            strings commands;
+            for (size_t i = done; i < min(count, done + depth); ++i) {
+                commands.push_back("TOP " + to_string(total - i) + " 0\r\n");
+            }
+            strings responses = this->pipeline(commands, true);
+            for (const string& header : responses) {
+                ++done;
+                if (!this->isResponseOK(header)) {
+                    throw ConnectionError("Can't get message " +
+                                          to_string(total - done + 1) + ".");
+                }
+                time_t date;
+                // Letters without valid date don't stop reading
+                if (since > 0 &&
+                    parseDate(getHeaderParameter(header, "Date"), date) &&
+                    date < since) {
+                    return;
+                }
+                if (this->isHeaderAccepted(header)) {
+                    headers.push_back(header);
+                    this->stored.grow(headers.back().capacity());
+                }
+            }
+        }
+    }
+
+    void POP3PostProvider::getLettersIDs (strings& ids, vector<size_t>& sizes)
+                                         throw(PostException) {
+        this->getEmailsIDs(ids, sizes);
+    }
+
+    void POP3PostProvider::getLettersUIDs (unordered_map<string, string>& uids)
+                                          throw(PostException) {
+        this->getEmailsUIDs(uids);
+    }
+
+    void POP3PostProvider::getMailboxStat (size_t& count, size_t& octets)
+                                          throw(PostException) {
+        this->checkState(AUTHORIZED);
+        ErrorCode code = POP3Protocol::stat(*this, this->buffer, count,
+                                            octets);
+        if (!this->succeeded(code)) {
+            throw ConnectionError("Server responsed negatively to STAT.");
+        }
+    }
+
+    void POP3PostProvider::getLetterUID (const string& id, string& uid)
+                                        throw(PostException) {
+        this->checkState(AUTHORIZED);
+        ErrorCode code = POP3Protocol::uidl(*this, this->buffer, id, uid);
+        if (!this->succeeded(code)) {
+            throw ConnectionError("Can't get unique ID of message " + id +
+                                  ".");
+        }
+    }
+
+    void POP3PostProvider::getLetterHeader (const string& id, string& header)
+                                           throw(PostException) {
+        this->checkState(AUTHORIZED);
+        ErrorCode code = POP3Protocol::top(*this, this->buffer,
+                                           id, header);
+        if (!this->succeeded(code)) {
+            throw ConnectionError("Can't get header of message " + id + ".");
+        }
+    }
+
+    void POP3PostProvider::getLetter (const string& id, string& letter)
+                                     throw(PostException) {
+        this->checkState(AUTHORIZED);
+        ErrorCode code = POP3Protocol::retr(*this, this->buffer,
+                                            id, letter);
+        if (!this->succeeded(code)) {
+            throw ConnectionError("Can't get message " + id + ".");
+        }
+    }
+
+    void POP3PostProvider::getLetter (const string& id,
+                                      const LetterHandler& handler)
+                                     throw(PostException) {
+        this->checkState(AUTHORIZED);
+        ErrorCode code = POP3Protocol::retr(*this, this->buffer, id,
+                                            handler);
+        if (!this->succeeded(code)) {
+            throw ConnectionError("Can't get message " + id + ".");
+        }
+    }
+
+    void POP3PostProvider::getHeaders (const strings& emailsIDs,
+                                       const HeaderHandler& handler)
+                                      throw(PostException) {
         string currentHeader;
-        for (string emailID : emailsIDs) {
-            currentHeader = this->send("TOP " + emailID + " 0\r\n",
-                                       "\r\n.\r\n");
-            if (!isResponseOK(currentHeader)) {
+        for (const string& emailID : emailsIDs) {
+            TRACE_CLOCK(pop3__header, start);
+            ErrorCode code = POP3Protocol::top(*this, this->buffer, emailID,
+                                               currentHeader);
+            if (!this->succeeded(code)) {
                 string message = "Can't get message " + emailID + ". "
                                  "Maybe connection was lost?";
-                throw ConnectionException(message);
+                throw ConnectionError(message);
             }
-            else {
-                headers.push_back(currentHeader);
+            bool accepted = this->isHeaderAccepted(currentHeader);
+            TRACE4(pop3__header, atol(emailID.c_str()), currentHeader.size(),
+                   (int) accepted, TRACE_ELAPSED(start));
+            if (accepted) {
+                handler(emailID, currentHeader);
             }
         }
     }
@@ -1,6 +1,8 @@
 #pragma once
 #include "../ac_includes.hpp"
+#include "pop3_protocol.hpp"
 #include <exception>
+#include <unordered_map>
 
 using namespace transport;
 
@@ -10,15 +12,91 @@ namespace post {
      * Post Provider for POP3 protocol.
      */
     class POP3PostProvider : public post::PostProvider {
+        friend struct POP3Protocol;
         private:
             /**
              * Get IDs of emails to access them in future.
              * @param result Strings array reference, which will contain IDs.
              * @throws IncorrectStateException Thrown if state is not
              * AUTHORIZED.
-             * @throws ConnectionException Thrown if server respond is strange.
+             * @throws ConnectionError Thrown if server respond is strange.
              */
             void getEmailsIDs (strings& result) throw(PostException);
+            /**
+             * Get IDs of emails and their sizes.
+             * @param result Strings array reference, which will contain IDs.
+             * @param sizes Reference to vector which will contain sizes
+             * of emails in octets.
+             * @throws IncorrectStateException Thrown if state is not
+             * AUTHORIZED.
+             * @throws ConnectionError Thrown if server respond is strange.
+             */
+            void getEmailsIDs (strings& result, vector<size_t>& sizes)
+                              throw(PostException);
+            /**
+             * Get unique IDs of emails (UIDL).
+             * @param result Map reference to write ID -> UID pairs to it.
+             * @throws IncorrectStateException Thrown if state is not
+             * AUTHORIZED.
+             * @throws ConnectionError Thrown if server doesn't support
+             * UIDL.
+             */
+            void getEmailsUIDs (unordered_map<string, string>& result)
+                               throw(PostException);
+            /**
+             * Download headers of emails with TOP.
+             * @param emailsIDs IDs of emails.
+             * @param handler Function which is called with ID and header
+             * of every email which passed header filter.
+             * @throws ConnectionError Thrown if header can't be
+             * received.
+             */
+            void getHeaders (const strings& emailsIDs,
+                             const HeaderHandler& handler)
+                            throw(PostException);
+            /**
+             * Capabilities announced by server (CAPA): ones which were
+             * announced before authorization or, if they didn't include
+             * PIPELINING, ones requested after it.
+             */
+            strings capabilities;
+            bool capabilitiesReceived;
+            /**
+             * Command buffer of POP3 Protocol which is reused by commands.
+             */
+            string buffer;
+            /**
+             * Check whether server announced PIPELINING capability.
+             */
+            bool isPipeliningSupported () throw(PostException);
+            /**
+             * Receive one response.
+             * @param multiline Set `true' if positive response is multi-line
+             * (terminated with a line which contains only dot).
+             * @return Returns full response including status line.
+             */
+            string receiveResponse (bool multiline) throw(PostException);
+            /**
+             * Send commands and receive their responses. If server supports
+             * pipelining, commands are sent in batches of `pipelineDepth'
+             * commands per write, otherwise one by one.
+             * @param commands Commands with line endings.
+             * @param multiline Set `true' if positive responses are
+             * multi-line.
+             * @return Returns responses in order of commands.
+             */
+            strings pipeline (const strings& commands, bool multiline)
+                             throw(PostException);
+            /**
+             * Convert status of POP3 Protocol command.
+             * @param code Status returned by POP3 Protocol.
+             * @return Returns `true' if command succeeded and `false' if
+             * server responsed negatively.
+             * @throws InvalidResponseException Thrown if server response
+             * wasn't recognised.
+             * @throws TemporaryFailureException Thrown if server is busy.
+             */
+            bool succeeded (ErrorCode code) throw(PostException);
         protected:
             /**
              * Checks wether mail server response is OK or ERR.
@@ -44,5 +122,26 @@ namespace post {
             void sendPassword (string password) throw(PostException);
             void signout () throw(PostException);
             void getLettersHeaders (strings& headers) throw(PostException);
+            void getLettersHeaders (const HeaderHandler& handler,
+                                    const unordered_set<string>& skipUIDs)
+                                   throw(PostException);
+            void getRecentLettersHeaders (strings& headers, size_t count,
+                                          time_t since) throw(PostException);
+            void deleteLetters (const RetentionPolicy& policy,
+                                RetentionReport& report) throw(PostException);
+            void getLettersIDs (strings& ids, vector<size_t>& sizes)
+                               throw(PostException);
+            void getLettersUIDs (unordered_map<string, string>& uids)
+                                throw(PostException);
+            void getMailboxStat (size_t& count, size_t& octets)
+                                throw(PostException);
+            void getLetterUID (const string& id, string& uid)
+                              throw(PostException);
+            void getLetterHeader (const string& id, string& header)
+                                 throw(PostException);
+            void getLetter (const string& id, string& letter)
+                           throw(PostException);
+            void getLetter (const string& id, const LetterHandler& handler)
+                           throw(PostException);
     };
 }
@@ -0,0 +1,640 @@
+#pragma once
+#include "../ac_includes.hpp"
+#include "../abstract_client/Trace.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <unordered_map>
+#include <openssl/evp.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+namespace post {
+
+    /**
+     * POP3 commands and responses independent of the way they're delivered.
+     * Channel is anything with `transmit(message)' and
+     * `receiveInto(response, responseEnding)': Transport Layer Provider or
+     * Post Provider which wraps it. If channel class is final (or held by
+     * value), calls are resolved at compile time and command formatting
+     * together with response classification is inlined into the I/O loop.
+     * Negative and unrecognised responses are reported by error codes
+     * without throwing; callers decide how to report them. Only transport
+     * errors are thrown.
+     * Commands are formatted in `buffer' which belongs to the session and
+     * responses are received into strings of the caller, so once their
+     * capacity is grown, steady-state commands don't allocate.
+     */
+    struct POP3Protocol {
+        /**
+         * Check whether negative response has extended response code
+         * (RFC 2449) which means that server is busy rather than that
+         * command is wrong: `IN-USE', `LOGIN-DELAY' or `SYS/TEMP'
+         * (RFC 3206).
+         * @param response Response which starts with "-ERR".
+         */
+        static bool isTemporaryFailure (const string& response) {
+            // Code is in brackets right after status and space
+            if (response.size() < 6 || response[5] != '[') {
+                return false;
+            }
+            const char* code = response.c_str() + 6;
+            return strncmp(code, "IN-USE]", 7) == 0 ||
+                   strncmp(code, "LOGIN-DELAY]", 12) == 0 ||
+                   strncmp(code, "SYS/TEMP", 8) == 0;
+        }
+
+        /**
+         * Classify server response by its status.
+         * @param response Response to check.
+         * @return Returns SUCCESS for "+OK", TEMPORARY_FAILURE for "-ERR"
+         * with code of busy server (see `isTemporaryFailure'),
+         * NEGATIVE_RESPONSE for other "-ERR" and INVALID_RESPONSE
+         * otherwise.
+         */
+        static ErrorCode classify (const string& response) {
+            if (boost::starts_with(response, "+OK")) {
+                return SUCCESS;
+            }
+            else if (boost::starts_with(response, "-ERR")) {
+                return isTemporaryFailure(response) ? TEMPORARY_FAILURE :
+                                                      NEGATIVE_RESPONSE;
+            }
+            return INVALID_RESPONSE;
+        }
+
+        /**
+         * Checks wether mail server response is OK or ERR.
+         * @param response Response to check.
+         * @return Returns `true' if server answered "+OK" and `false'
+         * if server answered "-ERR".
+         * @throws InvalidResponseException Thrown if server response
+         * wasn't recognised as OK neither ERR.
+         * @throws TemporaryFailureException Thrown if server is busy.
+         */
+        static bool isResponseOK (const string& response)
+                                 throw(PostException) {
+            ErrorCode code = classify(response);
+            if (code == INVALID_RESPONSE) {
+                throw InvalidResponseException(response);
+            }
+            if (code == TEMPORARY_FAILURE) {
+                throw TemporaryFailureException();
+            }
+            return code == SUCCESS;
+        }
+
+        /**
+         * Format command in the buffer: `prefix', `argument' and `suffix'
+         * are concatenated without separators.
+         * @param buffer Buffer to write command to.
+         * @return Returns the buffer.
+         */
+        static const string& format (string& buffer, const char* prefix,
+                                     const string& argument = string(),
+                                     const char* suffix = "\r\n") {
+            buffer.assign(prefix);
+            buffer.append(argument);
+            buffer.append(suffix);
+            return buffer;
+        }
+
+        /**
+         * Receive one response.
+         * @param multiline Set `true' if positive response is multi-line
+         * (terminated with a line which contains only dot).
+         * @param response Reference to write full response (including
+         * status line) to it.
+         * @return Returns status of response (see `classify').
+         */
+        template <class Channel>
+        static ErrorCode receiveResponse (Channel& channel, bool multiline,
+                                          string& response) {
+            response.clear();
+            channel.receiveInto(response, "\r\n");
+            ErrorCode code = classify(response);
+            if (!multiline || code != SUCCESS) {
+                return code;
+            }
+            // Dot may end a line inside the body: read until the line with
+            // single dot. Status line ends with CRLF, so the terminator
+            // is always preceded by CRLF
+            do {
+                channel.receiveInto(response, ".\r\n");
+            } while (!boost::ends_with(response, "\r\n.\r\n"));
+            return code;
+        }
+
+        /**
+         * Receive one response.
+         * @param multiline Set `true' if positive response is multi-line.
+         * @return Returns full response including status line.
+         */
+        template <class Channel>
+        static string receiveResponse (Channel& channel, bool multiline) {
+            string response;
+            receiveResponse(channel, multiline, response);
+            return response;
+        }
+
+        /**
+         * Send command and receive its response.
+         * @param command Command with line ending.
+         * @param multiline Set `true' if positive response is multi-line.
+         * @param response Reference to write full response to it. It may
+         * be the same string as command.
+         * @return Returns status of response (see `classify').
+         */
+        template <class Channel>
+        static ErrorCode execute (Channel& channel, const string& command,
+                                  bool multiline, string& response) {
+#ifdef POP3_TRACE
+            // Only command name is traced: argument may be password, and
+            // command is overwritten if it's the response string
+            char name[8] = "";
+            size_t length = 0;
+            if (TRACE_ENABLED(pop3__command)) {
+                length = min(command.find_first_of(" \r"), sizeof(name) - 1);
+                command.copy(name, length);
+            }
+            TRACE_CLOCK(pop3__command, start);
+#endif
+            channel.transmit(command);
+            ErrorCode code = receiveResponse(channel, multiline, response);
+            TRACE5(pop3__command, name, length, (int) code, response.size(),
+                   TRACE_ELAPSED(start));
+            return code;
+        }
+
+        template <class Channel>
+        static ErrorCode sendLogin (Channel& channel, string& buffer,
+                                    const string& login) {
+            return execute(channel, format(buffer, "USER ", login), false,
+                           buffer);
+        }
+
+        template <class Channel>
+        static ErrorCode sendPassword (Channel& channel, string& buffer,
+                                       const string& password) {
+            return execute(channel, format(buffer, "PASS ", password), false,
+                           buffer);
+        }
+
+        /**
+         * Get capabilities of server (CAPA, RFC 2449).
+         * @param capabilities Reference to write capability lines to it.
+         * @return Returns NEGATIVE_RESPONSE if server doesn't support CAPA.
+         */
+        template <class Channel>
+        static ErrorCode capa (Channel& channel, string& buffer,
+                               strings& capabilities) {
+            capabilities.clear();
+            ErrorCode code = execute(channel, format(buffer, "CAPA"), true,
+                                     buffer);
+            if (code != SUCCESS) {
+                return code;
+            }
+            strings lines;
+            boost::split(lines, buffer, boost::is_any_of("\r\n"),
+                         boost::token_compress_on);
+            for (size_t i = 1; i < lines.size() && lines[i] != "."; ++i) {
+                capabilities.push_back(lines[i]);
+            }
+            return SUCCESS;
+        }
+
+        /**
+         * Check whether capability is announced.
+         * @param capabilities Capability lines (see `capa').
+         * @param name Capability name, e.g. `PIPELINING'.
+         * @param argument Argument which should follow the name, e.g.
+         * `PLAIN' for `SASL' (NULL if any arguments fit).
+         */
+        static bool hasCapability (const strings& capabilities,
+                                   const char* name,
+                                   const char* argument = NULL) {
+            for (const string& capability : capabilities) {
+                strings words;
+                boost::split(words, capability, boost::is_any_of(" "),
+                             boost::token_compress_on);
+                if (!boost::iequals(words[0], name)) {
+                    continue;
+                }
+                if (argument == NULL) {
+                    return true;
+                }
+                for (size_t i = 1; i < words.size(); ++i) {
+                    if (boost::iequals(words[i], argument)) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Capabilities which servers announced before authorization,
+         * shared by all sessions of process: the next session to the same
+         * server doesn't send CAPA before signing in. Only non-empty
+         * responses are kept and only for `lifetime' seconds, so a failed
+         * CAPA or a server which was reconfigured isn't remembered for
+         * the whole run.
+         */
+        class CapabilityCache {
+            private:
+                struct Entry {
+                    strings capabilities;
+                    time_t stored;
+                };
+                mutex lock;
+                unordered_map<string, Entry> known;
+            public:
+                static const time_t lifetime = 600;
+
+                /**
+                 * Get capabilities of server.
+                 * @param server Server as `host:port'.
+                 * @param capabilities Reference to write capabilities to
+                 * it.
+                 * @return Returns `false' if they are unknown or expired.
+                 */
+                bool find (const string& server, strings& capabilities) {
+                    lock_guard<mutex> guard(this->lock);
+                    auto found = this->known.find(server);
+                    if (found == this->known.end()) {
+                        return false;
+                    }
+                    if (time(NULL) - found->second.stored >= lifetime) {
+                        this->known.erase(found);
+                        return false;
+                    }
+                    capabilities = found->second.capabilities;
+                    return true;
+                }
+
+                void store (const string& server,
+                            const strings& capabilities) {
+                    if (capabilities.empty()) {
+                        return;
+                    }
+                    lock_guard<mutex> guard(this->lock);
+                    Entry& entry = this->known[server];
+                    entry.capabilities = capabilities;
+                    entry.stored = time(NULL);
+                }
+
+                void forget (const string& server) {
+                    lock_guard<mutex> guard(this->lock);
+                    this->known.erase(server);
+                }
+        };
+
+        static CapabilityCache& serverCapabilities () {
+            static CapabilityCache cache;
+            return cache;
+        }
+
+        /**
+         * Sign in with USER and PASS sent in one packet: both responses
+         * are read even if USER failed, so the session stays in sync.
+         * Server should support pipelining.
+         * @return Returns status of the first failed command.
+         */
+        template <class Channel>
+        static ErrorCode sendLoginAndPassword (Channel& channel,
+                                               string& buffer,
+                                               const string& login,
+                                               const string& password) {
+            format(buffer, "USER ", login);
+            buffer.append("PASS ");
+            buffer.append(password);
+            buffer.append("\r\n");
+            channel.transmit(buffer);
+            ErrorCode code = receiveResponse(channel, false, buffer);
+            ErrorCode passwordCode = receiveResponse(channel, false, buffer);
+            return code != SUCCESS ? code : passwordCode;
+        }
+
+        /**
+         * Sign in with SASL PLAIN mechanism and initial response
+         * (RFC 5034).
+         */
+        template <class Channel>
+        static ErrorCode authPlain (Channel& channel, string& buffer,
+                                    const string& login,
+                                    const string& password) {
+            static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                           "abcdefghijklmnopqrstuvwxyz"
+                                           "0123456789+/";
+            // Authorization identity is empty: it's derived from login
+            string credentials = string(1, '\0') + login + '\0' + password;
+            format(buffer, "AUTH PLAIN ", string(), "");
+            for (size_t i = 0; i < credentials.size(); i += 3) {
+                size_t rest = credentials.size() - i;
+                unsigned bits = (unsigned char) credentials[i] << 16;
+                if (rest > 1) {
+                    bits |= (unsigned char) credentials[i + 1] << 8;
+                }
+                if (rest > 2) {
+                    bits |= (unsigned char) credentials[i + 2];
+                }
+                buffer += alphabet[bits >> 18];
+                buffer += alphabet[(bits >> 12) & 63];
+                buffer += rest > 1 ? alphabet[(bits >> 6) & 63] : '=';
+                buffer += rest > 2 ? alphabet[bits & 63] : '=';
+            }
+            buffer.append("\r\n");
+            return execute(channel, buffer, false, buffer);
+        }
+
+        /**
+         * Get timestamp of APOP from server greeting.
+         * @param greeting Greeting line.
+         * @return Returns `<...>' part of greeting or empty string if
+         * server didn't send it.
+         */
+        static string getTimestamp (const string& greeting) {
+            size_t start = greeting.find('<');
+            size_t end = start == string::npos ? start :
+                         greeting.find('>', start);
+            if (end == string::npos ||
+                greeting.find('@', start) > end) {
+                return "";
+            }
+            return greeting.substr(start, end - start + 1);
+        }
+
+        /**
+         * Sign in with APOP: MD5 digest of greeting timestamp and
+         * password is sent instead of password (RFC 1939).
+         * @param timestamp Timestamp from greeting (see `getTimestamp').
+         */
+        template <class Channel>
+        static ErrorCode apop (Channel& channel, string& buffer,
+                               const string& login, const string& timestamp,
+                               const string& password) {
+            static const char digits[] = "0123456789abcdef";
+            string secret = timestamp + password;
+            unsigned char digest[EVP_MAX_MD_SIZE];
+            unsigned size = 0;
+            EVP_Digest(secret.data(), secret.size(), digest, &size,
+                       EVP_md5(), NULL);
+            format(buffer, "APOP ", login, " ");
+            for (unsigned i = 0; i < size; ++i) {
+                buffer += digits[digest[i] >> 4];
+                buffer += digits[digest[i] & 15];
+            }
+            buffer.append("\r\n");
+            return execute(channel, buffer, false, buffer);
+        }
+
+        /**
+         * Sign in with one round trip when server allows it: SASL PLAIN
+         * with initial response, else USER and PASS in one packet if
+         * server supports pipelining, else APOP if greeting has
+         * timestamp. USER and PASS one by one are the last resort (and
+         * the fallback if APOP was refused: server may have no APOP
+         * secrets). Capabilities are requested only for the first session
+         * to server (see `CapabilityCache'); they are requested again after
+         * credentials were refused.
+         * @param server Server as `host:port'.
+         * @param greeting Greeting of server.
+         * @param capabilities Reference to write capabilities which server
+         * announced before authorization to it.
+         * @return Returns NEGATIVE_RESPONSE if credentials were refused.
+         */
+        template <class Channel>
+        static ErrorCode signin (Channel& channel, string& buffer,
+                                 const string& server,
+                                 const string& greeting,
+                                 const string& login,
+                                 const string& password,
+                                 strings& capabilities) {
+            if (!serverCapabilities().find(server, capabilities)) {
+                ErrorCode code = capa(channel, buffer, capabilities);
+                if (code == INVALID_RESPONSE || code == TEMPORARY_FAILURE) {
+                    return code;
+                }
+                // Server without CAPA has no capabilities
+                if (code == SUCCESS) {
+                    serverCapabilities().store(server, capabilities);
+                }
+            }
+            ErrorCode code = signinWith(channel, buffer, greeting, login,
+                                        password, capabilities);
+            if (code == NEGATIVE_RESPONSE) {
+                // Method may be chosen by capabilities which are outdated
+                serverCapabilities().forget(server);
+            }
+            return code;
+        }
+
+        /**
+         * Sign in with the best method of `signin' for capabilities.
+         */
+        template <class Channel>
+        static ErrorCode signinWith (Channel& channel, string& buffer,
+                                     const string& greeting,
+                                     const string& login,
+                                     const string& password,
+                                     const strings& capabilities) {
+            if (hasCapability(capabilities, "SASL", "PLAIN")) {
+                return authPlain(channel, buffer, login, password);
+            }
+            if (hasCapability(capabilities, "PIPELINING")) {
+                return sendLoginAndPassword(channel, buffer, login,
+                                            password);
+            }
+            string timestamp = getTimestamp(greeting);
+            if (!timestamp.empty()) {
+                ErrorCode code = apop(channel, buffer, login, timestamp,
+                                      password);
+                if (code != NEGATIVE_RESPONSE) {
+                    return code;
+                }
+            }
+            ErrorCode code = sendLogin(channel, buffer, login);
+            if (code != SUCCESS) {
+                return code;
+            }
+            return sendPassword(channel, buffer, password);
+        }
+
+        template <class Channel>
+        static ErrorCode signout (Channel& channel, string& buffer) {
+            return execute(channel, format(buffer, "QUIT"), false, buffer);
+        }
+
+        /**
+         * Get number of emails and their total size (STAT).
+         * @return Returns status of STAT response.
+         */
+        template <class Channel>
+        static ErrorCode stat (Channel& channel, string& buffer,
+                               size_t& count, size_t& octets) {
+            count = octets = 0;
+            ErrorCode code = execute(channel, format(buffer, "STAT"), false,
+                                     buffer);
+            if (code != SUCCESS) {
+                return code;
+            }
+            // "+OK count octets"
+            char* end;
+            count = strtoul(buffer.c_str() + 3, &end, 10);
+            octets = strtoul(end, NULL, 10);
+            return SUCCESS;
+        }
+
+        /**
+         * Get IDs of emails and their sizes (LIST).
+         * @return Returns status of LIST response.
+         */
+        template <class Channel>
+        static ErrorCode list (Channel& channel, string& buffer, strings& ids,
+                               vector<size_t>& sizes) {
+            ids.clear();
+            sizes.clear();
+            ErrorCode code = execute(channel, format(buffer, "LIST"), true,
+                                     buffer);
+            if (code != SUCCESS) {
+                return code;
+            }
+            strings lines, emailInfo;
+            boost::split(lines, buffer, boost::is_any_of("\r\n"),
+                         boost::token_compress_on);
+            // Skip status line and stop at terminating dot
+            for (size_t i = 1; i < lines.size() && lines[i] != "."; ++i) {
+                boost::trim(lines[i]);
+                boost::split(emailInfo, lines[i], boost::is_any_of(" "),
+                             boost::token_compress_on);
+                ids.push_back(emailInfo[0]);
+                sizes.push_back(emailInfo.size() > 1 ?
+                    strtoul(emailInfo[1].c_str(), NULL, 10) : 0);
+            }
+            return SUCCESS;
+        }
+
+        /**
+         * Get unique IDs of emails (UIDL).
+         * @return Returns NEGATIVE_RESPONSE if server doesn't support UIDL.
+         */
+        template <class Channel>
+        static ErrorCode uidl (Channel& channel, string& buffer,
+                               unordered_map<string, string>& uids) {
+            uids.clear();
+            ErrorCode code = execute(channel, format(buffer, "UIDL"), true,
+                                     buffer);
+            if (code != SUCCESS) {
+                return code;
+            }
+            strings lines, emailInfo;
+            boost::split(lines, buffer, boost::is_any_of("\r\n"),
+                         boost::token_compress_on);
+            for (size_t i = 1; i < lines.size() && lines[i] != "."; ++i) {
+                boost::trim(lines[i]);
+                boost::split(emailInfo, lines[i], boost::is_any_of(" "),
+                             boost::token_compress_on);
+                if (emailInfo.size() > 1) {
+                    uids[emailInfo[0]] = emailInfo[1];
+                }
+            }
+            return SUCCESS;
+        }
+
+        /**
+         * Get unique ID of one email (UIDL with argument).
+         * @return Returns NEGATIVE_RESPONSE if there is no such email or
+         * server doesn't support UIDL.
+         */
+        template <class Channel>
+        static ErrorCode uidl (Channel& channel, string& buffer,
+                               const string& id, string& uid) {
+            uid.clear();
+            ErrorCode code = execute(channel, format(buffer, "UIDL ", id),
+                                     false, buffer);
+            if (code != SUCCESS) {
+                return code;
+            }
+            // "+OK id uid"
+            strings fields;
+            boost::trim(buffer);
+            boost::split(fields, buffer, boost::is_any_of(" "),
+                         boost::token_compress_on);
+            if (fields.size() < 3) {
+                return INVALID_RESPONSE;
+            }
+            uid = fields[2];
+            return SUCCESS;
+        }
+
+        /**
+         * Get header of email (TOP with no body lines).
+         * @return Returns NEGATIVE_RESPONSE if there is no such email.
+         */
+        template <class Channel>
+        static ErrorCode top (Channel& channel, string& buffer,
+                              const string& id, string& header) {
+            return execute(channel, format(buffer, "TOP ", id, " 0\r\n"),
+                           true, header);
+        }
+
+        /**
+         * Get whole email (RETR).
+         * @return Returns NEGATIVE_RESPONSE if there is no such email.
+         */
+        template <class Channel>
+        static ErrorCode retr (Channel& channel, string& buffer,
+                               const string& id, string& letter) {
+            return execute(channel, format(buffer, "RETR ", id), true,
+                           letter);
+        }
+
+        /**
+         * Get whole email (RETR) and pass it to handler line by line, so
+         * only one piece of it is in memory. Lines are unstuffed and
+         * passed with their endings; line longer than 64 KiB is passed in
+         * pieces.
+         * @param handler Function which is called with data and size of
+         * every piece.
+         * @return Returns NEGATIVE_RESPONSE if there is no such email.
+         */
+        template <class Channel, class Handler>
+        static ErrorCode retr (Channel& channel, string& buffer,
+                               const string& id, const Handler& handler) {
+            static const size_t pieceSize = 64 << 10;
+            ErrorCode code = execute(channel, format(buffer, "RETR ", id),
+                                     false, buffer);
+            if (code != SUCCESS) {
+                return code;
+            }
+            buffer.clear();
+            size_t start = 0;
+            bool lineStart = true;
+            for (;;) {
+                size_t end = buffer.find('\n', start);
+                if (end == string::npos &&
+                    buffer.size() - start < pieceSize) {
+                    // Only the incomplete line is kept between reads
+                    buffer.erase(0, start);
+                    start = 0;
+                    channel.receiveSome(buffer, ".\r\n", pieceSize);
+                    continue;
+                }
+                end = end == string::npos ? start + pieceSize : end + 1;
+                const char* piece = buffer.data() + start;
+                size_t size = end - start;
+                if (lineStart && piece[0] == '.') {
+                    if (size == 3 && piece[1] == '\r' && piece[2] == '\n') {
+                        return code;
+                    }
+                    ++piece;
+                    --size;
+                }
+                handler(piece, size);
+                lineStart = buffer[end - 1] == '\n';
+                start = end;
+            }
+        }
+    };
+}
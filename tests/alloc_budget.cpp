@@ -0,0 +1,268 @@
+/**
+ * Allocation budget of the command path: once session buffers are grown,
+ * TOP and RETR must not touch the heap. Commands go through every layer a
+ * session uses: POP3Protocol over Transport Layer Provider, MailClient
+ * with POP3PostProvider, and BasicMailClient. The transport is a loopback
+ * provider which answers from prepared responses, and global
+ * `operator new' counts allocations.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include "../pp/pop3.hpp"
+
+using namespace std;
+using namespace post;
+using namespace mail_client;
+using namespace transport;
+
+static size_t allocations = 0;
+
+void* operator new (size_t size) {
+    ++allocations;
+    void* memory = malloc(size == 0 ? 1 : size);
+    if (memory == NULL) {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete (void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete (void* memory, size_t) noexcept {
+    free(memory);
+}
+
+void* operator new[] (size_t size) {
+    return operator new(size);
+}
+
+void operator delete[] (void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete[] (void* memory, size_t) noexcept {
+    free(memory);
+}
+
+static const string capabilities = "+OK\r\nUSER\r\nTOP\r\nUIDL\r\n.\r\n";
+static const string positive = "+OK\r\n";
+static const string header =
+    "+OK\r\n"
+    "From: sender@example.com\r\n"
+    "To: me@example.com\r\n"
+    "Subject: Allocation budget\r\n"
+    "Message-ID: <budget@example.com>\r\n"
+    "\r\n"
+    ".\r\n";
+static string letter;
+
+/**
+ * Transport Layer Provider which doesn't leave the process: every command
+ * is answered at once with the prepared response (header for TOP, whole
+ * letter for RETR). Received memory is charged like real transports do.
+ */
+class LoopbackTransportLayerProvider final : public TransportLayerProvider {
+    private:
+        const string* current;
+        size_t position;
+
+        size_t partEnd (const string& ending, size_t limit) const {
+            size_t end = this->current->find(ending, this->position);
+            if (end == string::npos) {
+                return this->current->size();
+            }
+            end += ending.size();
+            return min(end, this->position + limit);
+        }
+    public:
+        LoopbackTransportLayerProvider () : TransportLayerProvider() {
+            this->current = &positive;
+            this->position = positive.size();
+        }
+
+        void connect (string, string) throw(TransportException) {
+            this->greeting = positive;
+            this->connectionEstablished = true;
+        }
+
+        void disconnect () throw(TransportException) {
+            this->connectionEstablished = false;
+        }
+
+        void transmit (const string& message) throw(TransportException) {
+            if (message.compare(0, 4, "TOP ") == 0) {
+                this->current = &header;
+            }
+            else if (message.compare(0, 5, "RETR ") == 0) {
+                this->current = &letter;
+            }
+            else if (message.compare(0, 4, "CAPA") == 0) {
+                this->current = &capabilities;
+            }
+            else {
+                this->current = &positive;
+            }
+            this->position = 0;
+        }
+
+        void receiveInto (string& response, const string& responseEnding)
+                         throw(TransportException) {
+            size_t end = this->partEnd(responseEnding, string::npos);
+            response.append(*this->current, this->position,
+                            end - this->position);
+            this->position = end;
+            this->received.resize(response.capacity());
+        }
+
+        bool receiveSome (string& response, const string& responseEnding,
+                          size_t limit) throw(TransportException) {
+            size_t end = this->partEnd(responseEnding, limit);
+            response.append(*this->current, this->position,
+                            end - this->position);
+            this->position = end;
+            this->received.resize(response.capacity());
+            return this->current->compare(end - responseEnding.size(),
+                                          responseEnding.size(),
+                                          responseEnding) == 0;
+        }
+};
+
+static const string id = "17";
+
+/**
+ * Run TOP, RETR into string and streaming RETR through POP3Protocol.
+ */
+static bool protocolSession (LoopbackTransportLayerProvider& transport,
+                             string& buffer, string& response,
+                             const LetterHandler& handler, size_t letters) {
+    for (size_t i = 0; i < letters; ++i) {
+        if (POP3Protocol::top(transport, buffer, id, response) != SUCCESS ||
+            POP3Protocol::retr(transport, buffer, id, response) != SUCCESS ||
+            POP3Protocol::retr(transport, buffer, id, handler) != SUCCESS) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Run the same commands through MailClient and POP3PostProvider.
+ */
+static bool mailClientSession (MailClient& client, string& response,
+                               const LetterHandler& handler,
+                               size_t letters) {
+    try {
+        for (size_t i = 0; i < letters; ++i) {
+            client.getLetterHeader(id, response);
+            client.getLetter(id, response);
+            client.getLetter(id, handler);
+        }
+    }
+    catch (const MailClientException& e) {
+        return false;
+    }
+    return true;
+}
+
+typedef BasicMailClient<POP3Protocol, LoopbackTransportLayerProvider>
+        LoopbackClient;
+
+/**
+ * Run the same commands through BasicMailClient.
+ */
+static bool basicClientSession (LoopbackClient& client, string& response,
+                                const LetterHandler& handler,
+                                size_t letters) {
+    for (size_t i = 0; i < letters; ++i) {
+        if (!client.tryGetLetterHeader(id, response) ||
+            !client.tryGetLetter(id, response) ||
+            !client.tryGetLetter(id, handler)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Warm session up, then count allocations of steady-state commands.
+ * @return Returns `false' if commands failed or allocated.
+ */
+template <class Session>
+static bool check (const char* layer, const Session& session) {
+    static const size_t warmUp = 10;
+    static const size_t letters = 1000;
+    if (!session(warmUp)) {
+        fprintf(stderr, "alloc_budget: %s: warm-up commands failed\n",
+                layer);
+        return false;
+    }
+    allocations = 0;
+    bool succeeded = session(letters);
+    size_t counted = allocations;
+    if (!succeeded) {
+        fprintf(stderr, "alloc_budget: %s: commands failed\n", layer);
+        return false;
+    }
+    if (counted != 0) {
+        fprintf(stderr, "alloc_budget: %s: %zu allocations in %zu TOP/RETR "
+                "after warm-up, expected 0\n", layer, counted, letters);
+        return false;
+    }
+    printf("alloc_budget: %s: 0 allocations in %zu TOP/RETR after "
+           "warm-up\n", layer, letters);
+    return true;
+}
+
+int main () {
+    letter = header.substr(0, header.size() - 3);
+    for (size_t i = 0; i < 2000; ++i) {
+        letter.append(i % 50 == 0 ? "..stuffed line\r\n" :
+                      "Body line of the letter which is long enough\r\n");
+    }
+    letter.append(".\r\n");
+    size_t octets = 0;
+    LetterHandler handler = [&octets] (const char*, size_t size) {
+        octets += size;
+    };
+    string response;
+    bool passed = true;
+
+    LoopbackTransportLayerProvider transport;
+    transport.connect("loopback", "110");
+    string buffer;
+    passed &= check("POP3Protocol", [&] (size_t letters) {
+        return protocolSession(transport, buffer, response, handler,
+                               letters);
+    });
+
+    try {
+        MailClient client(p_PP(new POP3PostProvider(
+            p_TLP(new LoopbackTransportLayerProvider()))));
+        client.connect("loopback", "110");
+        client.signin("user", "secret");
+        passed &= check("MailClient", [&] (size_t letters) {
+            return mailClientSession(client, response, handler, letters);
+        });
+    }
+    catch (const MailClientException& e) {
+        fprintf(stderr, "alloc_budget: MailClient: %s\n", e.what());
+        passed = false;
+    }
+
+    LoopbackClient basic;
+    if (!basic.tryConnect("loopback", "110") ||
+        !basic.trySignin("user", "secret")) {
+        fprintf(stderr, "alloc_budget: BasicMailClient: can't sign in\n");
+        passed = false;
+    }
+    else {
+        passed &= check("BasicMailClient", [&] (size_t letters) {
+            return basicClientSession(basic, response, handler, letters);
+        });
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
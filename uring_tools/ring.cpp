@@ -0,0 +1,356 @@
+#include "ring.hpp"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace transport {
+
+    // io_uring Exception methods
+    URingException::URingException (string message) :
+                                   ConnectionException(message) {
+    }
+
+    // io_uring Session methods
+    URingSession::~URingSession () {
+    }
+
+    // io_uring methods
+    URing::URing (unsigned entries, unsigned receiveBuffersCount,
+                  unsigned receiveBufferSize, unsigned sendSlotsCount,
+                  unsigned sendSlotSize) throw(URingException) {
+        this->ringFD = -1;
+        this->sqRing = this->cqRing = MAP_FAILED;
+        this->sqes = (io_uring_sqe*) MAP_FAILED;
+        this->bufferRing = (io_uring_buf*) MAP_FAILED;
+        this->receiveBuffers = this->sendBuffers = NULL;
+        this->receiveBuffersCount = receiveBuffersCount;
+        this->receiveBufferSize = receiveBufferSize;
+        this->sendSlotSize = sendSlotSize;
+        this->sendSlotsCount = sendSlotsCount;
+        this->sqPending = 0;
+        try {
+            this->setup(entries);
+            this->registerReceiveBuffers();
+            this->registerSendBuffers();
+        }
+        catch (...) {
+            this->release();
+            throw;
+        }
+    }
+
+    URing::~URing () {
+        this->release();
+    }
+
+    void URing::release () {
+        if (this->sendBuffers != NULL) {
+            munmap(this->sendBuffers,
+                   this->sendSlotSize * this->sendSlotsCount);
+        }
+        if (this->receiveBuffers != NULL) {
+            munmap(this->receiveBuffers,
+                   this->receiveBufferSize * this->receiveBuffersCount);
+        }
+        if (this->bufferRing != MAP_FAILED) {
+            munmap(this->bufferRing, this->bufferRingSize);
+        }
+        if (this->sqes != MAP_FAILED) {
+            munmap(this->sqes, this->sqesSize);
+        }
+        if (this->cqRing != MAP_FAILED && this->cqRing != this->sqRing) {
+            munmap(this->cqRing, this->cqRingSize);
+        }
+        if (this->sqRing != MAP_FAILED) {
+            munmap(this->sqRing, this->sqRingSize);
+        }
+        if (this->ringFD >= 0) {
+            close(this->ringFD);
+        }
+        this->ringFD = -1;
+        this->sendBuffers = this->receiveBuffers = NULL;
+        this->bufferRing = (io_uring_buf*) MAP_FAILED;
+        this->sqes = (io_uring_sqe*) MAP_FAILED;
+        this->sqRing = this->cqRing = MAP_FAILED;
+    }
+
+    void URing::setup (unsigned entries) throw(URingException) {
+        io_uring_params parameters;
+        memset(&parameters, 0, sizeof(parameters));
+        this->ringFD = syscall(__NR_io_uring_setup, entries, &parameters);
+        if (this->ringFD < 0) {
+            throw URingException("Unable to create io_uring: " +
+                                 string(strerror(errno)) + ".");
+        }
+        this->sqEntries = parameters.sq_entries;
+        this->sqRingSize = parameters.sq_off.array +
+                           parameters.sq_entries * sizeof(unsigned);
+        this->cqRingSize = parameters.cq_off.cqes +
+                           parameters.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = parameters.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMap) {
+            this->sqRingSize = this->cqRingSize =
+                max(this->sqRingSize, this->cqRingSize);
+        }
+        this->sqRing = mmap(NULL, this->sqRingSize, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, this->ringFD,
+                            IORING_OFF_SQ_RING);
+        if (this->sqRing == MAP_FAILED) {
+            throw URingException("Unable to map submission queue.");
+        }
+        if (singleMap) {
+            this->cqRing = this->sqRing;
+        }
+        else {
+            this->cqRing = mmap(NULL, this->cqRingSize,
+                                PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, this->ringFD,
+                                IORING_OFF_CQ_RING);
+            if (this->cqRing == MAP_FAILED) {
+                throw URingException("Unable to map completion queue.");
+            }
+        }
+        this->sqesSize = parameters.sq_entries * sizeof(io_uring_sqe);
+        this->sqes = (io_uring_sqe*) mmap(NULL, this->sqesSize,
+                                          PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE,
+                                          this->ringFD, IORING_OFF_SQES);
+        if (this->sqes == MAP_FAILED) {
+            throw URingException("Unable to map submission entries.");
+        }
+        char* sq = (char*) this->sqRing;
+        char* cq = (char*) this->cqRing;
+        this->sqHead  = (unsigned*) (sq + parameters.sq_off.head);
+        this->sqTail  = (unsigned*) (sq + parameters.sq_off.tail);
+        this->sqMask  = (unsigned*) (sq + parameters.sq_off.ring_mask);
+        this->sqArray = (unsigned*) (sq + parameters.sq_off.array);
+        this->cqHead  = (unsigned*) (cq + parameters.cq_off.head);
+        this->cqTail  = (unsigned*) (cq + parameters.cq_off.tail);
+        this->cqMask  = (unsigned*) (cq + parameters.cq_off.ring_mask);
+        this->cqes    = (io_uring_cqe*) (cq + parameters.cq_off.cqes);
+    }
+
+    void URing::registerReceiveBuffers () throw(URingException) {
+        unsigned count = this->receiveBuffersCount;
+        if (count == 0 || (count & (count - 1)) != 0 || count > 32768) {
+            throw URingException("Number of receive buffers should be "
+                                 "a power of two.");
+        }
+        this->bufferRingSize = count * sizeof(io_uring_buf);
+        this->bufferRing = (io_uring_buf*) mmap(NULL,
+                                this->bufferRingSize, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (this->bufferRing == MAP_FAILED) {
+            throw URingException("Unable to allocate buffer ring.");
+        }
+        void* buffers = mmap(NULL, this->receiveBufferSize * count,
+                             PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffers == MAP_FAILED) {
+            throw URingException("Unable to allocate receive buffers.");
+        }
+        this->receiveBuffers = (char*) buffers;
+        io_uring_buf_reg registration;
+        memset(&registration, 0, sizeof(registration));
+        registration.ring_addr = (uint64_t) this->bufferRing;
+        registration.ring_entries = count;
+        registration.bgid = RECEIVE_GROUP;
+        if (syscall(__NR_io_uring_register, this->ringFD,
+                    IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+            throw URingException("Unable to register receive buffers: " +
+                                 string(strerror(errno)) + ".");
+        }
+        for (unsigned i = 0; i < count; ++i) {
+            this->recycleReceiveBuffer(i);
+        }
+    }
+
+    void URing::registerSendBuffers () throw(URingException) {
+        unsigned slotsCount = this->sendSlotsCount;
+        if (slotsCount == 0) {
+            return;
+        }
+        void* buffers = mmap(NULL, this->sendSlotSize * slotsCount,
+                             PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffers == MAP_FAILED) {
+            throw URingException("Unable to allocate send buffers.");
+        }
+        this->sendBuffers = (char*) buffers;
+        this->freeSendSlots.reserve(slotsCount);
+        vector<iovec> slots(slotsCount);
+        for (unsigned i = 0; i < slotsCount; ++i) {
+            slots[i].iov_base = this->sendBuffers + i * this->sendSlotSize;
+            slots[i].iov_len = this->sendSlotSize;
+        }
+        // Registration may be refused because of locked memory limit:
+        // then plain sends are used
+        if (syscall(__NR_io_uring_register, this->ringFD,
+                    IORING_REGISTER_BUFFERS, slots.data(), slotsCount) < 0) {
+            return;
+        }
+        for (unsigned i = slotsCount; i > 0; --i) {
+            this->freeSendSlots.push_back(i - 1);
+        }
+    }
+
+    void URing::recycleReceiveBuffer (unsigned short bufferID) {
+        unsigned short* ringTail = &this->bufferRing[0].resv;
+        unsigned short tail = *ringTail;
+        unsigned mask = this->receiveBuffersCount - 1;
+        io_uring_buf* buffer = &this->bufferRing[tail & mask];
+        // Field `resv' of the first buffer is the ring tail: don't touch it
+        buffer->addr = (uint64_t) (this->receiveBuffers +
+                                   bufferID * this->receiveBufferSize);
+        buffer->len = this->receiveBufferSize;
+        buffer->bid = bufferID;
+        __atomic_store_n(ringTail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    uint64_t URing::pack (URingSession* session, URingOperation operation) {
+        return ((uint64_t) session) | operation;
+    }
+
+    io_uring_sqe* URing::getSQE () throw(URingException) {
+        unsigned tail = *this->sqTail;
+        unsigned head = __atomic_load_n(this->sqHead, __ATOMIC_ACQUIRE);
+        if (tail - head >= this->sqEntries) {
+            // Queue is full: submit without waiting
+            int submitted = syscall(__NR_io_uring_enter, this->ringFD,
+                                    this->sqPending, 0, 0, NULL, 0);
+            if (submitted < 0) {
+                throw URingException("Unable to submit operations: " +
+                                     string(strerror(errno)) + ".");
+            }
+            this->sqPending -= min((unsigned) submitted, this->sqPending);
+        }
+        unsigned index = tail & *this->sqMask;
+        io_uring_sqe* sqe = &this->sqes[index];
+        memset(sqe, 0, sizeof(io_uring_sqe));
+        this->sqArray[index] = index;
+        __atomic_store_n(this->sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++this->sqPending;
+        return sqe;
+    }
+
+    void URing::prepareConnect (URingSession* session, int socketFD,
+                                const sockaddr* address, socklen_t length)
+                               throw(URingException) {
+        io_uring_sqe* sqe = this->getSQE();
+        sqe->opcode = IORING_OP_CONNECT;
+        sqe->fd = socketFD;
+        sqe->addr = (uint64_t) address;
+        sqe->off = length;
+        sqe->user_data = pack(session, URING_CONNECT);
+    }
+
+    int URing::prepareSend (URingSession* session, int socketFD,
+                            const char* data, size_t size)
+                           throw(URingException) {
+        io_uring_sqe* sqe = this->getSQE();
+        int slot = -1;
+        sqe->fd = socketFD;
+        sqe->user_data = pack(session, URING_SEND);
+        if (size <= this->sendSlotSize && !this->freeSendSlots.empty()) {
+            slot = this->freeSendSlots.back();
+            this->freeSendSlots.pop_back();
+            char* buffer = this->sendBuffers + slot * this->sendSlotSize;
+            memcpy(buffer, data, size);
+            sqe->opcode = IORING_OP_WRITE_FIXED;
+            sqe->addr = (uint64_t) buffer;
+            sqe->len = size;
+            sqe->off = (uint64_t) -1;
+            sqe->buf_index = slot;
+        }
+        else {
+            sqe->opcode = IORING_OP_SEND;
+            sqe->addr = (uint64_t) data;
+            sqe->len = size;
+            sqe->msg_flags = MSG_NOSIGNAL;
+        }
+        return slot;
+    }
+
+    void URing::releaseSendSlot (int slot) {
+        if (slot >= 0) {
+            this->freeSendSlots.push_back(slot);
+        }
+    }
+
+    void URing::prepareReceive (URingSession* session, int socketFD)
+                               throw(URingException) {
+        io_uring_sqe* sqe = this->getSQE();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = socketFD;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = RECEIVE_GROUP;
+        sqe->user_data = pack(session, URING_RECV);
+    }
+
+    void URing::prepareCancel (int socketFD) throw(URingException) {
+        io_uring_sqe* sqe = this->getSQE();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = socketFD;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        // Completion of cancellation itself is not dispatched to anybody
+        sqe->user_data = pack(NULL, URING_CANCEL);
+    }
+
+    unsigned URing::processCompletions () {
+        unsigned head = *this->cqHead;
+        unsigned tail = __atomic_load_n(this->cqTail, __ATOMIC_ACQUIRE);
+        unsigned processed = 0;
+        for (; head != tail; ++head, ++processed) {
+            io_uring_cqe* cqe = &this->cqes[head & *this->cqMask];
+            URingSession* session = (URingSession*) (cqe->user_data & ~3ULL);
+            URingOperation operation = (URingOperation) (cqe->user_data & 3);
+            bool hasBuffer = (cqe->flags & IORING_CQE_F_BUFFER) != 0;
+            unsigned short bufferID = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            const char* data = NULL;
+            if (hasBuffer) {
+                data = this->receiveBuffers +
+                       bufferID * this->receiveBufferSize;
+            }
+            if (session != NULL) {
+                session->onCompletion(operation, cqe->res, cqe->flags, data);
+            }
+            if (hasBuffer) {
+                this->recycleReceiveBuffer(bufferID);
+            }
+        }
+        __atomic_store_n(this->cqHead, head, __ATOMIC_RELEASE);
+        return processed;
+    }
+
+    void URing::run (const function<bool()>& done) throw(URingException) {
+        this->processCompletions();
+        while (!done()) {
+            int submitted = syscall(__NR_io_uring_enter, this->ringFD,
+                                    this->sqPending, 1,
+                                    IORING_ENTER_GETEVENTS, NULL, 0);
+            if (submitted < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw URingException("Unable to wait for completions: " +
+                                     string(strerror(errno)) + ".");
+            }
+            this->sqPending -= min((unsigned) submitted, this->sqPending);
+            this->processCompletions();
+        }
+    }
+
+    std::shared_ptr<URing> URing::shared () throw(URingException) {
+        static thread_local weak_ptr<URing> current;
+        shared_ptr<URing> ring = current.lock();
+        if (!ring) {
+            ring.reset(new URing());
+            current = ring;
+        }
+        return ring;
+    }
+}
@@ -0,0 +1,172 @@
+#pragma once
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <string>
+#include <functional>
+#include "../ac_includes.hpp"
+
+using namespace std;
+
+namespace transport {
+
+    /**
+     * Operations which can be submitted to the ring by a session.
+     */
+    enum URingOperation {
+        URING_CONNECT   = 0x0, // Connect socket to the server.
+        URING_SEND      = 0x1, // Send data (fixed buffer or plain).
+        URING_RECV      = 0x2, // Multishot receive into provided buffers.
+        URING_CANCEL    = 0x3  // Cancel pending operation.
+    };
+
+    /**
+     * Thrown when ring can not be created or operated.
+     */
+    class URingException : public ConnectionException {
+        public:
+            URingException (string message);
+    };
+
+    /**
+     * Something which owns submitted operations and wants to know about their
+     * completion.
+     */
+    class URingSession {
+        public:
+            virtual ~URingSession ();
+            /**
+             * Called by ring for every completion of session's operation.
+             * @param operation Operation which was completed.
+             * @param result Result of the operation (`cqe->res').
+             * @param flags Completion flags (`cqe->flags').
+             * @param data Received data for URING_RECV (NULL otherwise).
+             */
+            virtual void onCompletion (URingOperation operation, int result,
+                                       unsigned flags, const char* data) = 0;
+    };
+
+    /**
+     * io_uring instance shared by many sessions.
+     * Operations of all sessions are queued without system calls and
+     * submitted in one `io_uring_enter' together with waiting for
+     * completions, so one call serves every session which has something
+     * to do. Completions of other sessions are dispatched to them while
+     * current session waits for its own.
+     * Receives are multishot and use provided buffer ring, so idle sessions
+     * don't hold receive buffers. Sends are performed from registered
+     * (fixed) buffers when possible.
+     * Ring is not thread safe: use one ring per thread.
+     */
+    class URing {
+        private:
+            int ringFD;
+            // Submission queue
+            void* sqRing;
+            size_t sqRingSize;
+            unsigned* sqHead;
+            unsigned* sqTail;
+            unsigned* sqMask;
+            unsigned* sqArray;
+            io_uring_sqe* sqes;
+            size_t sqesSize;
+            unsigned sqEntries;
+            unsigned sqPending;
+            // Completion queue
+            void* cqRing;
+            size_t cqRingSize;
+            unsigned* cqHead;
+            unsigned* cqTail;
+            unsigned* cqMask;
+            io_uring_cqe* cqes;
+            // Provided buffers for multishot receive
+            // Entries of `io_uring_buf_ring': its tail is overlaid with
+            // `resv' of the first entry
+            io_uring_buf* bufferRing;
+            size_t bufferRingSize;
+            char* receiveBuffers;
+            unsigned receiveBufferSize;
+            unsigned receiveBuffersCount;
+            // Registered buffers for sends
+            char* sendBuffers;
+            unsigned sendSlotSize;
+            unsigned sendSlotsCount;
+            vector<unsigned> freeSendSlots;
+
+            void setup (unsigned entries) throw(URingException);
+            void registerReceiveBuffers () throw(URingException);
+            void registerSendBuffers () throw(URingException);
+            void release ();
+            void recycleReceiveBuffer (unsigned short bufferID);
+            io_uring_sqe* getSQE () throw(URingException);
+            unsigned processCompletions ();
+            static uint64_t pack (URingSession* session,
+                                  URingOperation operation);
+        public:
+            /**
+             * Buffer group ID for provided receive buffers.
+             */
+            static const unsigned short RECEIVE_GROUP = 0;
+            /**
+             * Create and configure ring.
+             * @param entries Submission queue size.
+             * @param receiveBuffersCount Number of provided receive buffers
+             * (power of two), shared by all sessions.
+             * @param receiveBufferSize Size of every receive buffer.
+             * @param sendSlotsCount Number of registered send buffers.
+             * @param sendSlotSize Size of every registered send buffer.
+             * @throws URingException Thrown if kernel refused to create ring.
+             */
+            URing (unsigned entries = 256, unsigned receiveBuffersCount = 256,
+                   unsigned receiveBufferSize = 4096,
+                   unsigned sendSlotsCount = 64, unsigned sendSlotSize = 4096)
+                  throw(URingException);
+            ~URing ();
+            /**
+             * Queue connect operation. Nothing is submitted until `run'.
+             */
+            void prepareConnect (URingSession* session, int socketFD,
+                                 const sockaddr* address, socklen_t length)
+                                throw(URingException);
+            /**
+             * Queue send operation. Data is copied to registered buffer if
+             * there is a free one, otherwise it should stay alive and
+             * unchanged until completion.
+             * @return Returns registered slot index or -1 if plain send was
+             * used.
+             */
+            int prepareSend (URingSession* session, int socketFD,
+                             const char* data, size_t size)
+                            throw(URingException);
+            /**
+             * Release registered slot returned by `prepareSend'.
+             */
+            void releaseSendSlot (int slot);
+            /**
+             * Queue multishot receive operation which selects buffers from
+             * provided buffer ring.
+             */
+            void prepareReceive (URingSession* session, int socketFD)
+                                throw(URingException);
+            /**
+             * Queue cancellation of all operations on the socket.
+             */
+            void prepareCancel (int socketFD) throw(URingException);
+            /**
+             * Submit queued operations and dispatch completions until
+             * `done' returns true.
+             * @param done Predicate which is checked after every batch of
+             * completions.
+             * @throws URingException Thrown if `io_uring_enter' failed.
+             */
+            void run (const std::function<bool()>& done) throw(URingException);
+            /**
+             * Ring used by default by sessions on current thread.
+             */
+            static std::shared_ptr<URing> shared () throw(URingException);
+    };
+
+    typedef std::shared_ptr<URing> p_URing;
+}
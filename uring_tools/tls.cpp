@@ -0,0 +1,316 @@
+#include "tls.hpp"
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include "../abstract_client/Trace.hpp"
+
+namespace transport {
+
+    URingTLSTransportLayerProvider::URingTLSTransportLayerProvider (
+                        p_URing ring) : TransportLayerProvider() {
+        this->ring = ring ? ring : URing::shared();
+        this->socketFD = -1;
+        this->ssl = NULL;
+        this->inBIO = this->outBIO = NULL;
+        this->sendSlot = -1;
+        this->sending = this->receiving = this->peerClosed = false;
+        this->connectResult = this->sendError = 0;
+        this->awaitedEnding = NULL;
+        this->awaitedChecked = this->awaitedPosition = 0;
+    }
+
+    URingTLSTransportLayerProvider::~URingTLSTransportLayerProvider () {
+        try {
+            this->release();
+        }
+        catch (...) {
+        }
+    }
+
+    SSL_CTX* URingTLSTransportLayerProvider::context ()
+                                            throw(TransportException) {
+        static SSL_CTX* c = SSL_CTX_new(TLS_client_method());
+        if (c == NULL) {
+            throw ConnectionException("Unable to create TLS context.");
+        }
+        // Idle sessions don't keep read and write buffers
+        static long mode = SSL_CTX_set_mode(c, SSL_MODE_RELEASE_BUFFERS);
+        (void) mode;
+        return c;
+    }
+
+    void URingTLSTransportLayerProvider::release () {
+        if (this->socketFD >= 0) {
+            // Stop multishot receive and wait for operations which still
+            // refer to this session
+            shutdown(this->socketFD, SHUT_RDWR);
+            if (this->receiving || this->sending) {
+                this->ring->prepareCancel(this->socketFD);
+            }
+            this->ring->run([this] () {
+                return !this->receiving && !this->sending;
+            });
+            close(this->socketFD);
+            this->socketFD = -1;
+        }
+        if (this->ssl != NULL) {
+            // BIOs are owned by SSL object
+            SSL_free(this->ssl);
+            this->ssl = NULL;
+            this->inBIO = this->outBIO = NULL;
+        }
+        this->outgoing.clear();
+        this->inFlight.clear();
+        this->pending.clear();
+        this->received.resize(0);
+        this->connectionEstablished = false;
+    }
+
+    void URingTLSTransportLayerProvider::onCompletion (
+            URingOperation operation, int result, unsigned flags,
+            const char* data) {
+        switch (operation) {
+            case URING_CONNECT:
+                this->connectResult = result;
+                break;
+            case URING_SEND:
+                this->ring->releaseSendSlot(this->sendSlot);
+                this->sendSlot = -1;
+                if (result < 0) {
+                    this->sendError = result;
+                    this->inFlight.clear();
+                    this->outgoing.clear();
+                }
+                else {
+                    this->inFlight.erase(0, result);
+                }
+                // Short write: send the rest
+                if (!this->inFlight.empty()) {
+                    this->sendSlot = this->ring->prepareSend(this,
+                        this->socketFD, this->inFlight.data(),
+                        this->inFlight.size());
+                }
+                else {
+                    this->sending = false;
+                    this->startSend();
+                }
+                break;
+            case URING_RECV:
+                if (result > 0 && data != NULL) {
+                    BIO_write(this->inBIO, data, result);
+                }
+                if (!(flags & IORING_CQE_F_MORE)) {
+                    bool rearm = (result > 0 || result == -ENOBUFS) &&
+                                 !this->peerClosed;
+                    if (rearm) {
+                        this->ring->prepareReceive(this, this->socketFD);
+                    }
+                    else {
+                        this->receiving = false;
+                        this->peerClosed = true;
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    void URingTLSTransportLayerProvider::flush () throw(TransportException) {
+        char chunk[4096];
+        int size;
+        while ((size = BIO_read(this->outBIO, chunk, sizeof(chunk))) > 0) {
+            this->outgoing.append(chunk, size);
+        }
+        this->startSend();
+    }
+
+    void URingTLSTransportLayerProvider::startSend () {
+        if (this->sending || this->outgoing.empty()) {
+            return;
+        }
+        this->inFlight.swap(this->outgoing);
+        this->sending = true;
+        this->sendSlot = this->ring->prepareSend(this, this->socketFD,
+            this->inFlight.data(), this->inFlight.size());
+    }
+
+    void URingTLSTransportLayerProvider::drain (size_t limit) {
+        char chunk[4096];
+        int size;
+        while (this->pending.size() < limit &&
+               (size = SSL_read(this->ssl, chunk, sizeof(chunk))) > 0) {
+            this->pending.append(chunk, size);
+        }
+    }
+
+    size_t URingTLSTransportLayerProvider::receiveUntil (const string& ending)
+                                                throw(TransportException) {
+        this->awaitedEnding = &ending;
+        this->awaitedChecked = 0;
+        this->awaitedPosition = string::npos;
+        // Send completion and response are awaited by the same system call
+        this->ring->run([this] () {
+            const string& ending = *this->awaitedEnding;
+            this->drain();
+            this->awaitedPosition = this->pending.find(ending,
+                                                       this->awaitedChecked);
+            if (this->pending.size() >= ending.size()) {
+                this->awaitedChecked = this->pending.size() -
+                                       ending.size() + 1;
+            }
+            return this->awaitedPosition != string::npos ||
+                   this->peerClosed || this->sendError != 0;
+        });
+        if (this->awaitedPosition == string::npos) {
+            throw ConnectionException("Connection was closed by server.");
+        }
+        return this->awaitedPosition + ending.size();
+    }
+
+    void URingTLSTransportLayerProvider::connect (string server, string port)
+                                                 throw(TransportException) {
+        this->checkConnectionState(false, "connect");
+        TRACE_CLOCK(transport__connect, start);
+        this->release();
+        addrinfo hints, *addresses;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(server.c_str(), port.c_str(), &hints, &addresses)) {
+            throw ConnectionException("Unable to establish connection.");
+        }
+        connectionStage(CONNECTION_STARTING);
+        for (addrinfo* a = addresses; a != NULL; a = a->ai_next) {
+            this->socketFD = socket(a->ai_family,
+                                    a->ai_socktype | SOCK_CLOEXEC,
+                                    a->ai_protocol);
+            if (this->socketFD < 0) {
+                continue;
+            }
+            this->connectResult = 1;
+            this->ring->prepareConnect(this, this->socketFD, a->ai_addr,
+                                       a->ai_addrlen);
+            this->ring->run([this] () { return this->connectResult != 1; });
+            if (this->connectResult == 0) {
+                break;
+            }
+            close(this->socketFD);
+            this->socketFD = -1;
+        }
+        freeaddrinfo(addresses);
+        if (this->socketFD < 0) {
+            throw ConnectionException("Unable to establish connection.");
+        }
+
+        // Handshake for TLS through memory BIOs
+        this->peerClosed = false;
+        this->sendError = 0;
+        this->ssl = SSL_new(context());
+        this->inBIO = BIO_new(BIO_s_mem());
+        this->outBIO = BIO_new(BIO_s_mem());
+        SSL_set_bio(this->ssl, this->inBIO, this->outBIO);
+        SSL_set_tlsext_host_name(this->ssl, server.c_str());
+        SSL_set_connect_state(this->ssl);
+        this->receiving = true;
+        this->ring->prepareReceive(this, this->socketFD);
+        connectionStage(HANDSHAKE_STARTING);
+        int result;
+        while ((result = SSL_do_handshake(this->ssl)) != 1) {
+            this->flush();
+            int error = SSL_get_error(this->ssl, result);
+            size_t buffered = BIO_ctrl_pending(this->inBIO);
+            if (error != SSL_ERROR_WANT_READ) {
+                this->release();
+                throw ConnectionException("Unable provide handshake.");
+            }
+            this->ring->run([&] () {
+                return BIO_ctrl_pending(this->inBIO) != buffered ||
+                       this->peerClosed || this->sendError != 0;
+            });
+            if (BIO_ctrl_pending(this->inBIO) == buffered) {
+                this->release();
+                throw ConnectionException("Unable provide handshake.");
+            }
+        }
+        this->flush();
+        // Get greeting from the server
+        try {
+            this->greeting.assign(this->pending, 0,
+                                  this->receiveUntil("\r\n"));
+        }
+        catch (const TransportException&) {
+            this->release();
+            throw;
+        }
+        this->pending.clear();
+        this->connectionEstablished = true;
+        TRACE1(transport__connect, TRACE_ELAPSED(start));
+    }
+
+    void URingTLSTransportLayerProvider::disconnect ()
+                                                throw(TransportException) {
+        this->checkConnectionState(true, "disconnect");
+        SSL_shutdown(this->ssl);
+        this->flush();
+        this->ring->run([this] () {
+            return !this->sending || this->sendError != 0;
+        });
+        this->release();
+        TRACE(transport__disconnect);
+    }
+
+    void URingTLSTransportLayerProvider::transmit (const string& message)
+                                                  throw(TransportException) {
+        this->checkConnectionState(true, "send a message");
+        if (SSL_write(this->ssl, message.data(), message.size()) <= 0) {
+            throw ConnectionException("Unable to encrypt message.");
+        }
+        // Operation is submitted together with waiting for response
+        this->flush();
+        TRACE1(transport__transmit, message.size());
+    }
+
+    void URingTLSTransportLayerProvider::receiveInto (string& response,
+                                        const string& responseEnding)
+                                       throw(TransportException) {
+        this->checkConnectionState(true, "receive a message");
+        TRACE_CLOCK(transport__receive, start);
+        size_t end = this->receiveUntil(responseEnding);
+        response.append(this->pending, 0, end);
+        this->pending.erase(0, end);
+        this->received.resize(response.capacity() + this->pending.capacity());
+        TRACE2(transport__receive, end, TRACE_ELAPSED(start));
+    }
+
+    bool URingTLSTransportLayerProvider::receiveSome (string& response,
+                                        const string& responseEnding,
+                                        size_t limit)
+                                       throw(TransportException) {
+        this->checkConnectionState(true, "receive a message");
+        TRACE_CLOCK(transport__receive, start);
+        bool complete;
+        size_t size = partSize(this->pending.data(), this->pending.size(),
+                               responseEnding, limit, complete);
+        // Completions aren't processed while there is enough data, so
+        // slow reader leaves the rest in kernel buffers
+        if (size == 0) {
+            this->ring->run([&] () {
+                this->drain(limit + responseEnding.size());
+                size = partSize(this->pending.data(), this->pending.size(),
+                                responseEnding, limit, complete);
+                return size > 0 || this->peerClosed || this->sendError != 0;
+            });
+        }
+        if (size == 0) {
+            throw ConnectionException("Connection was closed by server.");
+        }
+        response.append(this->pending, 0, size);
+        this->pending.erase(0, size);
+        this->received.resize(response.capacity() + this->pending.capacity());
+        TRACE2(transport__receive, size, TRACE_ELAPSED(start));
+        return complete;
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <openssl/ssl.h>
+#include <string>
+#include "ring.hpp"
+#include "../ac_includes.hpp"
+
+using namespace std;
+
+namespace transport {
+    /**
+     * TLS Transport Layer Provider on top of io_uring.
+     * TLS is processed by OpenSSL through memory BIOs, and ciphertext is
+     * moved by the ring, so many sessions can share one ring and one
+     * `io_uring_enter' call per batch of operations.
+     */
+    class URingTLSTransportLayerProvider final :
+                                    public TransportLayerProvider,
+                                    public URingSession {
+        private:
+            p_URing ring;
+            int socketFD;
+            SSL* ssl;
+            /**
+             * Ciphertext from server (read by OpenSSL).
+             */
+            BIO* inBIO;
+            /**
+             * Ciphertext to server (written by OpenSSL).
+             */
+            BIO* outBIO;
+            /**
+             * Ciphertext which waits for the current send to complete.
+             */
+            string outgoing;
+            /**
+             * Ciphertext which is being sent at the moment. Kernel reads
+             * it until completion arrives, so it isn't changed meanwhile;
+             * new data goes to `outgoing'.
+             */
+            string inFlight;
+            int sendSlot;
+            bool sending;
+            bool receiving;
+            bool peerClosed;
+            int connectResult;
+            int sendError;
+            /**
+             * Plaintext received from server but not returned yet.
+             */
+            string pending;
+            /**
+             * State of `receiveUntil': it's kept in the object, so the wait
+             * condition captures only `this' and fits into std::function
+             * without allocation.
+             */
+            const string* awaitedEnding;
+            size_t awaitedChecked;
+            size_t awaitedPosition;
+
+            static SSL_CTX* context () throw(TransportException);
+            void flush () throw(TransportException);
+            /**
+             * Send `outgoing' if nothing is being sent: buffers are
+             * swapped, so their memory is reused.
+             */
+            void startSend ();
+            /**
+             * Decrypt received data into `pending' until there is no more
+             * data or pending data reaches the limit.
+             */
+            void drain (size_t limit = string::npos);
+            /**
+             * Wait until plaintext contains `ending'.
+             * @return Returns position right after the ending.
+             */
+            size_t receiveUntil (const string& ending)
+                                throw(TransportException);
+            void release ();
+        public:
+            /**
+             * Construct.
+             * @param ring Ring to perform operations on. Ring of current
+             * thread is used if it's not set.
+             */
+            URingTLSTransportLayerProvider (p_URing ring = p_URing());
+            ~URingTLSTransportLayerProvider ();
+            void connect (string server, string port) throw(TransportException);
+            void disconnect () throw(TransportException);
+            void transmit (const string& message) throw(TransportException);
+            void receiveInto (string& response, const string& responseEnding)
+                             throw(TransportException);
+            bool receiveSome (string& response, const string& responseEnding,
+                              size_t limit) throw(TransportException);
+            void onCompletion (URingOperation operation, int result,
+                               unsigned flags, const char* data);
+    };
+}
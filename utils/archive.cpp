@@ -0,0 +1,508 @@
+#include "archive.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <algorithm>
+#include "cluster.hpp"
+
+namespace utils {
+
+    static const uint64_t indexMagic = 0x3158444e49334f50ULL; // "PO3INDX1"
+    static const uint32_t recordMagic = 0x424f4c42; // "BLOB"
+    static const size_t initialCapacity = 1024;
+
+    /**
+     * Index file starts with header and continues with slots.
+     */
+    struct ArchiveIndexHeader {
+        uint64_t magic;
+        uint64_t capacity;
+        uint64_t count;
+        /**
+         * Size of the current segment which is described by index.
+         */
+        uint64_t segmentEnd;
+        uint32_t segment;
+        uint32_t reserved;
+    };
+
+    /**
+     * Slot of hash table with linear probing (hash 0 marks empty slot).
+     */
+    struct ArchiveSlot {
+        uint64_t hash;
+        uint64_t offset;
+        uint32_t segment;
+        /**
+         * Length of the whole record.
+         */
+        uint32_t length;
+    };
+
+    /**
+     * Record in segment, followed by mailbox, UID and compressed data.
+     */
+    struct ArchiveRecord {
+        uint32_t magic;
+        uint32_t kind;
+        uint32_t mailboxLength;
+        uint32_t uidLength;
+        uint32_t size;
+        uint32_t packedSize;
+        uint32_t crc;
+    };
+
+    ArchiveException::ArchiveException (string message) : exception() {
+        this->message = message;
+    }
+
+    const char* ArchiveException::what () const throw() {
+        return this->message.c_str();
+    }
+
+    static uint64_t blobHash (BlobKind kind, const string& mailbox,
+                              const string& uid) {
+        string key(1, (char) kind);
+        key += mailbox;
+        key += '\0';
+        key += uid;
+        uint64_t hash = hashKey(key);
+        return hash != 0 ? hash : 1;
+    }
+
+    static string segmentName (const string& directory, uint32_t segment) {
+        char name[32];
+        snprintf(name, sizeof(name), "/%06u.pack", segment);
+        return directory + name;
+    }
+
+    static size_t mappingSize (size_t capacity) {
+        return sizeof(ArchiveIndexHeader) + capacity * sizeof(ArchiveSlot);
+    }
+
+    /**
+     * Parse record which is entirely in memory.
+     * @return Returns `false' if record is damaged.
+     */
+    static bool unpack (const char* record, size_t length, Blob& blob) {
+        ArchiveRecord fields;
+        if (length < sizeof(fields)) {
+            return false;
+        }
+        memcpy(&fields, record, sizeof(fields));
+        size_t names = fields.mailboxLength + fields.uidLength;
+        if (fields.magic != recordMagic ||
+            length != sizeof(fields) + names + fields.packedSize) {
+            return false;
+        }
+        const char* mailbox = record + sizeof(fields);
+        blob.kind = (BlobKind) fields.kind;
+        blob.mailbox.assign(mailbox, fields.mailboxLength);
+        blob.uid.assign(mailbox + fields.mailboxLength, fields.uidLength);
+        blob.data.resize(fields.size);
+        uLongf size = fields.size;
+        if (uncompress((Bytef*) &blob.data[0], &size,
+                       (const Bytef*) mailbox + names,
+                       fields.packedSize) != Z_OK || size != fields.size) {
+            return false;
+        }
+        return crc32(0, (const Bytef*) blob.data.data(), size) == fields.crc;
+    }
+
+    // Archive methods
+    Archive::Archive (const string& directory, size_t segmentSize,
+                      size_t threads) throw(ArchiveException) {
+        this->directory = directory;
+        this->segmentSize = segmentSize;
+        this->threads = threads;
+        this->header = NULL;
+        this->mappedSize = 0;
+        this->packFD = -1;
+        if (mkdir(directory.c_str(), 0755) < 0 && errno != EEXIST) {
+            throw ArchiveException("Can't create archive " + directory + ".");
+        }
+        // Another run would truncate the segment and write at the same
+        // offsets, so it isn't waited for
+        string lockName = directory + "/lock";
+        this->lockFD = open(lockName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC,
+                            0644);
+        if (this->lockFD < 0) {
+            throw ArchiveException("Can't open " + lockName + ".");
+        }
+        if (flock(this->lockFD, LOCK_EX | LOCK_NB) != 0) {
+            string reason = errno == EWOULDBLOCK ?
+                            "it's used by another process" : strerror(errno);
+            close(this->lockFD);
+            throw ArchiveException("Can't lock archive " + directory + ": " +
+                                   reason + ".");
+        }
+        string indexName = directory + "/index";
+        this->indexFD = open(indexName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC,
+                             0644);
+        struct stat indexStat;
+        if (this->indexFD < 0 || fstat(this->indexFD, &indexStat) < 0) {
+            if (this->indexFD >= 0) {
+                close(this->indexFD);
+            }
+            close(this->lockFD);
+            throw ArchiveException("Can't open index " + indexName + ".");
+        }
+        try {
+            if (indexStat.st_size == 0) {
+                this->map(initialCapacity);
+                this->header->magic = indexMagic;
+                this->header->capacity = initialCapacity;
+                this->header->segment = 1;
+            }
+            else {
+                ArchiveIndexHeader stored;
+                if (pread(this->indexFD, &stored, sizeof(stored), 0) !=
+                        sizeof(stored) || stored.magic != indexMagic ||
+                    (size_t) indexStat.st_size !=
+                        mappingSize(stored.capacity)) {
+                    throw ArchiveException("Index " + indexName +
+                                           " is damaged.");
+                }
+                this->map(stored.capacity);
+            }
+            // Drop the tail which isn't described by index
+            this->openSegment(this->header->segment, true);
+        }
+        catch (const ArchiveException&) {
+            this->unmap();
+            close(this->indexFD);
+            if (this->packFD >= 0) {
+                close(this->packFD);
+            }
+            close(this->lockFD);
+            throw;
+        }
+    }
+
+    Archive::~Archive () {
+        try {
+            this->flush();
+        }
+        catch (const ArchiveException& e) {
+            // Nothing can be done in destructor
+        }
+        this->unmap();
+        close(this->indexFD);
+        if (this->packFD >= 0) {
+            close(this->packFD);
+        }
+        // Lock is released only after everything is flushed
+        close(this->lockFD);
+    }
+
+    void Archive::map (size_t capacity) throw(ArchiveException) {
+        size_t size = mappingSize(capacity);
+        if (ftruncate(this->indexFD, size) < 0) {
+            throw ArchiveException("Can't resize index of " +
+                                   this->directory + ".");
+        }
+        void* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                            this->indexFD, 0);
+        if (mapped == MAP_FAILED) {
+            throw ArchiveException("Can't map index of " + this->directory +
+                                   ".");
+        }
+        this->header = (ArchiveIndexHeader*) mapped;
+        this->mappedSize = size;
+    }
+
+    void Archive::unmap () {
+        if (this->header != NULL) {
+            munmap(this->header, this->mappedSize);
+            this->header = NULL;
+        }
+    }
+
+    ArchiveSlot* Archive::slots () const {
+        return (ArchiveSlot*) (this->header + 1);
+    }
+
+    ArchiveSlot* Archive::find (uint64_t hash) const {
+        size_t capacity = this->header->capacity;
+        ArchiveSlot* slots = this->slots();
+        for (size_t i = hash % capacity; ; i = (i + 1) % capacity) {
+            if (slots[i].hash == hash || slots[i].hash == 0) {
+                return &slots[i];
+            }
+        }
+    }
+
+    void Archive::grow () throw(ArchiveException) {
+        // New index is built aside and renamed, so crash leaves the old one
+        string indexName = this->directory + "/index";
+        string temporary = indexName + ".tmp";
+        int fd = open(temporary.c_str(),
+                      O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw ArchiveException("Can't create " + temporary + ".");
+        }
+        vector<ArchiveSlot> used;
+        used.reserve(this->header->count);
+        for (size_t i = 0; i < this->header->capacity; ++i) {
+            if (this->slots()[i].hash != 0) {
+                used.push_back(this->slots()[i]);
+            }
+        }
+        ArchiveIndexHeader grown = *this->header;
+        grown.capacity *= 2;
+        this->unmap();
+        close(this->indexFD);
+        this->indexFD = fd;
+        this->map(grown.capacity);
+        *this->header = grown;
+        for (const ArchiveSlot& slot : used) {
+            *this->find(slot.hash) = slot;
+        }
+        if (msync(this->header, this->mappedSize, MS_SYNC) < 0 ||
+            rename(temporary.c_str(), indexName.c_str()) < 0) {
+            throw ArchiveException("Can't replace " + indexName + ".");
+        }
+    }
+
+    void Archive::openSegment (uint32_t segment, bool truncate)
+                              throw(ArchiveException) {
+        if (this->packFD >= 0) {
+            close(this->packFD);
+        }
+        string name = segmentName(this->directory, segment);
+        this->packFD = open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (this->packFD < 0 ||
+            (truncate && ftruncate(this->packFD,
+                                   this->header->segmentEnd) < 0)) {
+            throw ArchiveException("Can't open segment " + name + ".");
+        }
+    }
+
+    void Archive::append (const vector<Blob>& blobs) throw(ArchiveException) {
+        // Smaller amounts aren't worth a thread start
+        static const size_t minChunk = 256 << 10;
+        vector<string> packed(blobs.size());
+        vector<uint32_t> crcs(blobs.size());
+        size_t total = 0;
+        for (const Blob& blob : blobs) {
+            total += blob.data.size();
+        }
+        size_t threads = this->threads;
+        if (threads == 0) {
+            threads = max(thread::hardware_concurrency(), 1u);
+        }
+        threads = min(threads, total / minChunk + 1);
+        threads = min(threads, max(blobs.size(), (size_t) 1));
+        size_t chunk = (blobs.size() + threads - 1) / threads;
+        auto compressBlobs = [&] (size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const string& data = blobs[i].data;
+                uLongf size = compressBound(data.size());
+                packed[i].resize(size);
+                compress((Bytef*) &packed[i][0], &size,
+                         (const Bytef*) data.data(), data.size());
+                packed[i].resize(size);
+                crcs[i] = crc32(0, (const Bytef*) data.data(), data.size());
+            }
+        };
+        vector<thread> workers;
+        for (size_t t = 1; t < threads; ++t) {
+            workers.emplace_back(compressBlobs, t * chunk,
+                                 min((t + 1) * chunk, blobs.size()));
+        }
+        // Calling thread takes the first chunk
+        compressBlobs(0, min(chunk, blobs.size()));
+        for (thread& worker : workers) {
+            worker.join();
+        }
+        // Records of one segment are written at once, index is updated
+        // after they are written
+        string buffer;
+        vector<ArchiveSlot> written;
+        auto write = [&] () {
+            if (pwrite(this->packFD, buffer.data(), buffer.size(),
+                       this->header->segmentEnd) != (ssize_t) buffer.size()) {
+                throw ArchiveException("Can't write segment " +
+                    segmentName(this->directory, this->header->segment) +
+                    ".");
+            }
+            for (const ArchiveSlot& slot : written) {
+                if ((this->header->count + 1) * 4 >
+                        this->header->capacity * 3) {
+                    this->grow();
+                }
+                ArchiveSlot* place = this->find(slot.hash);
+                this->header->count += place->hash == 0 ? 1 : 0;
+                *place = slot;
+            }
+            this->header->segmentEnd += buffer.size();
+            buffer.clear();
+            written.clear();
+        };
+        for (size_t i = 0; i < blobs.size(); ++i) {
+            const Blob& blob = blobs[i];
+            ArchiveRecord record;
+            record.magic = recordMagic;
+            record.kind = blob.kind;
+            record.mailboxLength = blob.mailbox.size();
+            record.uidLength = blob.uid.size();
+            record.size = blob.data.size();
+            record.packedSize = packed[i].size();
+            record.crc = crcs[i];
+            size_t length = sizeof(record) + blob.mailbox.size() +
+                            blob.uid.size() + packed[i].size();
+            size_t end = this->header->segmentEnd + buffer.size();
+            if (end > 0 && end + length > this->segmentSize) {
+                write();
+                this->flush();
+                ++this->header->segment;
+                this->header->segmentEnd = 0;
+                this->openSegment(this->header->segment, true);
+            }
+            ArchiveSlot slot;
+            slot.hash = blobHash(blob.kind, blob.mailbox, blob.uid);
+            slot.offset = this->header->segmentEnd + buffer.size();
+            slot.segment = this->header->segment;
+            slot.length = length;
+            written.push_back(slot);
+            buffer.append((const char*) &record, sizeof(record));
+            buffer += blob.mailbox;
+            buffer += blob.uid;
+            buffer += packed[i];
+        }
+        write();
+    }
+
+    bool Archive::read (Blob& blob) const throw(ArchiveException) {
+        uint64_t hash = blobHash(blob.kind, blob.mailbox, blob.uid);
+        const ArchiveSlot* slot = this->find(hash);
+        if (slot->hash == 0) {
+            return false;
+        }
+        string name = segmentName(this->directory, slot->segment);
+        int fd = slot->segment == this->header->segment ? this->packFD :
+                 open(name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw ArchiveException("Can't open segment " + name + ".");
+        }
+        string record(slot->length, '\0');
+        ssize_t size = pread(fd, &record[0], record.size(), slot->offset);
+        if (fd != this->packFD) {
+            close(fd);
+        }
+        if (size < 0) {
+            throw ArchiveException("Can't read segment " + name + ".");
+        }
+        Blob found;
+        // Damaged record or collision of hashes is a missing blob
+        if ((size_t) size != record.size() ||
+            !unpack(record.data(), record.size(), found) ||
+            found.kind != blob.kind || found.mailbox != blob.mailbox ||
+            found.uid != blob.uid) {
+            return false;
+        }
+        blob.data.swap(found.data);
+        return true;
+    }
+
+    bool Archive::contains (BlobKind kind, const string& mailbox,
+                            const string& uid) const {
+        return this->find(blobHash(kind, mailbox, uid))->hash != 0;
+    }
+
+    void Archive::scan (const std::function<void(const Blob&)>& handler)
+                       const throw(ArchiveException) {
+        static const size_t readSize = 4 << 20;
+        const string magic((const char*) &recordMagic, sizeof(recordMagic));
+        string buffer;
+        Blob blob;
+        for (uint32_t segment = 1; segment <= this->header->segment;
+             ++segment) {
+            string name = segmentName(this->directory, segment);
+            int fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                throw ArchiveException("Can't open segment " + name + ".");
+            }
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            struct stat segmentStat;
+            if (fstat(fd, &segmentStat) < 0) {
+                close(fd);
+                throw ArchiveException("Can't read segment " + name + ".");
+            }
+            uint64_t offset = 0;
+            size_t start = 0;
+            buffer.clear();
+            for (;;) {
+                // Parse every record which is entirely in buffer
+                ArchiveRecord record;
+                while (buffer.size() - start >= sizeof(record)) {
+                    memcpy(&record, buffer.data() + start, sizeof(record));
+                    uint64_t length = (uint64_t) sizeof(record) +
+                                      record.mailboxLength +
+                                      record.uidLength + record.packedSize;
+                    // Damaged length can't be waited for past the end
+                    bool damaged = record.magic != recordMagic ||
+                        offset + length > (uint64_t) segmentStat.st_size;
+                    if (!damaged && buffer.size() - start < length) {
+                        break;
+                    }
+                    if (damaged ||
+                        !unpack(buffer.data() + start, length, blob)) {
+                        // Resync at the next magic, CRC drops false ones
+                        size_t next = buffer.find(magic, start + 1);
+                        if (next == string::npos) {
+                            // Magic may be cut by the end of buffer
+                            next = max(start + 1,
+                                       buffer.size() - magic.size() + 1);
+                        }
+                        offset += next - start;
+                        start = next;
+                        continue;
+                    }
+                    // Replaced blobs are skipped
+                    const ArchiveSlot* slot = this->find(
+                        blobHash(blob.kind, blob.mailbox, blob.uid));
+                    if (slot->segment == segment && slot->offset == offset) {
+                        handler(blob);
+                    }
+                    start += length;
+                    offset += length;
+                }
+                buffer.erase(0, start);
+                start = 0;
+                size_t size = buffer.size();
+                buffer.resize(size + readSize);
+                ssize_t got = ::read(fd, &buffer[size], readSize);
+                if (got < 0) {
+                    close(fd);
+                    throw ArchiveException("Can't read segment " + name +
+                                           ".");
+                }
+                buffer.resize(size + got);
+                if (got == 0) {
+                    break;
+                }
+            }
+            close(fd);
+        }
+    }
+
+    void Archive::flush () throw(ArchiveException) {
+        if (fdatasync(this->packFD) < 0 ||
+            msync(this->header, this->mappedSize, MS_SYNC) < 0) {
+            throw ArchiveException("Can't sync archive " + this->directory +
+                                   ".");
+        }
+    }
+
+    size_t Archive::size () const {
+        return this->header->count;
+    }
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <exception>
+#include <functional>
+
+using namespace std;
+
+namespace utils {
+    /**
+     * Thrown when archive files can't be opened, read or written.
+     */
+    class ArchiveException : public std::exception {
+        protected:
+            string message;
+        public:
+            ArchiveException (string message);
+            virtual const char* what() const throw();
+    };
+
+    enum BlobKind {
+        HEADER_BLOB = 'H',
+        MESSAGE_BLOB = 'M'
+    };
+
+    /**
+     * Header or whole message of a letter.
+     */
+    struct Blob {
+        BlobKind kind;
+        /**
+         * Mailbox name, e.g. `login@host:port'.
+         */
+        string mailbox;
+        /**
+         * Unique ID of letter in mailbox.
+         */
+        string uid;
+        string data;
+    };
+
+    struct ArchiveIndexHeader;
+    struct ArchiveSlot;
+
+    /**
+     * Append-only archive of letters in directory:
+     *   NNNNNN.pack -- segments with zlib-compressed blobs one after
+     *                  another, every blob is compressed separately;
+     *   index       -- hash table (mailbox, UID, kind) -> (segment,
+     *                  offset, length) which is mapped into memory.
+     * Reading a blob is one index probe and one read of its record, and
+     * scan reads segments sequentially with large reads. Blob with the
+     * same key replaces the previous one, old record stays in segment
+     * until the archive is rewritten. Pack data is synced before index in
+     * `flush', and index records are checked on reading, so crash loses
+     * only blobs which weren't flushed.
+     */
+    class Archive {
+        private:
+            string directory;
+            size_t segmentSize;
+            size_t threads;
+            /**
+             * File `lock' of directory which is locked while archive is
+             * open: archive has only one writer.
+             */
+            int lockFD;
+            int indexFD;
+            int packFD;
+            ArchiveIndexHeader* header;
+            size_t mappedSize;
+
+            void map (size_t capacity) throw(ArchiveException);
+            void unmap ();
+            /**
+             * Rebuild index with twice larger capacity.
+             */
+            void grow () throw(ArchiveException);
+            void openSegment (uint32_t segment, bool truncate)
+                             throw(ArchiveException);
+            ArchiveSlot* slots () const;
+            /**
+             * Find slot of key hash: slot with the same hash or empty slot
+             * where it should be inserted.
+             */
+            ArchiveSlot* find (uint64_t hash) const;
+        public:
+            /**
+             * Open archive, create it if it doesn't exist. Archive is
+             * locked until it's closed.
+             * @param directory Archive directory.
+             * @param segmentSize Size after which the next segment is
+             * started.
+             * @param threads Number of threads which compress blobs (0
+             * means number of cores).
+             * @throws ArchiveException Thrown if archive can't be opened or
+             * it's open in another process.
+             */
+            Archive (const string& directory,
+                     size_t segmentSize = 256 << 20, size_t threads = 0)
+                    throw(ArchiveException);
+            /**
+             * Flush and close archive.
+             */
+            ~Archive ();
+            Archive (const Archive&) = delete;
+            Archive& operator= (const Archive&) = delete;
+            /**
+             * Compress blobs in parallel and append them.
+             * @param blobs Blobs to append.
+             * @throws ArchiveException Thrown if segment can't be written.
+             */
+            void append (const vector<Blob>& blobs) throw(ArchiveException);
+            /**
+             * Read blob.
+             * @param blob Blob with kind, mailbox and UID set: its data is
+             * replaced with archived one.
+             * @return Returns `false' if blob isn't in archive.
+             * @throws ArchiveException Thrown if segment can't be read.
+             */
+            bool read (Blob& blob) const throw(ArchiveException);
+            bool contains (BlobKind kind, const string& mailbox,
+                           const string& uid) const;
+            /**
+             * Read every current blob in order of appending. Damaged
+             * record is skipped: reading goes on from the next record
+             * magic.
+             * @param handler Function which is called with every blob.
+             * @throws ArchiveException Thrown if segment can't be read.
+             */
+            void scan (const std::function<void(const Blob&)>& handler) const
+                      throw(ArchiveException);
+            /**
+             * Sync segment and then index.
+             * @throws ArchiveException Thrown if files can't be synced.
+             */
+            void flush () throw(ArchiveException);
+            /**
+             * Number of blobs in archive.
+             */
+            size_t size () const;
+    };
+}
@@ -0,0 +1,69 @@
+#include "attachments.hpp"
+#include <cerrno>
+#include <sys/stat.h>
+
+namespace utils {
+
+    /**
+     * Maximal length of file name taken from letter.
+     */
+    static const size_t maxNameLength = 200;
+
+    AttachmentFiles::AttachmentFiles (const string& directory,
+                                      const string& prefix)
+                                     throw(ios_base::failure) {
+        if (mkdir(directory.c_str(), 0755) < 0 && errno != EEXIST) {
+            throw ios_base::failure("Can't create directory " + directory +
+                                    ".");
+        }
+        this->directory = directory;
+        this->prefix = sanitizeFilename(prefix);
+        this->written = 0;
+    }
+
+    void AttachmentFiles::begin (const MimePart& part) {
+        string name = sanitizeFilename(part.filename);
+        if (name.empty()) {
+            name = part.contentType == "text/plain" ? "part.txt" :
+                   part.contentType == "text/html" ? "part.html" :
+                   part.contentType == "message/rfc822" ? "message.eml" :
+                   "part.bin";
+        }
+        string filename = this->directory + "/" + this->prefix + "-" +
+                          to_string(part.number) + "-" + name;
+        this->file.open(filename, ios_base::binary | ios_base::trunc);
+        if (!this->file.is_open()) {
+            throw ios_base::failure("Can't open file " + filename + ".");
+        }
+        this->file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+    }
+
+    void AttachmentFiles::write (const char* data, size_t size) {
+        this->file.write(data, size);
+        this->written += size;
+    }
+
+    void AttachmentFiles::end () {
+        this->file.close();
+        this->file.exceptions(std::ofstream::goodbit);
+        this->file.clear();
+    }
+
+    size_t AttachmentFiles::size () const {
+        return this->written;
+    }
+
+    string sanitizeFilename (const string& name) {
+        string result;
+        for (size_t i = 0; i < name.size() && result.size() < maxNameLength;
+             ++i) {
+            unsigned char c = name[i];
+            if (result.empty() && (c == '.' || c == ' ')) {
+                continue;
+            }
+            result += c < ' ' || c == 0x7F || c == '/' || c == '\\' ?
+                      '_' : (char) c;
+        }
+        return result;
+    }
+}
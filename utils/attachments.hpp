@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+#include <fstream>
+#include "../abstract_client/MimeParser.hpp"
+
+using namespace std;
+using namespace post;
+
+namespace utils {
+    /**
+     * MIME sink which writes every part of letter to its own file
+     * `DIR/<id>-<part number>-<file name>'. Parts without file name are
+     * named after their type (`part.txt', `part.html', `message.eml' or
+     * `part.bin').
+     */
+    class AttachmentFiles : public MimeSink {
+        private:
+            string directory;
+            string prefix;
+            ofstream file;
+            size_t written;
+        public:
+            /**
+             * Construct.
+             * @param directory Directory for files, created if it doesn't
+             * exist.
+             * @param prefix Prefix of file names (letter ID).
+             * @throws ios_base::failure Thrown if directory can't be
+             * created.
+             */
+            AttachmentFiles (const string& directory, const string& prefix)
+                            throw(ios_base::failure);
+            /**
+             * @throws ios_base::failure Thrown if file can't be opened.
+             */
+            void begin (const MimePart& part);
+            /**
+             * @throws ios_base::failure Thrown if file can't be written.
+             */
+            void write (const char* data, size_t size);
+            void end ();
+            /**
+             * Number of octets written to files.
+             */
+            size_t size () const;
+    };
+
+    /**
+     * Make file name safe: path separators and control characters are
+     * replaced and leading dots are removed.
+     * @param name Name which came with letter.
+     * @return Returns name which stays in the directory.
+     */
+    string sanitizeFilename (const string& name);
+}
@@ -0,0 +1,459 @@
+#include "batch.hpp"
+#include <fstream>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <sstream>
+#include "../uring_tools/tls.hpp"
+#include "../boost_tools/tls.hpp"
+#include "../pp/pop3_protocol.hpp"
+#include "limiter.hpp"
+
+using namespace mail_client;
+using namespace std::chrono;
+
+namespace utils {
+
+    vector<Account> readAccounts (const string& filename) {
+        ifstream in(filename);
+        if (!in.is_open()) {
+            throw ios_base::failure("Can't open file " + filename + ".");
+        }
+        vector<Account> accounts;
+        string line;
+        while (getline(in, line)) {
+            istringstream fields(line);
+            Account account;
+            if (!(fields >> account.login) || account.login[0] == '#') {
+                continue;
+            }
+            fields >> account.password;
+            accounts.push_back(account);
+        }
+        return accounts;
+    }
+
+    /**
+     * Account given to session together with its fingerprint from the
+     * previous run.
+     */
+    struct Assignment {
+        Account account;
+        /**
+         * Whether `previous' is set.
+         */
+        bool known;
+        Fingerprint previous;
+    };
+
+    /**
+     * Result of one account check.
+     */
+    struct Outcome {
+        Result result;
+        size_t count;
+        size_t octets;
+        /**
+         * Whether `fingerprint' was received.
+         */
+        bool fingerprinted;
+        Fingerprint fingerprint;
+        /**
+         * Fingerprint matched the previous one and LIST was skipped.
+         */
+        bool unchanged;
+        /**
+         * Replica of server which session was connected to.
+         */
+        size_t replica;
+        /**
+         * Latency of server in seconds: connection with TLS handshake and
+         * sign-in round trip. Commands after sign-in aren't counted, their
+         * time depends on mailbox size.
+         */
+        double latency;
+
+        Outcome () : count(0), octets(0), fingerprinted(false),
+                     unchanged(false), replica(0), latency(0) {
+        }
+    };
+
+    /**
+     * Get fingerprint of mailbox: STAT and, if requested, UIDL of the last
+     * letter. Server without UIDL gives fingerprint without unique ID.
+     */
+    template <class Client>
+    static Result getFingerprint (Client& mailClient,
+                                  const Parameters& parameters,
+                                  Fingerprint& fingerprint) {
+        Result result = mailClient.tryGetMailboxStat(fingerprint.count,
+                                                     fingerprint.octets);
+        if (result && parameters.fingerprintUIDL && fingerprint.count > 0) {
+            result = mailClient.tryGetLetterUID(to_string(fingerprint.count),
+                                                fingerprint.lastUID);
+            if (result.error() == NEGATIVE_RESPONSE) {
+                result = Result();
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Connect to server: to the best of `parameters.replicas' if they are
+     * set.
+     * @param replica Reference to write index of connected replica to it.
+     */
+    template <class Client>
+    static Result connectClient (Client& mailClient,
+                                 const Parameters& parameters,
+                                 size_t& replica) {
+        if (!parameters.replicas) {
+            return mailClient.tryConnect(parameters.host, parameters.port);
+        }
+        return parameters.replicas->connect(
+            [&] (const string& host, const string& port) {
+                return mailClient.tryConnect(host, port);
+            }, replica);
+    }
+
+    /**
+     * Count messages in mailbox. If fingerprints are used and mailbox
+     * wasn't changed since the previous run, STAT answer is used instead
+     * of LIST.
+     * @param mailClient Client which is connected to server.
+     * @param outcome Reference to write result, number of messages, size
+     * of mailbox and fingerprint to it.
+     */
+    template <class Client>
+    static void checkConnected (Client& mailClient,
+                                const Parameters& parameters,
+                                const Assignment& assignment,
+                                Outcome& outcome) {
+        strings ids;
+        vector<size_t> sizes;
+        const Account& account = assignment.account;
+        steady_clock::time_point start = steady_clock::now();
+        Result result = mailClient.trySignin(account.login, account.password);
+        double signin = duration<double>(steady_clock::now() - start).count();
+        outcome.latency += signin;
+        if (parameters.replicas) {
+            // Wrong password is the account's fault, not the replica's
+            parameters.replicas->reportCommand(outcome.replica, signin,
+                result.error() != TRANSPORT_FAILED &&
+                result.error() != TEMPORARY_FAILURE);
+        }
+        if (!result) {
+            outcome.result = result;
+            return;
+        }
+        if (!parameters.fingerprints.empty()) {
+            result = getFingerprint(mailClient, parameters,
+                                    outcome.fingerprint);
+            outcome.fingerprinted = (bool) result;
+            outcome.unchanged = result && assignment.known &&
+                                outcome.fingerprint == assignment.previous;
+        }
+        if (outcome.unchanged) {
+            outcome.count = outcome.fingerprint.count;
+            outcome.octets = outcome.fingerprint.octets;
+        }
+        else if (result) {
+            result = mailClient.tryGetLettersIDs(ids, sizes);
+            outcome.count = ids.size();
+            for (size_t size : sizes) {
+                outcome.octets += size;
+            }
+        }
+        Result signout = mailClient.trySignout();
+        outcome.result = result ? signout : result;
+    }
+
+    /**
+     * Connect to server, wait for account and check it. Connection which
+     * waited longer than `idle' may be dropped by server, so it's replaced
+     * with a fresh one.
+     * The whole session runs on one thread: io_uring cancels requests of
+     * a thread when it exits, so connection can't be handed over to
+     * another thread.
+     */
+    template <class Client>
+    static Outcome prefetchedCheck (const Parameters& parameters,
+                                    future<Assignment> assignment) {
+        duration<double> idle(parameters.prefetchIdle);
+        Outcome outcome;
+        unique_ptr<Client> mailClient(new Client());
+        outcome.result = connectClient(*mailClient, parameters,
+                                       outcome.replica);
+        steady_clock::time_point established = steady_clock::now();
+        Assignment task = assignment.get();
+        if (outcome.result && steady_clock::now() - established > idle) {
+            mailClient.reset(new Client());
+            outcome.result = connectClient(*mailClient, parameters,
+                                           outcome.replica);
+        }
+        if (outcome.result) {
+            checkConnected(*mailClient, parameters, task, outcome);
+        }
+        return outcome;
+    }
+
+    /**
+     * Check accounts one by one while connections for the next
+     * `parameters.prefetch' accounts are established in background.
+     * @param check Function called with assignment and its outcome in
+     * order of assignments.
+     */
+    template <class Client, class Handler>
+    static void checkAccounts (const Parameters& parameters,
+                               const vector<Assignment>& assignments,
+                               const Handler& check) {
+        // Sessions which are connecting or waiting for their accounts
+        deque<promise<Assignment>> waiting;
+        deque<future<Outcome>> outcomes;
+        size_t started = 0;
+        for (const Assignment& assignment : assignments) {
+            // Current account plus prefetch depth
+            while (waiting.size() <= parameters.prefetch &&
+                   started < assignments.size()) {
+                waiting.push_back(promise<Assignment>());
+                outcomes.push_back(async(launch::async,
+                    prefetchedCheck<Client>, std::cref(parameters),
+                    waiting.back().get_future()));
+                ++started;
+            }
+            waiting.front().set_value(assignment);
+            waiting.pop_front();
+            Outcome outcome;
+            try {
+                outcome = outcomes.front().get();
+            }
+            catch (const TransportException& e) {
+                outcome = Outcome();
+                outcome.result = Result(TRANSPORT_FAILED);
+            }
+            outcomes.pop_front();
+            check(assignment, outcome);
+        }
+    }
+
+    /**
+     * Number of attempts to check account which server refused because it
+     * was busy.
+     */
+    static const size_t temporaryFailureAttempts = 3;
+
+    /**
+     * Seconds before the second attempt, it doubles for every next one.
+     */
+    static const double temporaryFailureDelay = 1;
+
+    /**
+     * Check account when limiter of server allows one more session.
+     * Account which server refused as busy (e.g. `LOGIN-DELAY') is checked
+     * again in the next session after a delay: the server wouldn't accept
+     * it at once.
+     */
+    template <class Client>
+    static Outcome limitedCheck (const Parameters& parameters,
+                                 const Assignment& assignment,
+                                 ConcurrencyLimiter& limiter) {
+        Outcome outcome;
+        for (size_t attempt = 0; attempt < temporaryFailureAttempts;
+             ++attempt) {
+            if (attempt > 0) {
+                this_thread::sleep_for(duration<double>(
+                    temporaryFailureDelay * (1 << (attempt - 1))));
+            }
+            size_t ticket = limiter.acquire();
+            outcome = Outcome();
+            try {
+                Client mailClient;
+                steady_clock::time_point start = steady_clock::now();
+                outcome.result = connectClient(mailClient, parameters,
+                                               outcome.replica);
+                outcome.latency =
+                    duration<double>(steady_clock::now() - start).count();
+                if (outcome.result) {
+                    checkConnected(mailClient, parameters, assignment,
+                                   outcome);
+                }
+            }
+            catch (const TransportException& e) {
+                outcome.result = Result(TRANSPORT_FAILED);
+            }
+            limiter.release(ticket, outcome.result, outcome.latency);
+            if (outcome.result.error() != TEMPORARY_FAILURE) {
+                break;
+            }
+        }
+        return outcome;
+    }
+
+    /**
+     * Check up to `parameters.maxConcurrency' accounts at once: sessions
+     * wait for limiter of server, which adapts to its responses.
+     * @param check Function called with assignment and its outcome in
+     * order of assignments.
+     */
+    template <class Client, class Handler>
+    static void checkAccountsLimited (const Parameters& parameters,
+                                      const vector<Assignment>& assignments,
+                                      const Handler& check) {
+        ConcurrencyLimiter& limiter = ConcurrencyLimiter::forHost(
+            parameters.host + ":" + parameters.port,
+            parameters.maxConcurrency);
+        deque<future<Outcome>> outcomes;
+        size_t started = 0;
+        for (const Assignment& assignment : assignments) {
+            while (outcomes.size() < parameters.maxConcurrency &&
+                   started < assignments.size()) {
+                outcomes.push_back(async(launch::async,
+                    limitedCheck<Client>, std::cref(parameters),
+                    std::cref(assignments[started]), std::ref(limiter)));
+                ++started;
+            }
+            Outcome outcome = outcomes.front().get();
+            outcomes.pop_front();
+            check(assignment, outcome);
+        }
+    }
+
+    template <class Handler>
+    static void checkAccounts (const Parameters& parameters,
+                               const vector<Assignment>& assignments,
+                               const Handler& check) {
+        bool limited = parameters.maxConcurrency > 0;
+        if (limited && parameters.transport == "uring") {
+            checkAccountsLimited<BasicMailClient<POP3Protocol,
+                URingTLSTransportLayerProvider>>(parameters, assignments,
+                                                 check);
+        }
+        else if (limited) {
+            checkAccountsLimited<BasicMailClient<POP3Protocol,
+                TLSTransportLayerProvider>>(parameters, assignments, check);
+        }
+        else if (parameters.transport == "uring") {
+            checkAccounts<BasicMailClient<POP3Protocol,
+                URingTLSTransportLayerProvider>>(parameters, assignments,
+                                                 check);
+        }
+        else {
+            checkAccounts<BasicMailClient<POP3Protocol,
+                TLSTransportLayerProvider>>(parameters, assignments, check);
+        }
+    }
+
+    Result checkAccount (const Parameters& parameters, const Account& account,
+                         size_t& count, size_t& octets) {
+        Result result;
+        vector<Assignment> assignments(1);
+        assignments[0].account = account;
+        assignments[0].known = false;
+        Parameters single = parameters;
+        single.prefetch = 0;
+        single.fingerprints.clear();
+        checkAccounts(single, assignments,
+                      [&] (const Assignment&, const Outcome& outcome) {
+            result = outcome.result;
+            count = outcome.count;
+            octets = outcome.octets;
+        });
+        return result;
+    }
+
+    string mailboxName (const Parameters& parameters, const string& login) {
+        return login + "@" + parameters.host + ":" + parameters.port;
+    }
+
+    void writeAccountReport (ostream& out, const Account& account,
+                             const Result& result, size_t count,
+                             size_t octets, bool unchanged) {
+        out << account.login << " ";
+        if (result) {
+            out << count << " " << octets << (unchanged ? " unchanged" : "")
+                << endl;
+        }
+        else {
+            out << "error: " << result.what() << endl;
+        }
+    }
+
+    int runBatch (const Parameters& parameters, ostream& out) {
+        vector<Account> accounts;
+        try {
+            accounts = readAccounts(parameters.accounts);
+        }
+        catch (const ios_base::failure& e) {
+            cerr << "Error occured when application worked with file: "
+                 << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+        unique_ptr<FingerprintStore> fingerprints;
+        vector<Assignment> assignments(accounts.size());
+        try {
+            if (!parameters.fingerprints.empty()) {
+                fingerprints.reset(
+                    new FingerprintStore(parameters.fingerprints));
+            }
+        }
+        catch (const FingerprintException& e) {
+            cerr << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+        for (size_t i = 0; i < accounts.size(); ++i) {
+            assignments[i].account = accounts[i];
+            assignments[i].known = fingerprints &&
+                fingerprints->find(mailboxName(parameters, accounts[i].login),
+                                   assignments[i].previous);
+        }
+        size_t failed = 0, unchanged = 0;
+        checkAccounts(parameters, assignments,
+                      [&] (const Assignment& assignment,
+                           const Outcome& outcome) {
+            writeAccountReport(out, assignment.account, outcome.result,
+                               outcome.count, outcome.octets,
+                               outcome.unchanged);
+            failed += outcome.result ? 0 : 1;
+            unchanged += outcome.unchanged ? 1 : 0;
+            if (outcome.fingerprinted) {
+                fingerprints->update(mailboxName(parameters,
+                                                 assignment.account.login),
+                                     outcome.fingerprint);
+            }
+        });
+        if (fingerprints) {
+            try {
+                fingerprints->save();
+            }
+            catch (const FingerprintException& e) {
+                cerr << e.what() << endl;
+                return EXIT_FAILURE;
+            }
+            cerr << unchanged << " mailboxes are unchanged." << endl;
+        }
+        if (parameters.maxConcurrency > 0) {
+            const ConcurrencyLimiter& limiter = ConcurrencyLimiter::forHost(
+                parameters.host + ":" + parameters.port,
+                parameters.maxConcurrency);
+            cerr << "Concurrency limit " << (size_t) limiter.getLimit()
+                 << " (peak " << limiter.getPeak() << " sessions, "
+                 << limiter.getTemporaryFailures()
+                 << " busy responses)." << endl;
+        }
+        if (parameters.replicas) {
+            try {
+                parameters.replicas->save();
+            }
+            catch (const ReplicaException& e) {
+                cerr << e.what() << endl;
+                return EXIT_FAILURE;
+            }
+            parameters.replicas->writeReport(cerr);
+        }
+        cerr << accounts.size() << " accounts checked, " << failed
+             << " failed." << endl;
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+}
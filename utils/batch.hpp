@@ -0,0 +1,76 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include "command_line.hpp"
+#include "../abstract_client/Result.hpp"
+#include "fingerprint.hpp"
+
+using namespace std;
+
+namespace utils {
+    /**
+     * Mailbox credentials for batch run.
+     */
+    struct Account {
+        string login;
+        string password;
+    };
+
+    /**
+     * Read accounts file: one `login password' pair per line. Empty lines
+     * and lines starting with `#' are skipped.
+     * @param filename Accounts file name.
+     * @return Returns accounts in order of file.
+     * @throws ios_base::failure Thrown if file can't be read.
+     */
+    vector<Account> readAccounts (const string& filename);
+
+    /**
+     * Sign in to mailbox, count messages and sign out.
+     * @param parameters Server and transport parameters.
+     * @param account Mailbox credentials.
+     * @param count Reference to write number of messages to it.
+     * @param octets Reference to write size of mailbox to it.
+     * @return Returns result of the first failed operation or SUCCESS.
+     */
+    Result checkAccount (const Parameters& parameters, const Account& account,
+                         size_t& count, size_t& octets);
+
+    /**
+     * Name of mailbox in fingerprints file.
+     * @return Returns `login@host:port'.
+     */
+    string mailboxName (const Parameters& parameters, const string& login);
+
+    /**
+     * Write report line of one account: `login count octets' or
+     * `login error: reason'.
+     * @param unchanged Mark mailbox which matched its fingerprint.
+     */
+    void writeAccountReport (ostream& out, const Account& account,
+                             const Result& result, size_t count,
+                             size_t octets, bool unchanged = false);
+
+    /**
+     * Check every account from `parameters.accounts' file: sign in, count
+     * messages and sign out. Failures of accounts are ordinary outcomes
+     * here, so they're handled with error codes instead of exceptions.
+     * Writes `login count octets' or `login error: reason' per account.
+     * Connections for the next `parameters.prefetch' accounts are
+     * established while the current account is checked. If
+     * `parameters.replicas' are set, every session connects to the best
+     * replica (see ReplicaSet) and reports its latency. If
+     * `parameters.maxConcurrency' is set, up to that number of accounts
+     * are checked at once under ConcurrencyLimiter of server instead, and
+     * accounts which server refused as busy are tried again.
+     * If `parameters.fingerprints' is set, mailboxes whose STAT (and last
+     * UIDL) didn't change since the previous run are signed out without
+     * LIST and marked `unchanged'.
+     * @param parameters Server, transport and accounts parameters.
+     * @param out Output stream for report.
+     * @return Returns EXIT_SUCCESS if every account was checked,
+     * returns EXIT_FAILURE otherwise.
+     */
+    int runBatch (const Parameters& parameters, ostream& out);
+}
@@ -0,0 +1,460 @@
+#include "cluster.hpp"
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <condition_variable>
+#include <unistd.h>
+#include <openssl/crypto.h>
+#include <boost/asio.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include "server_name_parsing.hpp"
+#include "lines.hpp"
+
+using namespace std::chrono;
+
+/**
+ * Coordinator and workers talk with text lines:
+ *   worker:      HELLO key name
+ *   coordinator: CHECK index login password | DONE
+ *   worker:      RESULT index code count octets seconds
+ * Coordinator sends the next account after the result of the previous one,
+ * so every worker has at most one account in flight. Peer which doesn't
+ * know the cluster key gets nothing: passwords are sent only to workers.
+ */
+namespace utils {
+
+    // Hash Ring methods
+    HashRing::HashRing (size_t replicas) {
+        this->replicas = replicas;
+    }
+
+    void HashRing::add (size_t node, const string& name) {
+        for (size_t i = 0; i < this->replicas; ++i) {
+            this->points[hashKey(name + "#" + to_string(i))] = node;
+        }
+    }
+
+    void HashRing::remove (size_t node) {
+        for (auto point = this->points.begin(); point != this->points.end();) {
+            if (point->second == node) {
+                point = this->points.erase(point);
+            }
+            else {
+                ++point;
+            }
+        }
+    }
+
+    bool HashRing::empty () const {
+        return this->points.empty();
+    }
+
+    size_t HashRing::owner (const string& key) const {
+        auto point = this->points.lower_bound(hashKey(key));
+        // The circle is closed: after the last point goes the first one
+        if (point == this->points.end()) {
+            point = this->points.begin();
+        }
+        return point->second;
+    }
+
+    uint64_t hashKey (const string& key) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char c : key) {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+        // FNV leaves high bits of similar keys close, mix them for the ring
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    /**
+     * Seconds which connected peer has to introduce itself.
+     */
+    static const double helloTimeout = 10;
+
+    /**
+     * Compare keys in time which doesn't depend on their contents, so the
+     * key can't be guessed byte by byte.
+     */
+    static bool sameKey (const string& given, const string& expected) {
+        return given.size() == expected.size() &&
+               CRYPTO_memcmp(given.data(), expected.data(),
+                             given.size()) == 0;
+    }
+
+    /**
+     * Check that key is set and fits into one word of HELLO line.
+     */
+    static bool checkKey (const string& key) {
+        if (key.empty() || key.find_first_of(" \t\r\n") != string::npos) {
+            cerr << "Cluster key should be set with --cluster-key and "
+                 << "shouldn't contain whitespace." << endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Worker as seen by coordinator.
+     */
+    struct WorkerState {
+        string name;
+        /**
+         * Accounts assigned to worker which weren't sent yet.
+         */
+        deque<size_t> queue;
+        bool alive;
+        size_t checked;
+        size_t failed;
+        /**
+         * Time spent by worker on checks.
+         */
+        double seconds;
+    };
+
+    /**
+     * State of coordinator shared by threads which serve workers.
+     */
+    struct Coordination {
+        mutex lock;
+        condition_variable changed;
+        vector<Account> accounts;
+        vector<Result> results;
+        vector<size_t> counts;
+        vector<size_t> octets;
+        /**
+         * Number of accounts without result.
+         */
+        size_t remaining;
+        vector<WorkerState> workers;
+        HashRing ring;
+        /**
+         * Shared secret which workers present in HELLO.
+         */
+        string key;
+        /**
+         * Seconds to wait for result of one account.
+         */
+        double timeout;
+    };
+
+    /**
+     * Give account to its owner in ring. Should be called under lock.
+     * If there are no workers left, account fails.
+     */
+    static void assign (Coordination& coordination, size_t account) {
+        if (coordination.ring.empty()) {
+            coordination.results[account] = Result(TRANSPORT_FAILED);
+            --coordination.remaining;
+            return;
+        }
+        size_t owner = coordination.ring.owner(
+                           coordination.accounts[account].login);
+        coordination.workers[owner].queue.push_back(account);
+    }
+
+    /**
+     * Remove lost worker from ring and redistribute its accounts.
+     * @param current Account which was in flight.
+     */
+    static void dropWorker (Coordination& coordination, size_t worker,
+                            size_t current) {
+        lock_guard<mutex> guard(coordination.lock);
+        WorkerState& state = coordination.workers[worker];
+        state.alive = false;
+        coordination.ring.remove(worker);
+        deque<size_t> orphans;
+        swap(orphans, state.queue);
+        orphans.push_front(current);
+        for (size_t account : orphans) {
+            assign(coordination, account);
+        }
+        cerr << "Worker " << state.name << " is lost, " << orphans.size()
+             << " accounts are redistributed." << endl;
+        coordination.changed.notify_all();
+    }
+
+    /**
+     * Send accounts to worker until every account has result.
+     */
+    template <class Socket>
+    static void serveWorker (Coordination& coordination, size_t worker,
+                             Socket& socket, boost::asio::streambuf& buffer) {
+        WorkerState& state = coordination.workers[worker];
+        for (;;) {
+            size_t account;
+            {
+                unique_lock<mutex> guard(coordination.lock);
+                // Lost workers may bring more accounts later
+                coordination.changed.wait(guard, [&] () {
+                    return !state.queue.empty() ||
+                           coordination.remaining == 0;
+                });
+                if (state.queue.empty()) {
+                    break;
+                }
+                account = state.queue.front();
+                state.queue.pop_front();
+            }
+            const Account& credentials = coordination.accounts[account];
+            istringstream reply;
+            try {
+                writeLine(socket, "CHECK " + to_string(account) + " " +
+                                  credentials.login + " " +
+                                  credentials.password);
+                reply.str(readLine(socket, buffer, coordination.timeout));
+            }
+            catch (const boost::system::system_error& e) {
+                // Hung worker may answer later: it gets closed socket
+                boost::system::error_code ignored;
+                socket.close(ignored);
+                dropWorker(coordination, worker, account);
+                return;
+            }
+            string tag;
+            size_t index, count, octets;
+            int code;
+            double seconds;
+            if (!(reply >> tag >> index >> code >> count >> octets
+                        >> seconds) || tag != "RESULT" || index != account ||
+                code < SUCCESS || code > TRANSPORT_FAILED) {
+                dropWorker(coordination, worker, account);
+                return;
+            }
+            lock_guard<mutex> guard(coordination.lock);
+            Result result((ErrorCode) code);
+            coordination.results[account] = result;
+            coordination.counts[account] = count;
+            coordination.octets[account] = octets;
+            ++state.checked;
+            state.failed += result ? 0 : 1;
+            state.seconds += seconds;
+            --coordination.remaining;
+            coordination.changed.notify_all();
+        }
+        try {
+            writeLine(socket, "DONE");
+        }
+        catch (const boost::system::system_error& e) {
+            // Work is finished anyway
+        }
+    }
+
+    /**
+     * Accept workers, distribute accounts and wait for results.
+     * @param count Number of workers to wait for before distribution.
+     */
+    template <class Protocol>
+    static void coordinate (Coordination& coordination,
+                            boost::asio::io_service& io,
+                            const typename Protocol::endpoint& endpoint,
+                            size_t count) {
+        typedef typename Protocol::socket Socket;
+        typename Protocol::acceptor acceptor(io, endpoint);
+        vector<unique_ptr<Socket>> sockets;
+        vector<unique_ptr<boost::asio::streambuf>> buffers;
+        cerr << "Waiting for " << count << " workers." << endl;
+        while (sockets.size() < count) {
+            unique_ptr<Socket> socket(new Socket(io));
+            unique_ptr<boost::asio::streambuf> buffer(
+                new boost::asio::streambuf());
+            acceptor.accept(*socket);
+            istringstream hello;
+            try {
+                hello.str(readLine(*socket, *buffer, helloTimeout));
+            }
+            catch (const boost::system::system_error& e) {
+                continue;
+            }
+            string tag, key, name;
+            if (!(hello >> tag >> key >> name) || tag != "HELLO" ||
+                !sameKey(key, coordination.key)) {
+                cerr << "Connection without valid cluster key is rejected."
+                     << endl;
+                continue;
+            }
+            WorkerState state;
+            state.name = name;
+            state.alive = true;
+            state.checked = state.failed = 0;
+            state.seconds = 0;
+            // Names may repeat, position makes ring points unique
+            coordination.ring.add(sockets.size(), state.name + "/" +
+                                  to_string(sockets.size()));
+            coordination.workers.push_back(state);
+            sockets.push_back(move(socket));
+            buffers.push_back(move(buffer));
+        }
+        for (size_t account = 0; account < coordination.accounts.size();
+             ++account) {
+            assign(coordination, account);
+        }
+        vector<thread> threads;
+        for (size_t worker = 0; worker < sockets.size(); ++worker) {
+            threads.emplace_back(serveWorker<Socket>, ref(coordination),
+                                 worker, ref(*sockets[worker]),
+                                 ref(*buffers[worker]));
+        }
+        for (thread& worker : threads) {
+            worker.join();
+        }
+    }
+
+    int runCoordinator (const Parameters& parameters, ostream& out) {
+        if (!checkKey(parameters.clusterKey)) {
+            return EXIT_FAILURE;
+        }
+        Coordination coordination;
+        try {
+            coordination.accounts = readAccounts(parameters.accounts);
+        }
+        catch (const ios_base::failure& e) {
+            cerr << "Error occured when application worked with file: "
+                 << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+        size_t total = coordination.accounts.size();
+        coordination.results.resize(total);
+        coordination.counts.resize(total, 0);
+        coordination.octets.resize(total, 0);
+        coordination.remaining = total;
+        coordination.key = parameters.clusterKey;
+        coordination.timeout = parameters.workerTimeout;
+        boost::asio::io_service io;
+        const string& endpoint = parameters.coordinator;
+        try {
+            if (boost::starts_with(endpoint, "unix:")) {
+                typedef boost::asio::local::stream_protocol Local;
+                string path = endpoint.substr(5);
+                // Socket file of previous run would fail bind
+                unlink(path.c_str());
+                coordinate<Local>(coordination, io, Local::endpoint(path),
+                                  parameters.workers);
+            }
+            else {
+                typedef boost::asio::ip::tcp Tcp;
+                string host, port;
+                parseServerName(endpoint, host, port);
+                Tcp::resolver resolver(io);
+                Tcp::resolver::query query(host, port);
+                Tcp::endpoint address = resolver.resolve(query)->endpoint();
+                // Passwords go in cleartext: other hosts should come
+                // through a tunnel unless it's allowed explicitly
+                if (!address.address().is_loopback() &&
+                    !parameters.clusterRemote) {
+                    cerr << "Coordinator listens only on loopback address "
+                         << "without --cluster-remote; connect remote "
+                         << "workers through an SSH or TLS tunnel." << endl;
+                    return EXIT_FAILURE;
+                }
+                coordinate<Tcp>(coordination, io, address,
+                                parameters.workers);
+            }
+        }
+        catch (const BadServerName& e) {
+            cerr << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+        catch (const boost::system::system_error& e) {
+            cerr << "Coordinator can't listen on `" << endpoint << "': "
+                 << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+        size_t failed = 0;
+        for (size_t account = 0; account < total; ++account) {
+            writeAccountReport(out, coordination.accounts[account],
+                               coordination.results[account],
+                               coordination.counts[account],
+                               coordination.octets[account]);
+            failed += coordination.results[account] ? 0 : 1;
+        }
+        for (const WorkerState& worker : coordination.workers) {
+            cerr << "Worker " << worker.name
+                 << (worker.alive ? "" : " (lost)") << ": " << worker.checked
+                 << " accounts, " << worker.failed << " failed, "
+                 << fixed << setprecision(3) << worker.seconds << " s"
+                 << endl;
+        }
+        cerr << total << " accounts checked, " << failed << " failed."
+             << endl;
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    /**
+     * Check accounts sent by coordinator until it says DONE.
+     */
+    template <class Protocol>
+    static int work (const Parameters& parameters,
+                     boost::asio::io_service& io,
+                     const typename Protocol::endpoint& endpoint) {
+        typename Protocol::socket socket(io);
+        boost::asio::streambuf buffer;
+        socket.connect(endpoint);
+        char host[256] = "";
+        gethostname(host, sizeof(host) - 1);
+        writeLine(socket, "HELLO " + parameters.clusterKey + " " +
+                          string(host) + ":" + to_string(getpid()));
+        for (;;) {
+            istringstream request(readLine(socket, buffer));
+            string tag;
+            size_t index;
+            Account account;
+            request >> tag;
+            if (tag == "DONE") {
+                return EXIT_SUCCESS;
+            }
+            if (tag != "CHECK" || !(request >> index >> account.login)) {
+                cerr << "Unexpected request of coordinator." << endl;
+                return EXIT_FAILURE;
+            }
+            request >> account.password;
+            size_t count = 0, octets = 0;
+            steady_clock::time_point start = steady_clock::now();
+            Result result = checkAccount(parameters, account, count, octets);
+            double seconds = duration<double>(steady_clock::now() -
+                                              start).count();
+            writeLine(socket, "RESULT " + to_string(index) + " " +
+                              to_string((int) result.error()) + " " +
+                              to_string(count) + " " + to_string(octets) +
+                              " " + to_string(seconds));
+        }
+    }
+
+    int runWorker (const Parameters& parameters) {
+        if (!checkKey(parameters.clusterKey)) {
+            return EXIT_FAILURE;
+        }
+        boost::asio::io_service io;
+        const string& endpoint = parameters.worker;
+        try {
+            if (boost::starts_with(endpoint, "unix:")) {
+                typedef boost::asio::local::stream_protocol Local;
+                return work<Local>(parameters, io,
+                                   Local::endpoint(endpoint.substr(5)));
+            }
+            typedef boost::asio::ip::tcp Tcp;
+            string host, port;
+            parseServerName(endpoint, host, port);
+            Tcp::resolver resolver(io);
+            Tcp::resolver::query query(host, port);
+            return work<Tcp>(parameters, io,
+                             resolver.resolve(query)->endpoint());
+        }
+        catch (const BadServerName& e) {
+            cerr << e.what() << endl;
+        }
+        catch (const boost::system::system_error& e) {
+            cerr << "Connection to coordinator `" << endpoint
+                 << "' failed: " << e.what() << endl;
+        }
+        return EXIT_FAILURE;
+    }
+}
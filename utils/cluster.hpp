@@ -0,0 +1,74 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <map>
+#include <cstdint>
+#include "batch.hpp"
+
+using namespace std;
+
+namespace utils {
+    /**
+     * Consistent hash ring: every node owns `replicas' points of 64-bit
+     * circle and key belongs to the node of the first point at or after
+     * key's hash. Removing a node moves only keys of this node: they go to
+     * the next points, which are spread over the other nodes.
+     */
+    class HashRing {
+        private:
+            map<uint64_t, size_t> points;
+            size_t replicas;
+        public:
+            HashRing (size_t replicas = 64);
+            /**
+             * Add node to the ring.
+             * @param node Node number returned by `owner'.
+             * @param name Unique node name which places its points.
+             */
+            void add (size_t node, const string& name);
+            /**
+             * Remove every point of node.
+             */
+            void remove (size_t node);
+            bool empty () const;
+            /**
+             * Find node which owns key. Ring shouldn't be empty.
+             */
+            size_t owner (const string& key) const;
+    };
+
+    /**
+     * Stable 64-bit hash of string (FNV-1a): the same on every node and
+     * every run unlike std::hash.
+     */
+    uint64_t hashKey (const string& key);
+
+    /**
+     * Coordinate batch run: wait for `parameters.workers' worker processes
+     * on `parameters.coordinator' endpoint, distribute accounts between
+     * them by consistent hashing of login and collect their results.
+     * Accounts of a worker which disconnects or doesn't return result in
+     * `parameters.workerTimeout' seconds are moved to the remaining
+     * workers. Only peers which present `parameters.clusterKey' become
+     * workers; TCP endpoint should be a loopback address unless
+     * `parameters.clusterRemote' is set. Report has the same format and
+     * order as `runBatch', per worker metrics are written to standard
+     * error.
+     * Endpoint is `host:port' for TCP or `unix:path' for Unix socket.
+     * @param parameters Accounts, endpoint and number of workers.
+     * @param out Output stream for report.
+     * @return Returns EXIT_SUCCESS if every account was checked,
+     * returns EXIT_FAILURE otherwise.
+     */
+    int runCoordinator (const Parameters& parameters, ostream& out);
+
+    /**
+     * Work for coordinator at `parameters.worker' endpoint: check accounts
+     * it sends with own server and transport parameters until it says
+     * that work is done.
+     * @param parameters Server, transport and coordinator parameters.
+     * @return Returns EXIT_SUCCESS if work was finished, returns
+     * EXIT_FAILURE if coordinator can't be reached or went away.
+     */
+    int runWorker (const Parameters& parameters);
+}
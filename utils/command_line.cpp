@@ -1,4 +1,6 @@
 #include "command_line.hpp"
+#include <fstream>
+#include <boost/algorithm/string.hpp>
 
 namespace utils {
 
@@ -7,9 +9,125 @@ namespace utils {
         description.add_options()
             ("help,h", "display this help message")
             ("login,l", value<string>(), "username")
+            ("accounts,a", value<string>(),
+             "batch run: check every `login password' pair from file "
+             "instead of single user")
+            ("fingerprints", value<string>(),
+             "skip mailboxes whose STAT didn't change since the previous "
+             "run; fingerprints are kept in this file")
+            ("fingerprint-uidl",
+             "compare unique ID of the last message too")
+            ("prefetch", value<size_t>()->default_value(1),
+             "batch run: number of connections established in advance")
+            ("prefetch-idle", value<double>()->default_value(10),
+             "batch run: seconds after which unused prefetched connection "
+             "is replaced")
+            ("max-concurrency", value<size_t>()->default_value(0),
+             "batch run: check up to this number of accounts at once; "
+             "the number adapts to busy responses and latency of server")
+            ("coordinator", value<string>(),
+             "batch run: distribute accounts between workers which "
+             "connect to this endpoint (`host:port' or `unix:path')")
+            ("workers", value<size_t>()->default_value(1),
+             "coordinator: number of workers to wait for")
+            ("worker", value<string>(),
+             "batch run: check accounts sent by coordinator at this "
+             "endpoint")
+            ("cluster-key", value<string>(),
+             "coordinator and worker: shared secret which workers present "
+             "to coordinator (`@file' reads it from file); required")
+            ("cluster-remote",
+             "coordinator: listen on address which isn't loopback; "
+             "passwords go in cleartext, so use it only in trusted network")
+            ("worker-timeout", value<double>()->default_value(600),
+             "coordinator: seconds to wait for result of one account "
+             "before its worker is considered lost")
+            ("serve", value<string>(),
+             "run as resident service which answers JSON requests on "
+             "this Unix socket")
+            ("cache-size", value<size_t>()->default_value(64),
+             "service: memory for cached headers in MiB; the least "
+             "recently used mailboxes are evicted first")
             ("password,p", value<string>()->default_value(""),
              "password (optional)")
-            ("server_name,s", value<string>(), "host:port");
+            ("server_name,s", value<string>(),
+             "host:port or comma separated list of equivalent replicas; "
+             "sessions go to the fastest healthy one")
+            ("replica-stats", value<string>(),
+             "keep connect and command latency and error rate of "
+             "replicas in this file between runs")
+            ("transport,t", value<string>()->default_value("asio"),
+             "transport: asio or uring (Linux io_uring)")
+            ("filter,f", value<strings>()->composing(),
+             "keep only messages matching header filter "
+             "`Field:kind=values' (kind: keywords, regex or domain; "
+             "`@file' reads values from file); may be repeated")
+            ("dedupe", value<string>(),
+             "skip letters whose Message-ID was already seen in another "
+             "mailbox; seen IDs are kept in this file between runs")
+            ("delete-older-than", value<unsigned>(),
+             "retention: delete messages older than this number of days")
+            ("delete-larger-than", value<size_t>(),
+             "retention: delete messages larger than this number of octets")
+            ("delete-uids", value<string>(),
+             "retention: delete only messages with UIDs listed in file "
+             "(one per line)")
+            ("dry-run", "retention: only report what would be deleted")
+            ("pipeline", value<size_t>()->default_value(64),
+             "number of commands sent at once if server supports "
+             "pipelining")
+            ("threads", value<size_t>()->default_value(0),
+             "number of threads which extract header fields "
+             "(0 means number of cores)")
+            ("memory-budget", value<size_t>()->default_value(0),
+             "memory for buffers and headers of all sessions in MiB; "
+             "reads and pipelining slow down near it (0 means unlimited)")
+            ("startup-benchmark", value<size_t>()->default_value(0),
+             "run this number of times with the other options and report "
+             "time from exec to the first packet sent to server and to "
+             "TLS handshake start")
+            ("last", value<size_t>(),
+             "read only this number of the newest messages, newest first")
+            ("newer-than", value<unsigned>(),
+             "with --last: stop at the first message older than this "
+             "number of days")
+            ("journal,j", value<string>(),
+             "journal of downloaded letters: resume interrupted run and "
+             "append only new letters to output")
+            ("journal-group", value<size_t>()->default_value(64),
+             "number of letters per journal commit")
+            ("archive", value<string>(),
+             "also store downloaded headers in compressed archive in this "
+             "directory")
+            ("archive-messages",
+             "with --archive: download whole letters with RETR only and "
+             "take header fields from them instead of sending TOP; "
+             "letters dropped by --filter or --dedupe are downloaded too")
+            ("archive-get", value<string>(),
+             "with --archive: print archived header of letter with this "
+             "unique ID without connecting to server")
+            ("archive-replay", value<string>(),
+             "with --archive: print this header field of every archived "
+             "letter without connecting to server")
+            ("attachments", value<string>(),
+             "download letters and extract their MIME parts (attachments "
+             "and bodies) to files in this directory")
+            ("load-sessions", value<size_t>(),
+             "load generation: number of concurrent sessions")
+            ("load-rate", value<double>()->default_value(10),
+             "load generation: new sessions per second")
+            ("load-duration", value<double>()->default_value(30),
+             "load generation: test duration in seconds")
+            ("load-interval", value<double>()->default_value(1),
+             "load generation: report period in seconds")
+            ("load-commands", value<size_t>()->default_value(10),
+             "load generation: commands per session")
+            ("load-script",
+             value<string>()->default_value("LIST:1,UIDL:1,TOP:5,RETR:2"),
+             "load generation: commands mix as `COMMAND:weight' pairs")
+            ("load-idle", value<size_t>()->default_value(0),
+             "load generation: idle sessions kept open during the test; "
+             "memory per idle and per active session is reported");
         return description;
     }
 
@@ -28,16 +146,152 @@ namespace utils {
         out << description;
     }
 
-    bool getParameters (variables_map& variablesMap, string& login,
-                        string& password, string& server_name) {
-        if (!(variablesMap.count("login")
-              && variablesMap.count("server_name"))) {
+    bool getParameters (variables_map& variablesMap, Parameters& parameters,
+                        string& server_name) {
+        bool coordinator = variablesMap.count("accounts") &&
+                           variablesMap.count("coordinator");
+        // Coordinator doesn't connect to mail server itself
+        if (!((variablesMap.count("login") || variablesMap.count("accounts")
+               || variablesMap.count("worker") ||
+               variablesMap.count("serve")) &&
+              (variablesMap.count("server_name") || coordinator))) {
             return false;
         }
         else {
-            login = variablesMap["login"].as<string>();
-            password = variablesMap["password"].as<string>();
-            server_name = variablesMap["server_name"].as<string>();
+            if (variablesMap.count("login")) {
+                parameters.login = variablesMap["login"].as<string>();
+            }
+            if (variablesMap.count("accounts")) {
+                parameters.accounts = variablesMap["accounts"].as<string>();
+            }
+            if (variablesMap.count("coordinator")) {
+                parameters.coordinator =
+                    variablesMap["coordinator"].as<string>();
+            }
+            parameters.workers = variablesMap["workers"].as<size_t>();
+            if (variablesMap.count("replica-stats")) {
+                parameters.replicaStats =
+                    variablesMap["replica-stats"].as<string>();
+            }
+            if (variablesMap.count("fingerprints")) {
+                parameters.fingerprints =
+                    variablesMap["fingerprints"].as<string>();
+            }
+            parameters.fingerprintUIDL =
+                variablesMap.count("fingerprint-uidl") > 0;
+            parameters.prefetch = variablesMap["prefetch"].as<size_t>();
+            parameters.prefetchIdle =
+                variablesMap["prefetch-idle"].as<double>();
+            parameters.maxConcurrency =
+                variablesMap["max-concurrency"].as<size_t>();
+            if (variablesMap.count("serve")) {
+                parameters.serve = variablesMap["serve"].as<string>();
+            }
+            parameters.cacheSize =
+                variablesMap["cache-size"].as<size_t>() << 20;
+            if (variablesMap.count("worker")) {
+                parameters.worker = variablesMap["worker"].as<string>();
+            }
+            if (variablesMap.count("cluster-key")) {
+                parameters.clusterKey =
+                    variablesMap["cluster-key"].as<string>();
+            }
+            if (boost::starts_with(parameters.clusterKey, "@")) {
+                string filename = parameters.clusterKey.substr(1);
+                ifstream in(filename);
+                if (!in.is_open()) {
+                    throw ios_base::failure("Can't open file " + filename +
+                                            ".");
+                }
+                getline(in, parameters.clusterKey);
+                boost::algorithm::trim(parameters.clusterKey);
+            }
+            parameters.clusterRemote =
+                variablesMap.count("cluster-remote") > 0;
+            parameters.workerTimeout =
+                variablesMap["worker-timeout"].as<double>();
+            parameters.password = variablesMap["password"].as<string>();
+            parameters.transport = variablesMap["transport"].as<string>();
+            if (variablesMap.count("server_name")) {
+                server_name = variablesMap["server_name"].as<string>();
+            }
+            if (variablesMap.count("filter")) {
+                parameters.filters = variablesMap["filter"].as<strings>();
+            }
+            if (variablesMap.count("dedupe")) {
+                parameters.dedupe = variablesMap["dedupe"].as<string>();
+            }
+            parameters.pipelineDepth = variablesMap["pipeline"].as<size_t>();
+            parameters.threads = variablesMap["threads"].as<size_t>();
+            parameters.memoryBudget =
+                variablesMap["memory-budget"].as<size_t>() << 20;
+            parameters.startupRuns =
+                variablesMap["startup-benchmark"].as<size_t>();
+            if (variablesMap.count("journal")) {
+                parameters.journal = variablesMap["journal"].as<string>();
+            }
+            parameters.journalGroup =
+                variablesMap["journal-group"].as<size_t>();
+            if (variablesMap.count("archive")) {
+                parameters.archive = variablesMap["archive"].as<string>();
+            }
+            if (variablesMap.count("attachments")) {
+                parameters.attachments =
+                    variablesMap["attachments"].as<string>();
+            }
+            parameters.archiveMessages =
+                variablesMap.count("archive-messages") > 0;
+            if (variablesMap.count("archive-get")) {
+                parameters.archiveGet =
+                    variablesMap["archive-get"].as<string>();
+            }
+            if (variablesMap.count("archive-replay")) {
+                parameters.archiveReplay =
+                    variablesMap["archive-replay"].as<string>();
+            }
+            parameters.last = variablesMap.count("last") ?
+                              variablesMap["last"].as<size_t>() : 0;
+            parameters.since = variablesMap.count("newer-than") ?
+                time(NULL) - 86400 *
+                (time_t) variablesMap["newer-than"].as<unsigned>() : 0;
+            LoadParameters& load = parameters.load;
+            load.sessions = variablesMap.count("load-sessions") ?
+                            variablesMap["load-sessions"].as<size_t>() : 0;
+            load.connectRate = variablesMap["load-rate"].as<double>();
+            load.duration = variablesMap["load-duration"].as<double>();
+            load.interval = variablesMap["load-interval"].as<double>();
+            load.commandsPerSession =
+                variablesMap["load-commands"].as<size_t>();
+            load.script = variablesMap["load-script"].as<string>();
+            load.idleSessions = variablesMap["load-idle"].as<size_t>();
+            RetentionPolicy& retention = parameters.retention;
+            if (variablesMap.count("delete-older-than")) {
+                retention.maxAge = 86400 *
+                    (time_t) variablesMap["delete-older-than"].as<unsigned>();
+            }
+            if (variablesMap.count("delete-larger-than")) {
+                retention.minSize =
+                    variablesMap["delete-larger-than"].as<size_t>();
+            }
+            if (variablesMap.count("delete-uids")) {
+                string filename = variablesMap["delete-uids"].as<string>();
+                ifstream in(filename);
+                if (!in.is_open()) {
+                    throw ios_base::failure("Can't open file " + filename +
+                                            ".");
+                }
+                string uid;
+                while (getline(in, uid)) {
+                    boost::algorithm::trim(uid);
+                    if (!uid.empty()) {
+                        retention.uids.insert(uid);
+                    }
+                }
+                retention.byUIDs = true;
+            }
+            retention.dryRun = variablesMap.count("dry-run") > 0;
+            parameters.purge = retention.maxAge > 0 || retention.minSize > 0 ||
+                               retention.byUIDs;
             return true;
         }
     }
@@ -1,11 +1,221 @@
 #pragma once
 #include <boost/program_options.hpp>
 #include <iostream>
+#include "../abstract_client/PostProvider.hpp"
+#include "replicas.hpp"
 
 using namespace boost::program_options;
 using namespace std;
+using namespace post;
 
 namespace utils {
+    /**
+     * Settings of load generation mode.
+     */
+    struct LoadParameters {
+        /**
+         * Number of concurrent sessions (0 disables load generation).
+         */
+        size_t sessions;
+        /**
+         * Target number of new sessions per second.
+         */
+        double connectRate;
+        /**
+         * Duration of the test in seconds.
+         */
+        double duration;
+        /**
+         * Report period in seconds.
+         */
+        double interval;
+        /**
+         * Number of scripted commands in every session.
+         */
+        size_t commandsPerSession;
+        /**
+         * Commands mix: comma separated `COMMAND:weight' pairs, where
+         * command is LIST, UIDL, TOP or RETR.
+         */
+        string script;
+        /**
+         * Number of idle sessions which are opened before the test and
+         * kept open during it.
+         */
+        size_t idleSessions;
+    };
+    /**
+     * Parameters which were read from command line.
+     */
+    struct Parameters {
+        string login;
+        string password;
+        /**
+         * The first replica of server: it names mailboxes.
+         */
+        string host;
+        string port;
+        /**
+         * Replica statistics file (empty if statistics aren't persisted).
+         */
+        string replicaStats;
+        /**
+         * Replicas of server with their statistics (NULL if server has
+         * one endpoint and statistics aren't persisted).
+         */
+        p_RS replicas;
+        /**
+         * Transport Layer Provider name: `asio' or `uring'.
+         */
+        string transport;
+        /**
+         * Header filter rules (see HeaderFilter).
+         */
+        strings filters;
+        /**
+         * Header filter compiled from rules (NULL if there are no rules).
+         */
+        p_HF headerFilter;
+        /**
+         * File of Message-IDs seen in mailboxes (empty if copies of
+         * letters from other mailboxes aren't skipped).
+         */
+        string dedupe;
+        /**
+         * Set of seen Message-IDs loaded from `dedupe' (NULL if it isn't
+         * set).
+         */
+        p_DF duplicateFilter;
+        /**
+         * Delete messages selected by `retention' instead of reading
+         * headers.
+         */
+        bool purge;
+        RetentionPolicy retention;
+        /**
+         * Maximal number of pipelined commands.
+         */
+        size_t pipelineDepth;
+        /**
+         * Number of threads which extract header parameters (0 means
+         * number of cores).
+         */
+        size_t threads;
+        /**
+         * Memory budget of all sessions in octets (0 means unlimited).
+         */
+        size_t memoryBudget;
+        /**
+         * Number of runs of startup benchmark (0 for usual run).
+         */
+        size_t startupRuns;
+        /**
+         * Journal file name for resuming interrupted runs (empty if
+         * journal isn't used).
+         */
+        string journal;
+        /**
+         * Number of journal records per commit.
+         */
+        size_t journalGroup;
+        /**
+         * Archive directory for downloaded headers (empty if archive isn't
+         * used).
+         */
+        string archive;
+        /**
+         * Store whole letters in archive: they're downloaded once with
+         * RETR and headers are split from them.
+         */
+        bool archiveMessages;
+        /**
+         * Unique ID of letter whose archived header is printed instead of
+         * connecting to server (empty for usual run).
+         */
+        string archiveGet;
+        /**
+         * Header field which is printed for every archived letter of the
+         * mailbox instead of connecting to server (empty for usual run).
+         */
+        string archiveReplay;
+        /**
+         * Directory to extract MIME parts of letters to instead of reading
+         * headers (empty for usual run).
+         */
+        string attachments;
+        LoadParameters load;
+        /**
+         * Read only headers of this number of the newest messages
+         * (0 reads all messages).
+         */
+        size_t last;
+        /**
+         * With `last': stop at the first message older than this UNIX
+         * time (0 disables the cutoff).
+         */
+        time_t since;
+        /**
+         * Accounts file for batch run (empty if batch run isn't requested).
+         */
+        string accounts;
+        /**
+         * Fingerprints file for skipping unchanged mailboxes (empty if
+         * fingerprints aren't used).
+         */
+        string fingerprints;
+        /**
+         * Include unique ID of the last letter into fingerprint.
+         */
+        bool fingerprintUIDL;
+        /**
+         * Number of connections established in advance by batch run.
+         */
+        size_t prefetch;
+        /**
+         * Seconds after which unused prefetched connection is replaced.
+         */
+        double prefetchIdle;
+        /**
+         * Upper bound of adaptive number of accounts which batch run
+         * checks at once (0 checks them one by one with prefetch).
+         */
+        size_t maxConcurrency;
+        /**
+         * Endpoint to coordinate batch run on (empty if this process isn't
+         * coordinator): `host:port' or `unix:path'.
+         */
+        string coordinator;
+        /**
+         * Number of workers which coordinator waits for.
+         */
+        size_t workers;
+        /**
+         * Unix socket to serve requests on (empty if this process isn't
+         * resident service).
+         */
+        string serve;
+        /**
+         * Limit of header cache of resident service in octets.
+         */
+        size_t cacheSize;
+        /**
+         * Endpoint of coordinator to work for (empty if this process isn't
+         * worker).
+         */
+        string worker;
+        /**
+         * Shared secret of coordinator and workers (no whitespace).
+         */
+        string clusterKey;
+        /**
+         * Let coordinator listen on address which isn't loopback.
+         */
+        bool clusterRemote;
+        /**
+         * Seconds which coordinator waits for result of one account.
+         */
+        double workerTimeout;
+    };
     /**
      * Prepare command line arguments processing.
      */
@@ -31,12 +241,12 @@ namespace utils {
     /**
      * Get parameters' values from variables map.
      * @param variablesMap Variables map to read parameters from it.
-     * @param login Reference to write login to it.
-     * @param param Reference to write password to it.
+     * @param parameters Reference to write parameters to it (host and port
+     * are not set).
      * @param server_name Reference to write server name to it.
      * @return Returns `true' in the case of success reading,
      * returns `false' otherwise.
      */
-    bool getParameters (variables_map& variablesMap, string& login,
-                        string& password, string& server_name);
+    bool getParameters (variables_map& variablesMap, Parameters& parameters,
+                        string& server_name);
 }
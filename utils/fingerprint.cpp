@@ -0,0 +1,90 @@
+#include "fingerprint.hpp"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+namespace utils {
+
+    FingerprintException::FingerprintException (string message) :
+                                               exception() {
+        this->message = message;
+    }
+
+    const char* FingerprintException::what () const throw() {
+        return this->message.c_str();
+    }
+
+    // Fingerprint methods
+    Fingerprint::Fingerprint () {
+        this->count = this->octets = 0;
+    }
+
+    bool Fingerprint::operator== (const Fingerprint& other) const {
+        return this->count == other.count && this->octets == other.octets &&
+               this->lastUID == other.lastUID;
+    }
+
+    // Fingerprint Store methods
+    FingerprintStore::FingerprintStore (const string& filename)
+                                       throw(FingerprintException) {
+        this->filename = filename;
+        ifstream in(filename);
+        if (!in.is_open()) {
+            return;
+        }
+        string line;
+        while (getline(in, line)) {
+            if (line.empty()) {
+                continue;
+            }
+            istringstream fields(line);
+            string mailbox;
+            Fingerprint fingerprint;
+            if (!(fields >> mailbox >> fingerprint.count >> fingerprint.octets
+                         >> fingerprint.lastUID)) {
+                throw FingerprintException("Bad fingerprint `" + line +
+                                           "' in " + filename + ".");
+            }
+            if (fingerprint.lastUID == "-") {
+                fingerprint.lastUID.clear();
+            }
+            this->fingerprints[mailbox] = fingerprint;
+        }
+    }
+
+    bool FingerprintStore::find (const string& mailbox,
+                                 Fingerprint& fingerprint) const {
+        auto found = this->fingerprints.find(mailbox);
+        if (found == this->fingerprints.end()) {
+            return false;
+        }
+        fingerprint = found->second;
+        return true;
+    }
+
+    void FingerprintStore::update (const string& mailbox,
+                                   const Fingerprint& fingerprint) {
+        this->fingerprints[mailbox] = fingerprint;
+    }
+
+    void FingerprintStore::save () const throw(FingerprintException) {
+        string temporary = this->filename + ".tmp";
+        {
+            ofstream out(temporary);
+            for (const auto& entry : this->fingerprints) {
+                const Fingerprint& fingerprint = entry.second;
+                out << entry.first << " " << fingerprint.count << " "
+                    << fingerprint.octets << " "
+                    << (fingerprint.lastUID.empty() ? "-" :
+                        fingerprint.lastUID) << "\n";
+            }
+            if (!out.flush()) {
+                throw FingerprintException("Can't write " + temporary + ".");
+            }
+        }
+        if (rename(temporary.c_str(), this->filename.c_str()) != 0) {
+            throw FingerprintException("Can't replace " + this->filename +
+                                       ".");
+        }
+    }
+}
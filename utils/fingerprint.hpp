@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#include <exception>
+#include <unordered_map>
+
+using namespace std;
+
+namespace utils {
+    /**
+     * Thrown when fingerprints file can't be read or written.
+     */
+    class FingerprintException : public std::exception {
+        protected:
+            string message;
+        public:
+            FingerprintException (string message);
+            virtual const char* what() const throw();
+    };
+
+    /**
+     * Cheap summary of mailbox state: STAT answer and optionally unique ID
+     * of the last letter. New letters change count and size; letter which
+     * replaced a deleted one of the same size changes the last unique ID.
+     */
+    struct Fingerprint {
+        size_t count;
+        size_t octets;
+        /**
+         * Unique ID of the last letter (empty if it isn't compared).
+         */
+        string lastUID;
+
+        Fingerprint ();
+        bool operator== (const Fingerprint& other) const;
+    };
+
+    /**
+     * Fingerprints of mailboxes from the previous run, persisted in file
+     * as `mailbox count octets uid' lines (`-' stands for empty unique ID).
+     */
+    class FingerprintStore {
+        private:
+            string filename;
+            unordered_map<string, Fingerprint> fingerprints;
+        public:
+            /**
+             * Read fingerprints file. Missing file is an empty store.
+             * @param filename Fingerprints file name.
+             * @throws FingerprintException Thrown if file can't be parsed.
+             */
+            FingerprintStore (const string& filename)
+                             throw(FingerprintException);
+            /**
+             * Find fingerprint of mailbox.
+             * @param mailbox Mailbox name, e.g. `login@host:port'.
+             * @param fingerprint Reference to write fingerprint to it.
+             * @return Returns `false' if mailbox is unknown.
+             */
+            bool find (const string& mailbox, Fingerprint& fingerprint) const;
+            void update (const string& mailbox,
+                         const Fingerprint& fingerprint);
+            /**
+             * Write fingerprints to file. Temporary file is renamed over
+             * the old one, so interrupted run leaves the previous state.
+             * @throws FingerprintException Thrown if file can't be written.
+             */
+            void save () const throw(FingerprintException);
+    };
+}
@@ -0,0 +1,146 @@
+#include "journal.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+
+namespace utils {
+
+    JournalException::JournalException (string message) : exception() {
+        this->message = message;
+    }
+
+    const char* JournalException::what () const throw() {
+        return this->message.c_str();
+    }
+
+    Journal::Journal (const string& filename, const string& outputFilename,
+                      size_t groupSize) throw(JournalException) {
+        this->filename = filename;
+        this->groupSize = groupSize > 0 ? groupSize : 1;
+        this->buffered = 0;
+        this->lastOffset = 0;
+        this->outputFD = -1;
+        this->journalFD = open(filename.c_str(),
+                               O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (this->journalFD < 0) {
+            throw JournalException("Can't open journal " + filename + ".");
+        }
+        try {
+            this->load();
+        }
+        catch (const JournalException&) {
+            close(this->journalFD);
+            throw;
+        }
+        this->outputFD = open(outputFilename.c_str(),
+                              O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        struct stat outputStat;
+        if (this->outputFD < 0 || fstat(this->outputFD, &outputStat) < 0) {
+            close(this->journalFD);
+            throw JournalException("Can't open file " + outputFilename + ".");
+        }
+        if ((size_t) outputStat.st_size < this->lastOffset) {
+            close(this->journalFD);
+            close(this->outputFD);
+            throw JournalException("File " + outputFilename + " is shorter "
+                                   "than journal " + filename + " says. "
+                                   "Remove the journal to start over.");
+        }
+        // Drop the tail which was written after the last committed letter
+        if (ftruncate(this->outputFD, this->lastOffset) < 0) {
+            close(this->journalFD);
+            close(this->outputFD);
+            throw JournalException("Can't truncate file " + outputFilename +
+                                   ".");
+        }
+    }
+
+    Journal::~Journal () {
+        try {
+            this->commit();
+        }
+        catch (const JournalException&) {
+        }
+        close(this->outputFD);
+        close(this->journalFD);
+    }
+
+    void Journal::load () throw(JournalException) {
+        string content;
+        char chunk[65536];
+        ssize_t size;
+        while ((size = read(this->journalFD, chunk, sizeof(chunk))) > 0) {
+            content.append(chunk, size);
+        }
+        if (size < 0) {
+            throw JournalException("Can't read journal " + this->filename +
+                                   ".");
+        }
+        // Only complete records are valid: the last one may be torn
+        size_t valid = 0, lineStart = 0, lineEnd;
+        while ((lineEnd = content.find('\n', lineStart)) != string::npos) {
+            string line = content.substr(lineStart, lineEnd - lineStart);
+            size_t space = line.rfind(' ');
+            if (space == string::npos || space == 0) {
+                break;
+            }
+            this->uids.insert(line.substr(0, space));
+            this->lastOffset = strtoull(line.c_str() + space + 1, NULL, 10);
+            valid = lineStart = lineEnd + 1;
+        }
+        if (ftruncate(this->journalFD, valid) < 0 ||
+            lseek(this->journalFD, valid, SEEK_SET) < 0) {
+            throw JournalException("Can't repair journal " + this->filename +
+                                   ".");
+        }
+    }
+
+    void Journal::append (const string& uid, size_t offset)
+                         throw(JournalException) {
+        this->buffer += uid + " " + to_string(offset) + "\n";
+        this->uids.insert(uid);
+        this->lastOffset = offset;
+        if (++this->buffered >= this->groupSize) {
+            this->commit();
+        }
+    }
+
+    void Journal::commit () throw(JournalException) {
+        if (this->buffer.empty()) {
+            return;
+        }
+        // Letters should be on disk before records about them
+        if (fdatasync(this->outputFD) < 0) {
+            throw JournalException("Can't sync output: " +
+                                   string(strerror(errno)) + ".");
+        }
+        size_t written = 0;
+        while (written < this->buffer.size()) {
+            ssize_t size = write(this->journalFD,
+                                 this->buffer.data() + written,
+                                 this->buffer.size() - written);
+            if (size < 0 && errno != EINTR) {
+                throw JournalException("Can't write journal " +
+                                       this->filename + ".");
+            }
+            written += size > 0 ? size : 0;
+        }
+        if (fdatasync(this->journalFD) < 0) {
+            throw JournalException("Can't sync journal " + this->filename +
+                                   ".");
+        }
+        this->buffer.clear();
+        this->buffered = 0;
+    }
+
+    const unordered_set<string>& Journal::completed () const {
+        return this->uids;
+    }
+
+    size_t Journal::offset () const {
+        return this->lastOffset;
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <string>
+#include <exception>
+#include <unordered_set>
+
+using namespace std;
+
+namespace utils {
+    /**
+     * Thrown when journal or output file can't be read or written.
+     */
+    class JournalException : public std::exception {
+        protected:
+            string message;
+        public:
+            JournalException (string message);
+            virtual const char* what() const throw();
+    };
+
+    /**
+     * Append-only journal of downloaded letters for resuming interrupted
+     * runs.
+     * Every record is `UID OFFSET': unique ID of letter and size of output
+     * file after letter was written. Records are committed in groups:
+     * output file is synced first and journal after it, so every committed
+     * record describes data which is already on disk. On opening, output is
+     * truncated to the offset of the last committed record, so partially
+     * written letters are dropped and will be downloaded again.
+     */
+    class Journal {
+        private:
+            string filename;
+            int journalFD;
+            int outputFD;
+            /**
+             * Number of records per commit.
+             */
+            size_t groupSize;
+            /**
+             * Records which are not written yet.
+             */
+            string buffer;
+            size_t buffered;
+            unordered_set<string> uids;
+            size_t lastOffset;
+
+            void load () throw(JournalException);
+        public:
+            /**
+             * Open journal, read committed records and prepare output file.
+             * @param filename Journal file name.
+             * @param outputFilename Output file name. It's truncated to
+             * the end of last committed letter.
+             * @param groupSize Number of records per commit.
+             * @throws JournalException Thrown if files can't be opened.
+             */
+            Journal (const string& filename, const string& outputFilename,
+                     size_t groupSize = 64) throw(JournalException);
+            /**
+             * Commit buffered records and close files.
+             */
+            ~Journal ();
+            /**
+             * Add record about letter which was written and flushed
+             * to output.
+             * @param uid Unique ID of letter.
+             * @param offset Output size after letter.
+             * @throws JournalException Thrown if group commit failed.
+             */
+            void append (const string& uid, size_t offset)
+                        throw(JournalException);
+            /**
+             * Sync output and write buffered records.
+             * @throws JournalException Thrown if files can't be written.
+             */
+            void commit () throw(JournalException);
+            /**
+             * Unique IDs of letters which were already written.
+             */
+            const unordered_set<string>& completed () const;
+            /**
+             * Output size after the last written letter.
+             */
+            size_t offset () const;
+    };
+}
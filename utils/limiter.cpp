@@ -0,0 +1,85 @@
+#include "limiter.hpp"
+#include <map>
+#include <memory>
+#include <algorithm>
+
+namespace utils {
+
+    ConcurrencyLimiter::ConcurrencyLimiter (size_t maximum,
+                                            double tolerance) {
+        this->maximum = max(maximum, (size_t) 1);
+        this->limit = 1;
+        this->tolerance = tolerance;
+        this->active = 0;
+        this->minLatency = 0;
+        this->cuts = 0;
+        this->temporaryFailures = 0;
+        this->peak = 0;
+    }
+
+    size_t ConcurrencyLimiter::acquire () {
+        unique_lock<mutex> guard(this->lock);
+        this->released.wait(guard, [this] () {
+            return this->active < (size_t) this->limit;
+        });
+        ++this->active;
+        this->peak = max(this->peak, this->active);
+        return this->cuts;
+    }
+
+    void ConcurrencyLimiter::release (size_t ticket, const Result& result,
+                                      double latency) {
+        lock_guard<mutex> guard(this->lock);
+        --this->active;
+        bool refused = result.error() == TEMPORARY_FAILURE ||
+                       result.error() == TRANSPORT_FAILED;
+        bool queued = false;
+        if (result.error() == TEMPORARY_FAILURE) {
+            ++this->temporaryFailures;
+        }
+        // Failed session may end early or late (e.g. delayed answer to
+        // wrong password), so only successful ones measure server
+        if (result) {
+            if (this->minLatency == 0 || latency < this->minLatency) {
+                this->minLatency = latency;
+            }
+            queued = latency > this->tolerance * this->minLatency;
+        }
+        if ((refused || queued) && ticket == this->cuts) {
+            this->limit = max(1.0, this->limit * (refused ? 0.5 : 0.9));
+            ++this->cuts;
+        }
+        else if (!refused && !queued) {
+            this->limit += this->cuts == 0 ? 1 : 1 / this->limit;
+            this->limit = min(this->limit, (double) this->maximum);
+        }
+        this->released.notify_all();
+    }
+
+    double ConcurrencyLimiter::getLimit () const {
+        lock_guard<mutex> guard(this->lock);
+        return this->limit;
+    }
+
+    size_t ConcurrencyLimiter::getPeak () const {
+        lock_guard<mutex> guard(this->lock);
+        return this->peak;
+    }
+
+    size_t ConcurrencyLimiter::getTemporaryFailures () const {
+        lock_guard<mutex> guard(this->lock);
+        return this->temporaryFailures;
+    }
+
+    ConcurrencyLimiter& ConcurrencyLimiter::forHost (const string& host,
+                                                     size_t maximum) {
+        static mutex limitersLock;
+        static map<string, unique_ptr<ConcurrencyLimiter>> limiters;
+        lock_guard<mutex> guard(limitersLock);
+        unique_ptr<ConcurrencyLimiter>& limiter = limiters[host];
+        if (!limiter) {
+            limiter.reset(new ConcurrencyLimiter(maximum));
+        }
+        return *limiter;
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include "../abstract_client/Result.hpp"
+
+using namespace std;
+using namespace post;
+
+namespace utils {
+    /**
+     * Adaptive limit of concurrent sessions to one server (AIMD like TCP
+     * congestion control). The limit starts at 1 and grows by one per
+     * successful session (slow start) until the first congestion, then by
+     * one per `limit' sessions. Congestion is a busy server response
+     * (RFC 3206 `IN-USE', `LOGIN-DELAY', `SYS/TEMP'), connection failure
+     * or latency of successful session above `tolerance' times the lowest
+     * one; it halves the limit (latency cuts it by 10%). Latency is
+     * measured on handshake and sign-in, whose time doesn't depend on
+     * mailbox. Sessions which started before
+     * the cut don't cut it again, so one burst of failures halves the
+     * limit once. So the limit settles just below the concurrency which
+     * server starts to refuse or queue.
+     */
+    class ConcurrencyLimiter {
+        private:
+            mutable mutex lock;
+            condition_variable released;
+            size_t maximum;
+            double limit;
+            double tolerance;
+            size_t active;
+            double minLatency;
+            /**
+             * Number of cuts: sessions get it as ticket.
+             */
+            size_t cuts;
+            size_t temporaryFailures;
+            size_t peak;
+        public:
+            /**
+             * Construct.
+             * @param maximum Upper bound of the limit.
+             * @param tolerance Latency which is this times higher than the
+             * lowest one means that server queues sessions.
+             */
+            ConcurrencyLimiter (size_t maximum, double tolerance = 2);
+            /**
+             * Wait until session may start.
+             * @return Returns ticket to pass to `release'.
+             */
+            size_t acquire ();
+            /**
+             * Finish session and adapt the limit to its outcome.
+             * @param ticket Ticket returned by `acquire'.
+             * @param result Result of session.
+             * @param latency Connection with TLS handshake and sign-in
+             * round trip in seconds (ignored if session failed).
+             */
+            void release (size_t ticket, const Result& result,
+                          double latency);
+            double getLimit () const;
+            /**
+             * The highest number of concurrent sessions.
+             */
+            size_t getPeak () const;
+            size_t getTemporaryFailures () const;
+            /**
+             * Limiter of server which is shared by all its sessions in
+             * process.
+             * @param host Server `host:port'.
+             * @param maximum Upper bound of the limit if limiter is
+             * created.
+             */
+            static ConcurrencyLimiter& forHost (const string& host,
+                                                size_t maximum);
+    };
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <string>
+#include <istream>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+#include <boost/asio.hpp>
+
+using namespace std;
+
+namespace utils {
+    /**
+     * Write line to stream socket. Line ending is added.
+     * @throws boost::system::system_error Thrown if socket is closed.
+     */
+    template <class Socket>
+    void writeLine (Socket& socket, const string& line) {
+        string message = line + "\n";
+        boost::asio::write(socket, boost::asio::buffer(message));
+    }
+
+    /**
+     * Read line from stream socket.
+     * @param buffer Buffer of socket: data after the line stays in it.
+     * @return Returns line without ending.
+     * @throws boost::system::system_error Thrown if socket is closed.
+     */
+    template <class Socket>
+    string readLine (Socket& socket, boost::asio::streambuf& buffer) {
+        boost::asio::read_until(socket, buffer, '\n');
+        istream in(&buffer);
+        string line;
+        getline(in, line);
+        return line;
+    }
+
+    /**
+     * Read line from stream socket, waiting for it no longer than given
+     * time.
+     * @param buffer Buffer of socket: data after the line stays in it.
+     * @param seconds Time to wait for the whole line.
+     * @return Returns line without ending.
+     * @throws boost::system::system_error Thrown if socket is closed or
+     * line didn't arrive in time (`timed_out').
+     */
+    template <class Socket>
+    string readLine (Socket& socket, boost::asio::streambuf& buffer,
+                     double seconds) {
+        std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(seconds));
+        for (;;) {
+            auto data = buffer.data();
+            if (find(boost::asio::buffers_begin(data),
+                     boost::asio::buffers_end(data), '\n') !=
+                boost::asio::buffers_end(data)) {
+                return readLine(socket, buffer);
+            }
+            auto left = std::chrono::duration_cast<
+                std::chrono::milliseconds>(deadline -
+                                           std::chrono::steady_clock::now());
+            pollfd descriptor;
+            descriptor.fd = socket.native_handle();
+            descriptor.events = POLLIN;
+            int ready = left.count() > 0 ?
+                        poll(&descriptor, 1, (int) left.count()) : 0;
+            if (ready == 0) {
+                throw boost::system::system_error(
+                    boost::asio::error::timed_out);
+            }
+            if (ready < 0 && errno != EINTR) {
+                throw boost::system::system_error(
+                    boost::system::error_code(errno,
+                        boost::system::system_category()));
+            }
+            if (ready > 0) {
+                // Socket is readable, so this doesn't block
+                buffer.commit(socket.read_some(buffer.prepare(4096)));
+            }
+        }
+    }
+}
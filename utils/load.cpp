@@ -0,0 +1,363 @@
+#include "load.hpp"
+#include "task.hpp"
+#include "../boost_tools/tls.hpp"
+#include "../uring_tools/tls.hpp"
+#include "../pp/pop3_protocol.hpp"
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <fstream>
+#include <unistd.h>
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+
+using namespace std::chrono;
+
+namespace utils {
+
+    static const char* loadCommandsNames[] = {"CONNECT", "LIST", "UIDL",
+                                              "TOP", "RETR"};
+
+    /**
+     * Results of commands collected by sessions.
+     */
+    struct LoadStatistics {
+        vector<double> latencies[LOAD_COMMANDS_COUNT];
+        size_t bytes;
+        size_t errors;
+
+        LoadStatistics () : bytes(0), errors(0) {
+        }
+
+        size_t commands () const {
+            size_t result = 0;
+            // Session setup is not a command
+            for (int c = LOAD_LIST; c < LOAD_COMMANDS_COUNT; ++c) {
+                result += this->latencies[c].size();
+            }
+            return result;
+        }
+
+        void add (const LoadStatistics& other) {
+            for (int c = 0; c < LOAD_COMMANDS_COUNT; ++c) {
+                this->latencies[c].insert(this->latencies[c].end(),
+                                          other.latencies[c].begin(),
+                                          other.latencies[c].end());
+            }
+            this->bytes += other.bytes;
+            this->errors += other.errors;
+        }
+    };
+
+    BadLoadScript::BadLoadScript (string message) : exception() {
+        this->message = message;
+    }
+
+    const char* BadLoadScript::what () const throw() {
+        return this->message.c_str();
+    }
+
+    vector<double> parseLoadScript (const string& script)
+                                   throw(BadLoadScript) {
+        vector<double> weights(LOAD_COMMANDS_COUNT, 0);
+        strings items, item;
+        boost::algorithm::split(items, script, boost::is_any_of(","),
+                                boost::token_compress_on);
+        for (string& command : items) {
+            boost::algorithm::split(item, command, boost::is_any_of(":"));
+            boost::algorithm::to_upper(item[0]);
+            const char** name = find(loadCommandsNames + LOAD_LIST,
+                                     loadCommandsNames + LOAD_COMMANDS_COUNT,
+                                     item[0]);
+            if (name == loadCommandsNames + LOAD_COMMANDS_COUNT) {
+                throw BadLoadScript("Unknown command `" + item[0] + "'.");
+            }
+            double weight = 1;
+            try {
+                weight = item.size() > 1 ? stod(item[1]) : 1;
+            }
+            catch (const logic_error&) {
+                throw BadLoadScript("Bad weight in `" + command + "'.");
+            }
+            weights[name - loadCommandsNames] = max(weight, 0.0);
+        }
+        // Make weights cumulative
+        for (int c = 1; c < LOAD_COMMANDS_COUNT; ++c) {
+            weights[c] += weights[c - 1];
+        }
+        if (weights.back() <= 0) {
+            throw BadLoadScript("Script has no commands.");
+        }
+        return weights;
+    }
+
+    /**
+     * Latency percentile in milliseconds.
+     */
+    static double percentile (vector<double>& sorted, double p) {
+        if (sorted.empty()) {
+            return 0;
+        }
+        size_t index = (size_t) (p * sorted.size());
+        return sorted[min(index, sorted.size() - 1)] * 1000;
+    }
+
+    static void report (ostream& out, const string& title,
+                        LoadStatistics& statistics, double seconds,
+                        size_t active) {
+        out << fixed << setprecision(1) << title
+            << " active " << active
+            << " sessions " << statistics.latencies[LOAD_CONNECT].size()
+            << " commands " << statistics.commands()
+            << " (" << statistics.commands() / seconds << "/s)"
+            << " KiB/s " << statistics.bytes / 1024.0 / seconds
+            << " errors " << statistics.errors
+            << " memory KiB " << (MemoryBudget::global().getUsed() >> 10)
+            << " (peak " << (MemoryBudget::global().getHighWater() >> 10)
+            << ")" << endl;
+        for (int c = 0; c < LOAD_COMMANDS_COUNT; ++c) {
+            vector<double>& latencies = statistics.latencies[c];
+            if (latencies.empty()) {
+                continue;
+            }
+            sort(latencies.begin(), latencies.end());
+            out << setprecision(2) << "    " << setw(7) << left
+                << loadCommandsNames[c] << right
+                << " count " << latencies.size()
+                << " p50 " << percentile(latencies, 0.5)
+                << " p90 " << percentile(latencies, 0.9)
+                << " p99 " << percentile(latencies, 0.99)
+                << " max " << latencies.back() * 1000 << " ms" << endl;
+        }
+    }
+
+    /**
+     * Run command and remember its latency and received size.
+     * @param run Command which returns number of received octets.
+     */
+    template <class Command>
+    static void measure (LoadStatistics& local, LoadCommand command,
+                         const Command& run) {
+        steady_clock::time_point t = steady_clock::now();
+        size_t bytes = run();
+        local.latencies[command].push_back(
+            duration<double>(steady_clock::now() - t).count());
+        local.bytes += bytes;
+    }
+
+    typedef BasicMailClient<POP3Protocol, TLSTransportLayerProvider>
+            AsioClient;
+    typedef BasicMailClient<POP3Protocol, URingTLSTransportLayerProvider>
+            URingClient;
+
+    /**
+     * Resident set size of the process in octets.
+     */
+    static size_t residentMemory () {
+        ifstream statm("/proc/self/statm");
+        size_t pages = 0, resident = 0;
+        statm >> pages >> resident;
+        return resident * sysconf(_SC_PAGESIZE);
+    }
+
+    /**
+     * Run one session: connect, list letters and run scripted commands.
+     * Client is statically composed, so per-command overhead is the one
+     * of protocol and transport only. Client object is reused by the next
+     * session of the thread, so its buffers are allocated once.
+     */
+    template <class Client>
+    static void runSession (Client& mailClient, const Parameters& parameters,
+                            const vector<double>& weights, mt19937& random,
+                            LoadStatistics& local)
+                           throw(MailClientException) {
+        uniform_real_distribution<double> pick(0, weights.back());
+        steady_clock::time_point before = steady_clock::now();
+        mailClient.connect(parameters.host, parameters.port);
+        mailClient.signin(parameters.login, parameters.password);
+        local.latencies[LOAD_CONNECT].push_back(
+            duration<double>(steady_clock::now() - before).count());
+        strings ids;
+        vector<size_t> sizes;
+        string data;
+        const string first("1");
+        unordered_map<string, string> uids;
+        measure(local, LOAD_LIST, [&] () -> size_t {
+            mailClient.getLettersIDs(ids, sizes);
+            return 0;
+        });
+        for (size_t i = 0; i < parameters.load.commandsPerSession; ++i) {
+            double choice = pick(random);
+            int command = upper_bound(weights.begin(), weights.end(),
+                                      choice) - weights.begin();
+            command = min(command, LOAD_COMMANDS_COUNT - 1);
+            const string& id = ids.empty() ? first :
+                               ids[random() % ids.size()];
+            measure(local, (LoadCommand) command, [&] () -> size_t {
+                switch (command) {
+                    case LOAD_LIST:
+                        mailClient.getLettersIDs(ids, sizes);
+                        return 0;
+                    case LOAD_UIDL:
+                        mailClient.getLettersUIDs(uids);
+                        return 0;
+                    case LOAD_TOP:
+                        mailClient.getLetterHeader(id, data);
+                        return data.size();
+                    default:
+                        mailClient.getLetter(id, data);
+                        return data.size();
+                }
+            });
+        }
+        mailClient.signout();
+        mailClient.disconnect();
+    }
+
+    /**
+     * Open signed in sessions which stay idle until they're destroyed.
+     * @param count Number of sessions to open.
+     * @param clients Vector to add opened sessions to.
+     * @return Returns number of sessions which failed to open.
+     */
+    template <class Client>
+    static size_t openIdleSessions (const Parameters& parameters,
+                                    size_t count,
+                                    vector<unique_ptr<Client>>& clients) {
+        size_t errors = 0;
+        clients.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            unique_ptr<Client> mailClient(new Client());
+            try {
+                mailClient->connect(parameters.host, parameters.port);
+                mailClient->signin(parameters.login, parameters.password);
+                clients.push_back(move(mailClient));
+            }
+            catch (const MailClientException& e) {
+                ++errors;
+            }
+        }
+        return errors;
+    }
+
+    template <class Client>
+    static int generateLoad (const Parameters& parameters,
+                             const vector<double>& weights, ostream& out) {
+        const LoadParameters& load = parameters.load;
+        mutex statisticsMutex;
+        LoadStatistics current, total;
+        atomic<size_t> connects(0), active(0);
+
+        // Idle sessions are opened by this thread: io_uring sessions have
+        // to stay on the thread of their ring
+        vector<unique_ptr<Client>> idle;
+        size_t before = residentMemory();
+        total.errors += openIdleSessions(parameters, load.idleSessions, idle);
+        size_t baseline = residentMemory(), peak = baseline;
+        if (!idle.empty()) {
+            out << "Idle sessions " << idle.size() << ", memory per idle "
+                << "session " << fixed << setprecision(1)
+                << (baseline - before) / 1024.0 / idle.size() << " KiB"
+                << endl;
+        }
+
+        steady_clock::time_point start = steady_clock::now();
+        steady_clock::time_point end = start +
+            duration_cast<steady_clock::duration>(
+                duration<double>(load.duration));
+
+        auto session = [&] (unsigned seed) {
+            mt19937 random(seed);
+            // Created on this thread, so io_uring session uses its ring
+            unique_ptr<Client> mailClient;
+            while (true) {
+                // Connect rate limit: n-th session starts at n / rate
+                size_t number = connects++;
+                steady_clock::time_point due = start +
+                    duration_cast<steady_clock::duration>(
+                        duration<double>(number / load.connectRate));
+                if (due >= end) {
+                    break;
+                }
+                this_thread::sleep_until(due);
+                if (!mailClient) {
+                    mailClient.reset(new Client());
+                }
+                LoadStatistics local;
+                ++active;
+                try {
+                    runSession(*mailClient, parameters, weights, random,
+                               local);
+                }
+                catch (const MailClientException& e) {
+                    mailClient->disconnect();
+                    ++local.errors;
+                }
+                --active;
+                lock_guard<mutex> lock(statisticsMutex);
+                current.add(local);
+            }
+        };
+
+        vector<thread> sessions;
+        random_device seeds;
+        for (size_t i = 0; i < load.sessions; ++i) {
+            sessions.push_back(thread(session, seeds()));
+        }
+        // Report periodically until the end of the run
+        steady_clock::time_point lastReport = start;
+        while (true) {
+            steady_clock::time_point next = lastReport +
+                duration_cast<steady_clock::duration>(
+                    duration<double>(load.interval));
+            this_thread::sleep_until(min(next, end));
+            steady_clock::time_point now = steady_clock::now();
+            LoadStatistics interval;
+            {
+                lock_guard<mutex> lock(statisticsMutex);
+                swap(interval, current);
+            }
+            peak = max(peak, residentMemory());
+            total.add(interval);
+            ostringstream title;
+            title << fixed << setprecision(1) << setw(7)
+                  << duration<double>(now - start).count() << "s";
+            report(out, title.str(), interval,
+                   duration<double>(now - lastReport).count(), active);
+            lastReport = now;
+            if (now >= end) {
+                break;
+            }
+        }
+        for (thread& t : sessions) {
+            t.join();
+        }
+        total.add(current);
+        report(out, "  total", total,
+               duration<double>(steady_clock::now() - start).count(), 0);
+        if (load.sessions > 0) {
+            out << "Memory per active session " << fixed << setprecision(1)
+                << (peak - baseline) / 1024.0 / load.sessions
+                << " KiB (peak RSS " << (peak >> 10) << " KiB)" << endl;
+        }
+        return total.errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    int generateLoad (const Parameters& parameters, ostream& out) {
+        vector<double> weights;
+        try {
+            weights = parseLoadScript(parameters.load.script);
+        }
+        catch (const BadLoadScript& e) {
+            cerr << "Bad load script: " << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+        if (parameters.transport == "uring") {
+            return generateLoad<URingClient>(parameters, weights, out);
+        }
+        return generateLoad<AsioClient>(parameters, weights, out);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <exception>
+#include "command_line.hpp"
+
+using namespace std;
+
+namespace utils {
+    /**
+     * Thrown when load generation script can't be parsed.
+     */
+    class BadLoadScript : public std::exception {
+        protected:
+            string message;
+        public:
+            BadLoadScript (string message);
+            virtual const char* what() const throw();
+    };
+
+    /**
+     * Commands which can be used in load generation script.
+     * CONNECT is session setup: connection, handshake, greeting and
+     * authorization.
+     */
+    enum LoadCommand {
+        LOAD_CONNECT = 0,
+        LOAD_LIST    = 1,
+        LOAD_UIDL    = 2,
+        LOAD_TOP     = 3,
+        LOAD_RETR    = 4,
+        LOAD_COMMANDS_COUNT
+    };
+
+    /**
+     * Parse commands mix.
+     * @param script Comma separated `COMMAND:weight' pairs.
+     * @return Returns cumulative weights of commands (index is LoadCommand).
+     * @throws BadLoadScript Thrown if script can't be parsed.
+     */
+    vector<double> parseLoadScript (const string& script)
+                                   throw(BadLoadScript);
+
+    /**
+     * Stress test POP3 server: keep `load.sessions' concurrent sessions
+     * opened at most `load.connectRate' per second, run scripted commands
+     * in them and report throughput and latency percentiles every
+     * `load.interval' seconds and for the whole run. With
+     * `load.idleSessions' idle sessions are opened first and kept open,
+     * and resident memory per idle and per active session is reported.
+     * @param parameters Server, user, transport and load parameters.
+     * @param out Output stream for reports.
+     * @return Returns EXIT_SUCCESS if no errors occured,
+     * returns EXIT_FAILURE otherwise.
+     */
+    int generateLoad (const Parameters& parameters, ostream& out);
+}
@@ -0,0 +1,226 @@
+#include "replicas.hpp"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace utils {
+
+    /**
+     * Replica with this error rate isn't chosen while others are healthy.
+     */
+    static const double unhealthyErrorRate = 0.5;
+    /**
+     * Error rate of replica which isn't used halves in this number of
+     * seconds.
+     */
+    static const double errorHalfLife = 300;
+
+    const double ReplicaSet::weight = 0.2;
+
+    ReplicaException::ReplicaException (string message) : exception() {
+        this->message = message;
+    }
+
+    const char* ReplicaException::what () const throw() {
+        return this->message.c_str();
+    }
+
+    // Replica methods
+    Replica::Replica () {
+        this->connectLatency = this->commandLatency = this->errorRate = 0;
+        this->samples = 0;
+        this->updated = 0;
+    }
+
+    double Replica::currentErrorRate (time_t now) const {
+        double age = max(0.0, difftime(now, this->updated));
+        return this->errorRate * pow(0.5, age / errorHalfLife);
+    }
+
+    // Replica Set methods
+    ReplicaSet::ReplicaSet (const string& serverNames,
+                            const string& filename)
+                           throw(BadServerName, ReplicaException) {
+        this->filename = filename;
+        this->sessions = 0;
+        istringstream names(serverNames);
+        string name;
+        while (getline(names, name, ',')) {
+            Replica replica;
+            parseServerName(name, replica.host, replica.port);
+            this->replicas.push_back(replica);
+        }
+        if (this->replicas.empty()) {
+            throw BadServerName("No servers in `" + serverNames + "'.");
+        }
+        ifstream in(filename);
+        if (filename.empty() || !in.is_open()) {
+            return;
+        }
+        string line;
+        while (getline(in, line)) {
+            if (line.empty()) {
+                continue;
+            }
+            istringstream fields(line);
+            Replica stored;
+            if (!(fields >> name >> stored.connectLatency
+                         >> stored.commandLatency >> stored.errorRate
+                         >> stored.samples >> stored.updated)) {
+                throw ReplicaException("Bad replica statistics `" + line +
+                                       "' in " + filename + ".");
+            }
+            bool known = false;
+            for (Replica& replica : this->replicas) {
+                if (replica.host + ":" + replica.port == name) {
+                    stored.host = replica.host;
+                    stored.port = replica.port;
+                    replica = stored;
+                    known = true;
+                }
+            }
+            if (!known) {
+                this->others.push_back(line);
+            }
+        }
+    }
+
+    size_t ReplicaSet::size () const {
+        return this->replicas.size();
+    }
+
+    Replica ReplicaSet::get (size_t replica) const {
+        lock_guard<mutex> guard(this->lock);
+        return this->replicas[replica];
+    }
+
+    vector<size_t> ReplicaSet::order () {
+        lock_guard<mutex> guard(this->lock);
+        time_t now = time(NULL);
+        vector<size_t> result(this->replicas.size());
+        for (size_t i = 0; i < result.size(); ++i) {
+            result[i] = i;
+        }
+        // Unmeasured replicas first, then healthy ones by latency, then
+        // unhealthy ones by error rate; the list order breaks ties
+        stable_sort(result.begin(), result.end(), [&] (size_t a, size_t b) {
+            const Replica& x = this->replicas[a];
+            const Replica& y = this->replicas[b];
+            if ((x.samples == 0) != (y.samples == 0)) {
+                return x.samples == 0;
+            }
+            double xErrors = x.currentErrorRate(now);
+            double yErrors = y.currentErrorRate(now);
+            bool xHealthy = xErrors < unhealthyErrorRate;
+            bool yHealthy = yErrors < unhealthyErrorRate;
+            if (xHealthy != yHealthy) {
+                return xHealthy;
+            }
+            if (!xHealthy) {
+                return xErrors < yErrors;
+            }
+            return x.connectLatency + x.commandLatency <
+                   y.connectLatency + y.commandLatency;
+        });
+        if (++this->sessions % exploration == 0 && result.size() > 1) {
+            // The least recently measured healthy replica goes first
+            auto oldest = min_element(result.begin(), result.end(),
+                                      [&] (size_t a, size_t b) {
+                const Replica& x = this->replicas[a];
+                const Replica& y = this->replicas[b];
+                bool xHealthy = x.currentErrorRate(now) < unhealthyErrorRate;
+                bool yHealthy = y.currentErrorRate(now) < unhealthyErrorRate;
+                if (xHealthy != yHealthy) {
+                    return xHealthy;
+                }
+                return x.updated < y.updated;
+            });
+            rotate(result.begin(), oldest, oldest + 1);
+        }
+        return result;
+    }
+
+    void ReplicaSet::update (Replica& replica, double& average,
+                             double sample, bool failed) {
+        if (replica.samples == 0) {
+            replica.errorRate = failed ? 1 : 0;
+        }
+        else {
+            replica.errorRate = replica.currentErrorRate(time(NULL)) *
+                                (1 - weight) + (failed ? weight : 0);
+        }
+        if (!failed) {
+            // The first sample replaces zero which isn't a measurement
+            average = average == 0 ? sample :
+                      average * (1 - weight) + sample * weight;
+        }
+        ++replica.samples;
+        replica.updated = time(NULL);
+    }
+
+    void ReplicaSet::reportConnect (size_t replica, double seconds,
+                                    bool succeeded) {
+        lock_guard<mutex> guard(this->lock);
+        Replica& target = this->replicas[replica];
+        this->update(target, target.connectLatency, seconds, !succeeded);
+    }
+
+    void ReplicaSet::reportCommand (size_t replica, double seconds,
+                                    bool succeeded) {
+        lock_guard<mutex> guard(this->lock);
+        Replica& target = this->replicas[replica];
+        this->update(target, target.commandLatency, seconds, !succeeded);
+    }
+
+    void ReplicaSet::save () const throw(ReplicaException) {
+        if (this->filename.empty()) {
+            return;
+        }
+        lock_guard<mutex> guard(this->lock);
+        string temporary = this->filename + ".tmp";
+        {
+            ofstream out(temporary);
+            for (const string& line : this->others) {
+                out << line << "\n";
+            }
+            out << setprecision(6);
+            for (const Replica& replica : this->replicas) {
+                if (replica.samples == 0) {
+                    continue;
+                }
+                out << replica.host << ":" << replica.port << " "
+                    << replica.connectLatency << " "
+                    << replica.commandLatency << " " << replica.errorRate
+                    << " " << replica.samples << " " << replica.updated
+                    << "\n";
+            }
+            if (!out.flush()) {
+                throw ReplicaException("Can't write " + temporary + ".");
+            }
+        }
+        if (rename(temporary.c_str(), this->filename.c_str()) != 0) {
+            throw ReplicaException("Can't replace " + this->filename + ".");
+        }
+    }
+
+    void ReplicaSet::writeReport (ostream& out) const {
+        lock_guard<mutex> guard(this->lock);
+        time_t now = time(NULL);
+        ios_base::fmtflags flags = out.flags();
+        streamsize precision = out.precision();
+        out << fixed;
+        for (const Replica& replica : this->replicas) {
+            out << "Replica " << replica.host << ":" << replica.port
+                << ": connect " << setprecision(1)
+                << replica.connectLatency * 1000 << " ms, command "
+                << replica.commandLatency * 1000 << " ms, errors "
+                << setprecision(0) << replica.currentErrorRate(now) * 100
+                << "%, " << replica.samples << " samples." << endl;
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+}
@@ -0,0 +1,177 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <ctime>
+#include <exception>
+#include <unordered_map>
+#include "../abstract_client/Result.hpp"
+#include "server_name_parsing.hpp"
+
+using namespace std;
+using namespace post;
+
+namespace utils {
+    /**
+     * Thrown when replica statistics file can't be read or written.
+     */
+    class ReplicaException : public std::exception {
+        protected:
+            string message;
+        public:
+            ReplicaException (string message);
+            virtual const char* what() const throw();
+    };
+
+    /**
+     * Equivalent endpoint of server with its statistics: exponentially
+     * weighted moving averages of connection time, command latency and
+     * error rate.
+     */
+    struct Replica {
+        string host;
+        string port;
+        /**
+         * Time of TCP and TLS handshake and greeting in seconds.
+         */
+        double connectLatency;
+        /**
+         * Round trip of one command (signing in) in seconds.
+         */
+        double commandLatency;
+        /**
+         * Share of failed connections and sessions, 0..1.
+         */
+        double errorRate;
+        /**
+         * Number of samples (0 means replica was never measured).
+         */
+        size_t samples;
+        /**
+         * UNIX time of the last sample.
+         */
+        time_t updated;
+
+        Replica ();
+        /**
+         * Error rate which fades while replica isn't used, so replica
+         * which failed once is tried again later.
+         * @param now Current UNIX time.
+         */
+        double currentErrorRate (time_t now) const;
+    };
+
+    /**
+     * Replicas of server given as `host:port,host:port,...'. Sessions go
+     * to the fastest healthy replica (error rate below one half); replica
+     * which wasn't measured yet is tried first and every `exploration'
+     * session goes to the replica with the oldest statistics, so they
+     * don't get stale. Connection failure fails over to the next replica
+     * in the same order. Statistics are shared by all sessions of process
+     * and persisted in file as `host:port connect command errors samples
+     * updated' lines; lines of other servers are kept.
+     */
+    class ReplicaSet {
+        private:
+            mutable mutex lock;
+            vector<Replica> replicas;
+            string filename;
+            /**
+             * Lines of file which belong to other servers.
+             */
+            vector<string> others;
+            size_t sessions;
+
+            void update (Replica& replica, double& average, double sample,
+                         bool failed);
+        public:
+            /**
+             * Weight of the newest sample in averages.
+             */
+            static const double weight;
+            /**
+             * Every this session measures the least recently used replica.
+             */
+            static const size_t exploration = 16;
+
+            /**
+             * Parse replicas and read their statistics.
+             * @param serverNames Comma separated `host:port' list.
+             * @param filename Statistics file (empty if statistics aren't
+             * persisted). Missing file means no statistics.
+             * @throws BadServerName Thrown if replica can't be parsed.
+             * @throws ReplicaException Thrown if file can't be parsed.
+             */
+            ReplicaSet (const string& serverNames,
+                        const string& filename = string())
+                       throw(BadServerName, ReplicaException);
+            size_t size () const;
+            /**
+             * Get copy of replica with its current statistics.
+             */
+            Replica get (size_t replica) const;
+            /**
+             * Order in which replicas should be tried by a new session.
+             * @return Returns indices of replicas, the best first.
+             */
+            vector<size_t> order ();
+            /**
+             * Record outcome of connection to replica.
+             * @param seconds Connection time (ignored if it failed).
+             */
+            void reportConnect (size_t replica, double seconds,
+                                bool succeeded);
+            /**
+             * Record outcome of command sent to replica.
+             * @param seconds Command latency (ignored if it failed).
+             */
+            void reportCommand (size_t replica, double seconds,
+                                bool succeeded);
+            /**
+             * Connect to the best replica, fail over to the next ones if
+             * connection fails.
+             * @param connect Function which is called with host and port
+             * and returns Result of connection.
+             * @param chosen Reference to write index of connected replica
+             * to it.
+             * @return Returns result of the last attempt.
+             */
+            template <class Connect>
+            Result connect (const Connect& connect, size_t& chosen) {
+                Result result(TRANSPORT_FAILED);
+                for (size_t replica : this->order()) {
+                    Replica target = this->get(replica);
+                    std::chrono::steady_clock::time_point start =
+                        std::chrono::steady_clock::now();
+                    result = connect(target.host, target.port);
+                    std::chrono::duration<double> elapsed =
+                        std::chrono::steady_clock::now() - start;
+                    this->reportConnect(replica, elapsed.count(),
+                                        (bool) result);
+                    if (result) {
+                        chosen = replica;
+                        break;
+                    }
+                }
+                return result;
+            }
+            /**
+             * Write statistics to file. Temporary file is renamed over
+             * the old one.
+             * @throws ReplicaException Thrown if file can't be written.
+             */
+            void save () const throw(ReplicaException);
+            /**
+             * Write statistics of every replica.
+             * @param out Stream to write report to.
+             */
+            void writeReport (ostream& out) const;
+    };
+
+    /**
+     * Shortcut for Replica Set shared pointer.
+     */
+    typedef std::shared_ptr<ReplicaSet> p_RS;
+}
@@ -0,0 +1,437 @@
+#include "service.hpp"
+#include <mutex>
+#include <list>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <sstream>
+#include <cstdio>
+#include <unistd.h>
+#include <boost/asio.hpp>
+#include "../uring_tools/tls.hpp"
+#include "../boost_tools/tls.hpp"
+#include "../pp/pop3_protocol.hpp"
+#include "batch.hpp"
+#include "lines.hpp"
+
+using namespace mail_client;
+using namespace std::chrono;
+
+namespace utils {
+
+    /**
+     * Headers of mailboxes by unique IDs, shared by client connections.
+     * Cache holds up to `limit' octets: the least recently used mailboxes
+     * are evicted first.
+     */
+    class HeaderCache {
+        private:
+            typedef unordered_map<string, string> Headers;
+            struct Entry {
+                Headers headers;
+                size_t octets;
+                list<string>::iterator position;
+            };
+            mutex lock;
+            /**
+             * Mailboxes, the most recently used first.
+             */
+            list<string> recent;
+            unordered_map<string, Entry> mailboxes;
+            size_t octets;
+            size_t limit;
+        public:
+            HeaderCache (size_t limit) {
+                this->octets = 0;
+                this->limit = limit;
+            }
+
+            /**
+             * Take headers of mailbox out of cache.
+             * @param headers Reference to write headers to it (empty if
+             * mailbox isn't cached).
+             */
+            void take (const string& mailbox, Headers& headers) {
+                lock_guard<mutex> guard(this->lock);
+                headers.clear();
+                auto found = this->mailboxes.find(mailbox);
+                if (found == this->mailboxes.end()) {
+                    return;
+                }
+                headers.swap(found->second.headers);
+                this->octets -= found->second.octets;
+                this->recent.erase(found->second.position);
+                this->mailboxes.erase(found);
+            }
+
+            /**
+             * Put headers of mailbox to cache as the most recently used
+             * and evict the least recently used mailboxes over limit.
+             * @param headers Headers which are moved to cache.
+             */
+            void put (const string& mailbox, Headers& headers) {
+                size_t size = 0;
+                for (const auto& header : headers) {
+                    size += header.first.size() + header.second.size();
+                }
+                lock_guard<mutex> guard(this->lock);
+                auto found = this->mailboxes.find(mailbox);
+                if (found != this->mailboxes.end()) {
+                    // Another connection put newer headers meanwhile
+                    this->octets -= found->second.octets;
+                    this->recent.erase(found->second.position);
+                    this->mailboxes.erase(found);
+                }
+                Entry& entry = this->mailboxes[mailbox];
+                entry.headers.swap(headers);
+                entry.octets = size;
+                this->recent.push_front(mailbox);
+                entry.position = this->recent.begin();
+                this->octets += size;
+                while (this->octets > this->limit) {
+                    auto oldest = this->mailboxes.find(this->recent.back());
+                    this->octets -= oldest->second.octets;
+                    this->mailboxes.erase(oldest);
+                    this->recent.pop_back();
+                }
+            }
+    };
+
+    static void skipSpaces (const string& line, size_t& position) {
+        while (position < line.size() && isspace(line[position])) {
+            ++position;
+        }
+    }
+
+    /**
+     * Parse JSON string starting at `position' (at the opening quote).
+     */
+    static bool parseString (const string& line, size_t& position,
+                             string& value) {
+        if (position >= line.size() || line[position] != '"') {
+            return false;
+        }
+        value.clear();
+        for (++position; position < line.size(); ++position) {
+            char c = line[position];
+            if (c == '"') {
+                ++position;
+                return true;
+            }
+            if (c != '\\') {
+                value += c;
+                continue;
+            }
+            if (++position == line.size()) {
+                return false;
+            }
+            switch (line[position]) {
+                case 'b': value += '\b'; break;
+                case 'f': value += '\f'; break;
+                case 'n': value += '\n'; break;
+                case 'r': value += '\r'; break;
+                case 't': value += '\t'; break;
+                case 'u': {
+                    if (position + 4 >= line.size()) {
+                        return false;
+                    }
+                    unsigned code = stoul(line.substr(position + 1, 4),
+                                          NULL, 16);
+                    position += 4;
+                    // Basic plane only: encode as UTF-8
+                    if (code < 0x80) {
+                        value += (char) code;
+                    }
+                    else if (code < 0x800) {
+                        value += (char) (0xC0 | (code >> 6));
+                        value += (char) (0x80 | (code & 0x3F));
+                    }
+                    else {
+                        value += (char) (0xE0 | (code >> 12));
+                        value += (char) (0x80 | ((code >> 6) & 0x3F));
+                        value += (char) (0x80 | (code & 0x3F));
+                    }
+                    break;
+                }
+                default: value += line[position]; break;
+            }
+        }
+        return false;
+    }
+
+    bool parseRequest (const string& line,
+                       unordered_map<string, string>& fields) {
+        size_t position = 0;
+        fields.clear();
+        skipSpaces(line, position);
+        if (position == line.size() || line[position++] != '{') {
+            return false;
+        }
+        skipSpaces(line, position);
+        if (position < line.size() && line[position] == '}') {
+            return true;
+        }
+        try {
+            for (;;) {
+                string key, value;
+                skipSpaces(line, position);
+                if (!parseString(line, position, key)) {
+                    return false;
+                }
+                skipSpaces(line, position);
+                if (position == line.size() || line[position++] != ':') {
+                    return false;
+                }
+                skipSpaces(line, position);
+                if (position < line.size() && line[position] == '"') {
+                    if (!parseString(line, position, value)) {
+                        return false;
+                    }
+                }
+                else {
+                    // Number or literal
+                    size_t end = line.find_first_of(",} \t", position);
+                    if (end == string::npos || end == position) {
+                        return false;
+                    }
+                    value = line.substr(position, end - position);
+                    position = end;
+                }
+                fields[key] = value;
+                skipSpaces(line, position);
+                if (position == line.size()) {
+                    return false;
+                }
+                char c = line[position++];
+                if (c == '}') {
+                    return true;
+                }
+                if (c != ',') {
+                    return false;
+                }
+            }
+        }
+        catch (const logic_error& e) {
+            // Bad \u escape
+            return false;
+        }
+    }
+
+    string jsonString (const string& value) {
+        string result = "\"";
+        for (char c : value) {
+            switch (c) {
+                case '"': result += "\\\""; break;
+                case '\\': result += "\\\\"; break;
+                case '\n': result += "\\n"; break;
+                case '\r': result += "\\r"; break;
+                case '\t': result += "\\t"; break;
+                default:
+                    if ((unsigned char) c < 0x20) {
+                        char escaped[8];
+                        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                        result += escaped;
+                    }
+                    else {
+                        result += c;
+                    }
+            }
+        }
+        return result + "\"";
+    }
+
+    static string failure (const string& message) {
+        return "{\"ok\": false, \"error\": " + jsonString(message) + "}";
+    }
+
+    /**
+     * Write headers (or their field) of every letter to response. Headers
+     * which are in cache aren't downloaded; cache of mailbox is replaced
+     * with headers of current letters. If download fails, headers which
+     * were received are added to cache of mailbox instead.
+     */
+    template <class Client>
+    static Result getHeaders (Client& mailClient, const string& mailbox,
+                              const string& field, HeaderCache& cache,
+                              ostream& response) {
+        strings ids;
+        vector<size_t> sizes;
+        unordered_map<string, string> uids;
+        Result result = mailClient.tryGetLettersIDs(ids, sizes);
+        if (!result) {
+            return result;
+        }
+        // Without UIDL letters can't be recognised and nothing is cached
+        Result listed = mailClient.tryGetLettersUIDs(uids);
+        if (!listed && listed.error() != NEGATIVE_RESPONSE) {
+            return listed;
+        }
+        unordered_map<string, string> known, current;
+        cache.take(mailbox, known);
+        string header;
+        response << "{\"ok\": true, \"values\": [";
+        for (size_t i = 0; i < ids.size(); ++i) {
+            auto uid = uids.find(ids[i]);
+            auto cached = uid == uids.end() ? known.end() :
+                                              known.find(uid->second);
+            if (cached != known.end()) {
+                header.swap(cached->second);
+            }
+            else {
+                result = mailClient.tryGetLetterHeader(ids[i], header);
+                if (!result) {
+                    break;
+                }
+            }
+            response << (i > 0 ? ", " : "")
+                     << jsonString(field.empty() ? getResponseBody(header) :
+                                   getHeaderParameter(header, field));
+            if (uid != uids.end()) {
+                current[uid->second].swap(header);
+            }
+        }
+        response << "]}";
+        if (!result) {
+            // Headers of the letters after failure are still valid; cached
+            // headers which were used are taken back from `current'
+            for (auto& header : current) {
+                known[header.first].swap(header.second);
+            }
+            current.swap(known);
+        }
+        cache.put(mailbox, current);
+        return result;
+    }
+
+    /**
+     * Sign in, perform request and sign out.
+     * @return Returns JSON response.
+     */
+    template <class Client>
+    static string perform (Client& mailClient, const Parameters& parameters,
+                           unordered_map<string, string>& request,
+                           HeaderCache& cache) {
+        const string& login = request["login"];
+        Result result = mailClient.trySignin(login, request["password"]);
+        if (!result) {
+            return failure(result.what());
+        }
+        ostringstream response;
+        if (request["op"] == "stat") {
+            size_t count, octets;
+            result = mailClient.tryGetMailboxStat(count, octets);
+            response << "{\"ok\": true, \"count\": " << count
+                     << ", \"octets\": " << octets << "}";
+        }
+        else {
+            result = getHeaders(mailClient, mailboxName(parameters, login),
+                                request["field"], cache, response);
+        }
+        mailClient.trySignout();
+        return result ? response.str() : failure(result.what());
+    }
+
+    /**
+     * Serve requests of one client. Connection to mail server for the
+     * next request is established right after response is sent, and the
+     * whole session stays on this thread (see `prefetchedCheck').
+     */
+    template <class Client>
+    static void serveClient (const Parameters& parameters,
+                             std::shared_ptr<boost::asio::local::
+                                             stream_protocol::socket> socket,
+                             HeaderCache& cache) {
+        boost::asio::streambuf buffer;
+        duration<double> idle(parameters.prefetchIdle);
+        unique_ptr<Client> ready;
+        Result connected;
+        steady_clock::time_point established;
+        auto prepare = [&] () {
+            try {
+                ready.reset(new Client());
+                connected = ready->tryConnect(parameters.host,
+                                              parameters.port);
+            }
+            catch (const TransportException& e) {
+                ready.reset();
+                connected = Result(TRANSPORT_FAILED);
+            }
+            established = steady_clock::now();
+        };
+        prepare();
+        for (;;) {
+            string line;
+            try {
+                line = readLine(*socket, buffer);
+            }
+            catch (const boost::system::system_error& e) {
+                return;
+            }
+            unordered_map<string, string> request;
+            string response;
+            bool used = false;
+            if (!parseRequest(line, request)) {
+                response = failure("Bad request.");
+            }
+            else if (request["op"] == "ping") {
+                response = "{\"ok\": true}";
+            }
+            else if (request["op"] == "stat" || request["op"] == "headers") {
+                // Server may have dropped connection which waited too long
+                if (!connected || steady_clock::now() - established > idle) {
+                    prepare();
+                }
+                response = connected ? perform(*ready, parameters, request,
+                                               cache) :
+                                       failure(connected.what());
+                used = true;
+            }
+            else {
+                response = failure("Unknown operation.");
+            }
+            try {
+                writeLine(*socket, response);
+            }
+            catch (const boost::system::system_error& e) {
+                return;
+            }
+            if (used) {
+                prepare();
+            }
+        }
+    }
+
+    int runService (const Parameters& parameters) {
+        typedef boost::asio::local::stream_protocol Local;
+        boost::asio::io_service io;
+        HeaderCache cache(parameters.cacheSize);
+        try {
+            // Socket file of previous run would fail bind
+            unlink(parameters.serve.c_str());
+            Local::acceptor acceptor(io, Local::endpoint(parameters.serve));
+            cerr << "Serving on " << parameters.serve << "." << endl;
+            for (;;) {
+                std::shared_ptr<Local::socket> socket(
+                    new Local::socket(io));
+                acceptor.accept(*socket);
+                if (parameters.transport == "uring") {
+                    thread(serveClient<BasicMailClient<POP3Protocol,
+                               URingTLSTransportLayerProvider>>,
+                           std::cref(parameters), socket,
+                           std::ref(cache)).detach();
+                }
+                else {
+                    thread(serveClient<BasicMailClient<POP3Protocol,
+                               TLSTransportLayerProvider>>,
+                           std::cref(parameters), socket,
+                           std::ref(cache)).detach();
+                }
+            }
+        }
+        catch (const boost::system::system_error& e) {
+            cerr << "Service can't listen on `" << parameters.serve << "': "
+                 << e.what() << endl;
+        }
+        return EXIT_FAILURE;
+    }
+}
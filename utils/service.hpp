@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include "command_line.hpp"
+
+using namespace std;
+
+namespace utils {
+    /**
+     * Parse request line: flat JSON object with string and number values,
+     * e.g. {"op": "headers", "login": "user", "password": "secret"}.
+     * Numbers are kept as they're written.
+     * @param line Request line.
+     * @param fields Reference to write key -> value pairs to it.
+     * @return Returns `false' if line isn't such object.
+     */
+    bool parseRequest (const string& line,
+                       unordered_map<string, string>& fields);
+
+    /**
+     * Quote and escape string for JSON.
+     */
+    string jsonString (const string& value);
+
+    /**
+     * Serve requests on Unix socket `parameters.serve' until process is
+     * stopped. Every request is one JSON line and gets one JSON line:
+     *   {"op": "ping"}
+     *   {"op": "stat", "login": ..., "password": ...}
+     *     -> {"ok": true, "count": N, "octets": N}
+     *   {"op": "headers", "login": ..., "password": ..., "field": ...}
+     *     -> {"ok": true, "values": [...]} (whole headers without field)
+     * Failures are {"ok": false, "error": "..."}.
+     * Every client connection keeps a connection to mail server ready
+     * for its next request and headers are cached by unique ID, so only
+     * new letters are downloaded again; cache is limited by
+     * `parameters.cacheSize' and the least recently used mailboxes are
+     * evicted. Mailbox is opened anew for every request: POP3 session
+     * sees mailbox as it was at sign in.
+     * @param parameters Server, transport and socket parameters.
+     * @return Returns EXIT_FAILURE if socket can't be opened.
+     */
+    int runService (const Parameters& parameters);
+}
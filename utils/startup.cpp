@@ -0,0 +1,145 @@
+#include "startup.hpp"
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <algorithm>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../abstract_client/TransportLayerProvider.hpp"
+
+using namespace transport;
+
+namespace utils {
+
+    /**
+     * Environment variable with descriptor which measured process writes
+     * times of its first packet and of its TLS handshake start to.
+     */
+    static const char* startupVariable = "POP3_CLIENT_STARTUP_FD";
+    static int startupFD = -1;
+
+    /**
+     * Monotonic time in nanoseconds (the same clock in every process).
+     */
+    static long long now () {
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec * 1000000000LL + time.tv_nsec;
+    }
+
+    static void reportStartup (ConnectionStage stage) {
+        static bool connecting = false;
+        // Only the first connection attempt is measured
+        if (stage == CONNECTION_STARTING && connecting) {
+            return;
+        }
+        connecting = true;
+        long long time = now();
+        if (write(startupFD, &time, sizeof(time)) != sizeof(time)) {
+            _exit(EXIT_FAILURE);
+        }
+        if (stage == HANDSHAKE_STARTING) {
+            _exit(EXIT_SUCCESS);
+        }
+    }
+
+    bool watchStartup () {
+        const char* fd = getenv(startupVariable);
+        if (fd == NULL) {
+            return false;
+        }
+        startupFD = atoi(fd);
+        TransportLayerProvider::setConnectionStageHandler(reportStartup);
+        return true;
+    }
+
+    /**
+     * Times of one run in microseconds from exec (negative if process
+     * didn't reach the stage).
+     */
+    struct StartupTimes {
+        double firstPacket;
+        double handshake;
+    };
+
+    /**
+     * Run measured process once.
+     */
+    static StartupTimes measureStartup (char* arguments[]) {
+        StartupTimes result{-1, -1};
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0) {
+            return result;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            // Descriptor for the measured process, and the time of exec
+            int fd = dup(fds[1]);
+            setenv(startupVariable, to_string(fd).c_str(), 1);
+            long long time = now();
+            if (write(fd, &time, sizeof(time)) == sizeof(time)) {
+                execv("/proc/self/exe", arguments);
+            }
+            _exit(127);
+        }
+        close(fds[1]);
+        // Exec, the first packet and the handshake start
+        long long times[3];
+        size_t received = 0;
+        ssize_t size;
+        while (received < sizeof(times) &&
+               (size = read(fds[0], (char*) times + received,
+                            sizeof(times) - received)) > 0) {
+            received += size;
+        }
+        close(fds[0]);
+        if (pid > 0) {
+            waitpid(pid, NULL, 0);
+        }
+        if (received >= 2 * sizeof(long long)) {
+            result.firstPacket = (times[1] - times[0]) / 1000.0;
+        }
+        if (received == sizeof(times)) {
+            result.handshake = (times[2] - times[0]) / 1000.0;
+        }
+        return result;
+    }
+
+    static void reportTimes (const char* stage, vector<double>& times,
+                             ostream& out) {
+        sort(times.begin(), times.end());
+        out << fixed << setprecision(2) << "Exec to " << stage << ", "
+            << times.size() << " runs: min " << times.front() / 1000
+            << " p50 " << times[times.size() / 2] / 1000
+            << " p90 " << times[times.size() * 9 / 10] / 1000
+            << " max " << times.back() / 1000 << " ms" << endl;
+    }
+
+    int benchmarkStartup (char* arguments[], size_t runs, ostream& out) {
+        vector<double> firstPackets, handshakes;
+        for (size_t i = 0; i < runs; ++i) {
+            StartupTimes times = measureStartup(arguments);
+            if (times.firstPacket >= 0) {
+                firstPackets.push_back(times.firstPacket);
+            }
+            if (times.handshake >= 0) {
+                handshakes.push_back(times.handshake);
+            }
+        }
+        if (firstPackets.empty()) {
+            cerr << "Measured process didn't start connection." << endl;
+            return EXIT_FAILURE;
+        }
+        reportTimes("first packet", firstPackets, out);
+        if (handshakes.empty()) {
+            cerr << "Measured process didn't start TLS handshake: server "
+                    "should accept connection." << endl;
+            return EXIT_FAILURE;
+        }
+        reportTimes("TLS handshake start", handshakes, out);
+        return handshakes.size() == runs ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+}
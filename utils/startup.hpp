@@ -0,0 +1,31 @@
+#pragma once
+#include <iostream>
+#include <cstddef>
+
+using namespace std;
+
+namespace utils {
+    /**
+     * Watch startup if process was started by startup benchmark: times of
+     * the first packet and of TLS handshake start are reported to
+     * benchmark, and process exits at handshake start.
+     * @return Returns `true' if process is measured by startup benchmark.
+     */
+    bool watchStartup ();
+    /**
+     * Startup benchmark: run this program `runs' times with the same
+     * arguments and measure time from exec to the first packet (SYN) sent
+     * to server and to the start of TLS handshake, when ClientHello is
+     * about to be sent. The first time covers loading, initialization,
+     * command line parsing and name resolution; the second one adds TCP
+     * connection and TLS initialization. Measured process exits at
+     * handshake start, so server has to accept connection but its TLS
+     * isn't measured.
+     * @param arguments Command line arguments of this process.
+     * @param runs Number of runs.
+     * @param out Output stream for report.
+     * @return Returns EXIT_SUCCESS if every run reached handshake start,
+     * returns EXIT_FAILURE otherwise.
+     */
+    int benchmarkStartup (char* arguments[], size_t runs, ostream& out);
+}
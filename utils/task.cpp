@@ -1,27 +1,93 @@
 #include <cstdlib>
 #include <fstream>
+#include <chrono>
 #include "../boost_tools/tls.hpp"
+#include "../uring_tools/tls.hpp"
 #include "../pp/pop3.hpp"
 #include "command_line.hpp"
 #include "server_name_parsing.hpp"
 #include "task.hpp"
+#include "load.hpp"
+#include "batch.hpp"
+#include "cluster.hpp"
+#include "service.hpp"
 
 using namespace boost::program_options;
 
 namespace utils {
 
-    p_MC mailboxEnter (const string& host,  const string& port,
-                       const string& login, const string& password)
+    p_TLP createTransportLayerProvider (const string& transport)
+                                       throw(MailClientException) {
+        try {
+            if (transport == "asio") {
+                return p_TLP(new TLSTransportLayerProvider());
+            }
+            else if (transport == "uring") {
+                return p_TLP(new URingTLSTransportLayerProvider());
+            }
+        }
+        catch (const TransportException& e) {
+            throw mail_client::ConnectionError(string(e.what()));
+        }
+        throw MailClientException("Unknown transport `" + transport + "'.");
+    }
+
+    p_MC mailboxEnter (const Parameters& parameters)
                       throw(MailClientException) {
-        p_TLP transportLayerProvider(new TLSTransportLayerProvider());
+        p_TLP transportLayerProvider =
+            createTransportLayerProvider(parameters.transport);
         p_PP postProvider(new POP3PostProvider(transportLayerProvider));
+        postProvider->setHeaderFilter(parameters.headerFilter);
+        postProvider->setDuplicateFilter(parameters.duplicateFilter,
+            mailboxName(parameters, parameters.login));
+        postProvider->setPipelineDepth(parameters.pipelineDepth);
+        postProvider->setThreads(parameters.threads);
         p_MC mailClient(new MailClient(postProvider));
-        mailClient->connect(host, port);
-        if (password != "") {
-            mailClient->signin(login, password);
+        size_t replica = 0;
+        if (!parameters.replicas) {
+            mailClient->connect(parameters.host, parameters.port);
+        }
+        else if (!parameters.replicas->connect(
+                     [&] (const string& host, const string& port) {
+                         try {
+                             mailClient->connect(host, port);
+                         }
+                         catch (const MailClientException& e) {
+                             return Result(TRANSPORT_FAILED);
+                         }
+                         return Result();
+                     }, replica)) {
+            throw mail_client::ConnectionError("No replica of server is "
+                                               "available.");
+        }
+        if (parameters.password != "" && parameters.replicas) {
+            std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
+            try {
+                mailClient->signin(parameters.login, parameters.password);
+            }
+            catch (const mail_client::TemporaryFailureException& e) {
+                // Busy replica is as bad as unavailable one
+                parameters.replicas->reportCommand(replica, 0, false);
+                throw;
+            }
+            catch (const MailClientException& e) {
+                // Wrong password is the account's fault, not the replica's
+                if (!mailClient->isConnected()) {
+                    parameters.replicas->reportCommand(replica, 0, false);
+                }
+                throw;
+            }
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            parameters.replicas->reportCommand(replica, elapsed.count(),
+                                               true);
+        }
+        else if (parameters.password != "") {
+            mailClient->signin(parameters.login, parameters.password);
         }
         else {
-            mailClient->sendLogin(login);
+            mailClient->sendLogin(parameters.login);
             // Enter password if required
             if (mailClient->isPasswordRequired()) {
                 // Bad method, but nothing better was found
@@ -54,9 +120,289 @@ namespace utils {
         return parameters.size();
     }
 
+    int getRecentMessagesHeadersParameters (const p_MC& mailClient,
+                                            ostream& out,
+                                            const string& parameterName,
+                                            size_t count, time_t since) {
+        strings headers;
+        mailClient->getRecentLettersHeaders(headers, count, since);
+        for (const string& header : headers) {
+            out << getHeaderParameter(header, parameterName) << endl;
+        }
+        return headers.size();
+    }
+
+    int getMessagesHeadersParameters (const p_MC& mailClient,
+                                      const string& outputFilename,
+                                      const string& parameterName,
+                                      const string& journalFilename,
+                                      size_t groupSize) {
+        Journal journal(journalFilename, outputFilename, groupSize);
+        ofstream out(outputFilename, ios_base::app);
+        if (!out.is_open()) {
+            throw ios_base::failure("Can't open file " + outputFilename + ".");
+        }
+        out.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        size_t offset = journal.offset();
+        int count = 0;
+        mailClient->getLettersHeaders(
+            [&] (const string& uid, const string& header) {
+                string line = getHeaderParameter(header, parameterName) + "\n";
+                // Letter should reach the file before journal record
+                out << line << flush;
+                offset += line.size();
+                journal.append(uid, offset);
+                ++count;
+            }, journal.completed());
+        journal.commit();
+        return count;
+    }
+
+    int getMessagesHeadersParameters (const p_MC& mailClient, ostream& out,
+                                      const string& parameterName,
+                                      Archive& archive,
+                                      const string& mailbox) {
+        static const size_t groupSize = 256;
+        vector<Blob> blobs;
+        int count = 0;
+        mailClient->getLettersHeaders(
+            [&] (const string& uid, const string& header) {
+                out << getHeaderParameter(header, parameterName) << endl;
+                ++count;
+                // Letters without unique ID can't be found in archive
+                if (uid.empty() || archive.contains(HEADER_BLOB, mailbox,
+                                                    uid)) {
+                    return;
+                }
+                blobs.push_back(Blob{HEADER_BLOB, mailbox, uid,
+                                     getResponseBody(header)});
+                if (blobs.size() == groupSize) {
+                    archive.append(blobs);
+                    blobs.clear();
+                }
+            }, unordered_set<string>());
+        archive.append(blobs);
+        archive.flush();
+        return count;
+    }
+
+    int archiveMessages (const p_MC& mailClient, ostream& out,
+                         const string& parameterName, Archive& archive,
+                         const string& mailbox,
+                         const Parameters& parameters) {
+        static const size_t groupSize = 256;
+        static const size_t groupOctets = 16 << 20;
+        strings ids, headers, values;
+        vector<size_t> sizes;
+        unordered_map<string, string> uids;
+        vector<Blob> blobs;
+        // Letters and headers of a group are charged to memory budget, and
+        // group is kept within half of its limit
+        MemoryCharge group;
+        size_t limit = MemoryBudget::global().getLimit();
+        size_t groupLimit = limit == 0 ? groupOctets :
+                            min(groupOctets, limit / 2);
+        size_t octets = 0;
+        int count = 0;
+        mailClient->getLettersIDs(ids, sizes);
+        try {
+            mailClient->getLettersUIDs(uids);
+        }
+        catch (const MailClientException& e) {
+            // Server without UIDL: letters can't be found in archive, so
+            // they're downloaded and not stored
+            uids.clear();
+        }
+        // Fields of a group are extracted in parallel and the group is
+        // compressed in parallel
+        auto flush = [&] () {
+            getHeadersParameters(headers, parameterName, values,
+                                 parameters.threads);
+            for (const string& value : values) {
+                out << value << endl;
+            }
+            archive.append(blobs);
+            count += headers.size();
+            headers.clear();
+            blobs.clear();
+            octets = 0;
+            group.resize(0);
+        };
+        for (size_t i = 0; i < ids.size(); ++i) {
+            const string& id = ids[i];
+            const string& uid = uids[id];
+            Blob header{HEADER_BLOB, mailbox, uid, string()};
+            Blob message{MESSAGE_BLOB, mailbox, uid, string()};
+            MemoryCharge letter;
+            // Archived letter isn't downloaded again: its header is local
+            bool archived = !uid.empty() &&
+                            archive.contains(MESSAGE_BLOB, mailbox, uid) &&
+                            archive.read(header);
+            if (!archived) {
+                // Group is written before the letter would overflow it
+                if (!headers.empty() && octets + sizes[i] > groupLimit) {
+                    flush();
+                }
+                bool inHeader = true, lineStart = true;
+                size_t headerSize = 0;
+                mailClient->getLetter(id, [&] (const char* data,
+                                               size_t size) {
+                    message.data.append(data, size);
+                    if (message.data.capacity() != letter.size()) {
+                        letter.resize(message.data.capacity());
+                    }
+                    // Header ends with the first empty line
+                    if (inHeader && lineStart && (data[0] == '\n' ||
+                        (size == 2 && data[0] == '\r'))) {
+                        inHeader = false;
+                        headerSize = message.data.size();
+                    }
+                    lineStart = data[size - 1] == '\n';
+                });
+                header.data.assign(message.data, 0, inHeader ?
+                                   message.data.size() : headerSize);
+            }
+            // The same filters as Post Provider applies to TOP headers
+            if ((parameters.headerFilter &&
+                 !parameters.headerFilter->matches(header.data)) ||
+                (parameters.duplicateFilter &&
+                 !parameters.duplicateFilter->accept(header.data,
+                                                     mailbox))) {
+                continue;
+            }
+            // Letters without unique ID can't be found in archive
+            if (!archived && !uid.empty()) {
+                octets += header.data.size() + message.data.size();
+                blobs.push_back(header);
+                blobs.push_back(std::move(message));
+            }
+            octets += header.data.size();
+            headers.push_back(std::move(header.data));
+            // Letter's memory moves to the group
+            letter.resize(0);
+            group.resize(octets);
+            if (headers.size() >= MemoryBudget::global().window(groupSize) ||
+                octets >= groupLimit) {
+                flush();
+            }
+        }
+        flush();
+        archive.flush();
+        return count;
+    }
+
+    int printArchivedHeader (const Parameters& parameters, ostream& out) {
+        try {
+            Archive archive(parameters.archive);
+            Blob blob{HEADER_BLOB, mailboxName(parameters, parameters.login),
+                      parameters.archiveGet, string()};
+            if (!archive.read(blob)) {
+                cerr << "Letter " << parameters.archiveGet
+                     << " isn't archived." << endl;
+                return EXIT_FAILURE;
+            }
+            out << blob.data;
+        }
+        catch (const ArchiveException& e) {
+            cerr << "Error occured when application worked with archive: "
+                 << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    int replayArchive (const Parameters& parameters, ostream& out) {
+        try {
+            Archive archive(parameters.archive);
+            string mailbox = mailboxName(parameters, parameters.login);
+            strings headers, values;
+            // Headers are collected first to extract the field in parallel
+            archive.scan([&] (const Blob& blob) {
+                if (blob.kind == HEADER_BLOB && blob.mailbox == mailbox) {
+                    headers.push_back(blob.data);
+                }
+            });
+            getHeadersParameters(headers, parameters.archiveReplay, values,
+                                 parameters.threads);
+            for (const string& value : values) {
+                out << value << endl;
+            }
+        }
+        catch (const ArchiveException& e) {
+            cerr << "Error occured when application worked with archive: "
+                 << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    int extractAttachments (const p_MC& mailClient, const string& directory,
+                            const p_DF& duplicateFilter,
+                            const string& mailbox, ostream& out) {
+        strings ids;
+        vector<size_t> sizes;
+        string header;
+        mailClient->getLettersIDs(ids, sizes);
+        size_t parts = 0, octets = 0, letters = 0;
+        for (const string& id : ids) {
+            // Header is much cheaper than RETR of a copy
+            if (duplicateFilter) {
+                mailClient->getLetterHeader(id, header);
+                if (!duplicateFilter->accept(header, mailbox)) {
+                    continue;
+                }
+            }
+            ++letters;
+            AttachmentFiles files(directory, id);
+            MimeParser parser(files);
+            mailClient->getLetter(id, [&parser](const char* data,
+                                                size_t size) {
+                parser.feed(data, size);
+            });
+            parser.finish();
+            parts += parser.count();
+            octets += files.size();
+        }
+        out << "Extracted " << parts << " parts (" << octets
+            << " octets) of " << letters << " messages to " << directory
+            << "." << endl;
+        return letters;
+    }
+
+    bool isMailboxUnchanged (const p_MC& mailClient,
+                             const Parameters& parameters,
+                             const FingerprintStore& store,
+                             Fingerprint& fingerprint) {
+        mailClient->getMailboxStat(fingerprint.count, fingerprint.octets);
+        if (parameters.fingerprintUIDL && fingerprint.count > 0) {
+            // Server without UIDL answers negatively: fingerprint is
+            // compared by count and size only, as batch run does
+            try {
+                mailClient->getLetterUID(to_string(fingerprint.count),
+                                         fingerprint.lastUID);
+            }
+            catch (const MailClientException& e) {
+                fingerprint.lastUID.clear();
+            }
+        }
+        Fingerprint previous;
+        return store.find(mailboxName(parameters, parameters.login),
+                          previous) && previous == fingerprint;
+    }
+
+    int deleteMessages (const p_MC& mailClient, const RetentionPolicy& policy,
+                        ostream& out) {
+        RetentionReport report;
+        mailClient->deleteLetters(policy, report);
+        out << (policy.dryRun ? "Would delete " : "Deleted ")
+            << report.deleted << " messages, " << report.octets
+            << " octets " << (policy.dryRun ? "would be " : "")
+            << "reclaimed." << endl;
+        return report.deleted;
+    }
 
     int getCommandLineParameters (int argumentsCount, char* arguments[],
-                  string& host, string& port, string& login, string& password) {
+                                  Parameters& parameters) {
         /**
          * Prepare command line arguments processing.
          */
@@ -84,45 +430,254 @@ namespace utils {
          * Process variables.
          */
         string server_name;
-        if (!getParameters(variablesMap, login, password, server_name)) {
-            cerr << "Not all mandatory parameters were set." << endl
-                 << "Please, run `" << arguments[0]
-                 << " --help' for more information." << endl;
+        try {
+            if (!getParameters(variablesMap, parameters, server_name)) {
+                cerr << "Not all mandatory parameters were set." << endl
+                     << "Please, run `" << arguments[0]
+                     << " --help' for more information." << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        catch (const ios_base::failure& e) {
+            cerr << "An error occured: " << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+        if (!server_name.empty()) {
+            parseServerName(server_name.substr(0, server_name.find(',')),
+                            parameters.host, parameters.port);
+        }
+        if (server_name.find(',') != string::npos ||
+            (!server_name.empty() && !parameters.replicaStats.empty())) {
+            try {
+                parameters.replicas.reset(
+                    new ReplicaSet(server_name, parameters.replicaStats));
+            }
+            catch (const BadServerName& e) {
+                cerr << "An error occured: " << e.what() << endl;
+                return EXIT_FAILURE;
+            }
+            catch (const ReplicaException& e) {
+                cerr << "Bad replica statistics: " << e.what() << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        if (parameters.transport != "asio" && parameters.transport != "uring") {
+            cerr << "Unknown transport `" << parameters.transport << "'."
+                 << endl;
             return EXIT_FAILURE;
         }
-        parseServerName(server_name, host, port);
+        if (!parameters.filters.empty()) {
+            parameters.headerFilter.reset(new HeaderFilter());
+            try {
+                for (const string& filter : parameters.filters) {
+                    parameters.headerFilter->addRule(filter);
+                }
+            }
+            catch (const FilterException& e) {
+                cerr << "Bad filter: " << e.what() << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        if (!parameters.dedupe.empty()) {
+            try {
+                parameters.duplicateFilter.reset(
+                    new DuplicateFilter(parameters.dedupe));
+            }
+            catch (const DuplicateFilterException& e) {
+                cerr << "Bad dedupe file: " << e.what() << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        MemoryBudget::global().setLimit(parameters.memoryBudget);
+        if ((!parameters.archiveGet.empty() ||
+             !parameters.archiveReplay.empty()) &&
+            parameters.archive.empty()) {
+            cerr << "Archive should be set to read from it." << endl;
+            return EXIT_FAILURE;
+        }
+        if (parameters.load.sessions > 0) {
+            if (parameters.password.empty()) {
+                cerr << "Password should be set to generate load." << endl;
+                return EXIT_FAILURE;
+            }
+            const LoadParameters& load = parameters.load;
+            if (!(load.connectRate > 0) || !(load.duration > 0) ||
+                !(load.interval > 0)) {
+                cerr << "Load rate, duration and interval should be "
+                        "positive." << endl;
+                return EXIT_FAILURE;
+            }
+            try {
+                parseLoadScript(parameters.load.script);
+            }
+            catch (const BadLoadScript& e) {
+                cerr << "Bad load script: " << e.what() << endl;
+                return EXIT_FAILURE;
+            }
+        }
 
         return EXIT_SUCCESS;
     }
 
-    int task (const string& host,  const string& port,
-              const string& login, const string& password) {
+    void reportMemoryBudget (ostream& out) {
+        MemoryBudget& budget = MemoryBudget::global();
+        out << "Memory budget: high water " << (budget.getHighWater() >> 10)
+            << " of " << (budget.getLimit() >> 10) << " KiB, "
+            << budget.getWaits() << " waits, " << budget.getOverdrafts()
+            << " overdrafts." << endl;
+    }
+
+    int task (const Parameters& parameters) {
+        if (!parameters.coordinator.empty() && !parameters.accounts.empty()) {
+            return runCoordinator(parameters, cout);
+        }
+        if (!parameters.serve.empty()) {
+            return runService(parameters);
+        }
+        if (!parameters.worker.empty()) {
+            return runWorker(parameters);
+        }
+        if (parameters.load.sessions > 0) {
+            return generateLoad(parameters, cout);
+        }
+        if (!parameters.archiveGet.empty()) {
+            return printArchivedHeader(parameters, cout);
+        }
+        if (!parameters.archiveReplay.empty()) {
+            return replayArchive(parameters, cout);
+        }
+        if (!parameters.accounts.empty()) {
+            return runBatch(parameters, cout);
+        }
         p_MC mailClient;
         try {
-            mailClient = mailboxEnter(host, port, login, password);
+            mailClient = mailboxEnter(parameters);
         }
         catch (const MailClientException& e) {
             cerr << "Error occured when tried to enter the mailbox: "
                  << e.what() << endl;
+            // Failures of replicas are kept, so the next run avoids them
+            if (parameters.replicas) {
+                try {
+                    parameters.replicas->save();
+                }
+                catch (const ReplicaException& e) {
+                    cerr << "Error occured when application worked with "
+                            "replica statistics: " << e.what() << endl;
+                }
+            }
             return EXIT_FAILURE;
         }
         try {
-            string outputFilename = "letters.txt";
-            ofstream out(outputFilename);
-            if (!out.is_open()) {
-                throw ios_base::failure("Can't open file " +
-                                        outputFilename + ".");
-            }
-            out.exceptions(std::ofstream::failbit | std::ofstream::badbit);
-            cout << getMessagesHeadersParameters(mailClient, out, "Subject")
-                 << endl;
-            out.close();
+            // Retention depends on time, so it isn't skipped
+            unique_ptr<FingerprintStore> fingerprints;
+            Fingerprint fingerprint;
+            bool unchanged = false;
+            if (!parameters.fingerprints.empty() && !parameters.purge) {
+                fingerprints.reset(
+                    new FingerprintStore(parameters.fingerprints));
+                unchanged = isMailboxUnchanged(mailClient, parameters,
+                                               *fingerprints, fingerprint);
+            }
+            if (unchanged) {
+                cerr << "Mailbox is unchanged since the last run." << endl;
+            }
+            else if (parameters.purge) {
+                deleteMessages(mailClient, parameters.retention, cout);
+            }
+            else if (!parameters.attachments.empty()) {
+                extractAttachments(mailClient, parameters.attachments,
+                                   parameters.duplicateFilter,
+                                   mailboxName(parameters, parameters.login),
+                                   cout);
+            }
+            else if (!parameters.journal.empty()) {
+                cout << getMessagesHeadersParameters(mailClient,
+                            "letters.txt", "Subject", parameters.journal,
+                            parameters.journalGroup) << endl;
+            }
+            else {
+                string outputFilename = "letters.txt";
+                ofstream out(outputFilename);
+                if (!out.is_open()) {
+                    throw ios_base::failure("Can't open file " +
+                                            outputFilename + ".");
+                }
+                out.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+                if (parameters.last > 0) {
+                    cout << getRecentMessagesHeadersParameters(mailClient,
+                                out, "Subject", parameters.last,
+                                parameters.since) << endl;
+                }
+                else if (!parameters.archive.empty() &&
+                         parameters.archiveMessages) {
+                    Archive archive(parameters.archive, 256 << 20,
+                                    parameters.threads);
+                    cout << archiveMessages(mailClient, out, "Subject",
+                                archive,
+                                mailboxName(parameters, parameters.login),
+                                parameters) << endl;
+                }
+                else if (!parameters.archive.empty()) {
+                    Archive archive(parameters.archive, 256 << 20,
+                                    parameters.threads);
+                    cout << getMessagesHeadersParameters(mailClient, out,
+                                "Subject", archive,
+                                mailboxName(parameters, parameters.login))
+                         << endl;
+                }
+                else {
+                    cout << getMessagesHeadersParameters(mailClient, out,
+                                                         "Subject") << endl;
+                }
+                out.close();
+            }
+            if (fingerprints && !unchanged) {
+                fingerprints->update(mailboxName(parameters,
+                                                 parameters.login),
+                                     fingerprint);
+                fingerprints->save();
+            }
+            if (parameters.replicas) {
+                parameters.replicas->save();
+                parameters.replicas->writeReport(cerr);
+            }
+            if (parameters.duplicateFilter) {
+                parameters.duplicateFilter->save();
+                cerr << "Skipped " << parameters.duplicateFilter->
+                        getDuplicates() << " duplicates." << endl;
+            }
+        }
+        catch (const ReplicaException& e) {
+            cerr << "Error occured when application worked with replica "
+                    "statistics: " << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+        catch (const DuplicateFilterException& e) {
+            cerr << "Error occured when application worked with seen "
+                    "Message-IDs: " << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+        catch (const FingerprintException& e) {
+            cerr << "Error occured when application worked with "
+                    "fingerprints: " << e.what() << endl;
+            return EXIT_FAILURE;
         }
         catch (const ios_base::failure& e) {
             cerr << "Error occured when application worked with file: "
                  << e.what() << endl;
             return EXIT_FAILURE;
         }
+        catch (const JournalException& e) {
+            cerr << "Error occured when application worked with journal: "
+                 << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+        catch (const ArchiveException& e) {
+            cerr << "Error occured when application worked with archive: "
+                 << e.what() << endl;
+            return EXIT_FAILURE;
+        }
         catch (const MailClientException& e) {
             cerr << "Mail Client error occured when tried to read messages: "
                  << e.what() << endl;
@@ -1,21 +1,31 @@
 #pragma once
 #include "../ac_includes.hpp"
+#include "command_line.hpp"
+#include "journal.hpp"
+#include "fingerprint.hpp"
+#include "archive.hpp"
+#include "attachments.hpp"
 
 using namespace mail_client;
 
 namespace utils {
+    /**
+     * Create Transport Layer Provider by its name.
+     * @param transport Transport name: `asio' or `uring'.
+     * @return Returns shared pointer to new Transport Layer Provider.
+     * @throws MailClientException Thrown if transport is unknown or can't
+     * be created.
+     */
+    p_TLP createTransportLayerProvider (const string& transport)
+                                       throw(MailClientException);
     /**
      * Enter the mailbox and return pointer to mail client.
-     * @param host Email server host.
-     * @param port Email service port.
-     * @param login User login.
-     * @param password User password.
+     * @param parameters Server, user and transport parameters.
      * @return Returns shared pointer to new mailbox client.
      * @throws MailClientException Thrown if something's gone wrong with
      * Mail Client.
      */
-    p_MC mailboxEnter (const string& host,  const string& port,
-                       const string& login, const string& password)
+    p_MC mailboxEnter (const Parameters& parameters)
                       throw(MailClientException);
     /**
      * Read messages headers in a file and return their number.
@@ -28,27 +38,169 @@ namespace utils {
      * Mail Client problem ocured.
      */
     int getMessagesHeaders (const p_MC& mailClient, ostream& out);
+    /**
+     * Write parameter of the newest messages to stream, newest first.
+     * @param mailClient Mail Client which is ready to get messages from
+     * mailbox.
+     * @param out Output stream which should contain parameters.
+     * @param parameterName Name of header parameter to write.
+     * @param count Maximal number of messages to look at.
+     * @param since UNIX time of the oldest interesting message (0 disables
+     * the cutoff).
+     * @return Returns number of written messages.
+     * @throws ios_base::failure Thrown if stream error occured.
+     * @throws MailClientException Thrown if connection error or another
+     * Mail Client problem ocured.
+     */
+    int getRecentMessagesHeadersParameters (const p_MC& mailClient,
+                                            ostream& out,
+                                            const string& parameterName,
+                                            size_t count, time_t since);
+    /**
+     * Write parameter of new messages to file and remember them in journal.
+     * Messages which are already in journal are not downloaded; output is
+     * truncated to the last message recorded in journal and appended.
+     * @param mailClient Mail Client which is ready to get messages from
+     * mailbox.
+     * @param outputFilename File to write parameters to.
+     * @param parameterName Name of header parameter to write.
+     * @param journalFilename Journal file name.
+     * @param groupSize Number of messages per journal commit.
+     * @return Returns number of received messages.
+     * @throws ios_base::failure Thrown if stream error occured.
+     * @throws JournalException Thrown if journal can't be used.
+     * @throws MailClientException Thrown if connection error or another
+     * Mail Client problem ocured.
+     */
+    int getMessagesHeadersParameters (const p_MC& mailClient,
+                                      const string& outputFilename,
+                                      const string& parameterName,
+                                      const string& journalFilename,
+                                      size_t groupSize);
+    /**
+     * Write parameter of messages to stream and store their headers in
+     * archive. Headers are appended in groups, so they are compressed in
+     * parallel; headers which are already archived aren't appended again.
+     * @param mailClient Mail Client which is ready to get messages from
+     * mailbox.
+     * @param out Output stream which should contain parameters.
+     * @param parameterName Name of header parameter to write.
+     * @param archive Archive to store headers in.
+     * @param mailbox Mailbox name in archive.
+     * @return Returns number of received messages.
+     * @throws ios_base::failure Thrown if stream error occured.
+     * @throws ArchiveException Thrown if archive can't be written.
+     * @throws MailClientException Thrown if connection error or another
+     * Mail Client problem ocured.
+     */
+    int getMessagesHeadersParameters (const p_MC& mailClient, ostream& out,
+                                      const string& parameterName,
+                                      Archive& archive,
+                                      const string& mailbox);
+    /**
+     * Write parameter of messages to stream and store whole messages in
+     * archive. Every message is downloaded once with RETR and its header
+     * is split from it while it's received, so header doesn't cross the
+     * wire twice (TOP and then RETR). Header is archived too, and
+     * parameters are extracted from headers of a group in parallel like
+     * in `getLettersHeadersParameters'. Messages which are already
+     * archived aren't downloaded: their archived headers are used.
+     * Header filter and Duplicate Filter of `parameters' are applied to
+     * headers.
+     * @param mailClient Mail Client which is ready to get messages from
+     * mailbox.
+     * @param out Output stream which should contain parameters.
+     * @param parameterName Name of header parameter to write.
+     * @param archive Archive to store messages in.
+     * @param mailbox Mailbox name in archive.
+     * @param parameters Filters and number of threads.
+     * @return Returns number of written messages.
+     * @throws ios_base::failure Thrown if stream error occured.
+     * @throws ArchiveException Thrown if archive can't be written.
+     * @throws MailClientException Thrown if connection error or another
+     * Mail Client problem ocured or if server doesn't support UIDL.
+     */
+    int archiveMessages (const p_MC& mailClient, ostream& out,
+                         const string& parameterName, Archive& archive,
+                         const string& mailbox,
+                         const Parameters& parameters);
+    /**
+     * Write archived header of letter `parameters.archiveGet'.
+     * @param parameters User, server and archive parameters.
+     * @param out Output stream for header.
+     * @return Returns EXIT_SUCCESS if header was found,
+     * returns EXIT_FAILURE otherwise.
+     */
+    int printArchivedHeader (const Parameters& parameters, ostream& out);
+    /**
+     * Delete messages selected by retention policy and write report.
+     * Deletion is committed when Mail Client signs out.
+     * @param mailClient Mail Client which is ready to get messages from
+     * mailbox.
+     * @param policy Which messages to delete.
+     * @param out Output stream for report.
+     * @return Returns number of deleted messages.
+     * @throws MailClientException Thrown if connection error or another
+     * Mail Client problem ocured.
+     */
+    int deleteMessages (const p_MC& mailClient, const RetentionPolicy& policy,
+                        ostream& out);
+    /**
+     * Stream every message through MIME parser and write its decoded parts
+     * to files in directory (see AttachmentFiles). Messages aren't kept in
+     * memory, so their size doesn't matter. With Duplicate Filter header
+     * of every message is read first and copies of letters from other
+     * mailboxes aren't downloaded at all.
+     * @param mailClient Mail Client which is ready to get messages from
+     * mailbox.
+     * @param directory Directory for parts.
+     * @param duplicateFilter Set of seen Message-IDs (may be NULL).
+     * @param mailbox Mailbox name for Duplicate Filter.
+     * @param out Output stream for report.
+     * @return Returns number of processed messages.
+     * @throws ios_base::failure Thrown if file error occured.
+     * @throws MailClientException Thrown if connection error or another
+     * Mail Client problem ocured.
+     */
+    int extractAttachments (const p_MC& mailClient, const string& directory,
+                            const p_DF& duplicateFilter,
+                            const string& mailbox, ostream& out);
+    /**
+     * Get fingerprint of mailbox (STAT and, if requested, unique ID of the
+     * last message) and compare it with the stored one.
+     * @param mailClient Mail Client which is ready to get messages from
+     * mailbox.
+     * @param parameters User, server and fingerprint parameters.
+     * @param store Fingerprints of the previous run.
+     * @param fingerprint Reference to write current fingerprint to it.
+     * @return Returns `true' if mailbox is unchanged since the last run.
+     * @throws MailClientException Thrown if connection error or another
+     * Mail Client problem ocured.
+     */
+    bool isMailboxUnchanged (const p_MC& mailClient,
+                             const Parameters& parameters,
+                             const FingerprintStore& store,
+                             Fingerprint& fingerprint);
     /**
      * Read needed command line parameters.
-     * @param host Reference to email server host.
-     * @param port Reference to email service port.
-     * @param login User login.
-     * @param password User password.
+     * @param parameters Reference to write parameters to it.
      * @return Returns EXIT_SUCCESS if no errors occured,
      * returns EXIT_FAILURE otherwise.
      */
     int getCommandLineParameters (int argumentsCount, char* arguments[],
-                  string& host, string& port, string& login, string& password);
+                                  Parameters& parameters);
+    /**
+     * Write high-water mark of memory budget and how often sessions waited
+     * for it.
+     * @param out Stream to write report to.
+     */
+    void reportMemoryBudget (ostream& out);
     /**
      * Complete my task: connect to server, get emails list, write it to
      * file `letters.txt' and display number of emails on display.
-     * @param host Email server host.
-     * @param port Email service port.
-     * @param login User login.
-     * @param password User password.
+     * @param parameters Server, user and transport parameters.
      * @return Returns EXIT_SUCCESS if no errors occured,
      * returns EXIT_FAILURE otherwise.
      */
-    int task (const string& host,  const string& port,
-              const string& login, const string& password);
+    int task (const Parameters& parameters);
 }